@@ -0,0 +1,104 @@
+#include "admission.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace tftpd {
+
+void admission::configure(const admission_limit &limit)
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    limit_ = limit;
+    grant_waiting();
+}
+
+void admission::reserve(ticket &t, size_t minimum, size_t maximum)
+{
+    t.memory = std::max(minimum, std::min(maximum, limit_.memory - memory_));
+    t.granted = true;
+    if (t.memory < maximum) {
+        clamped_++;
+    }
+    memory_ += t.memory;
+    sessions_++;
+}
+
+admission::verdict admission::acquire(ticket &t, size_t minimum, size_t maximum, std::function<void()> granted)
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    if (queue_.empty() && fits(minimum)) {
+        reserve(t, minimum, maximum);
+        return verdict::admitted;
+    }
+    if (queue_.size() >= limit_.queue) {
+        refused_++;
+        return verdict::refused;
+    }
+    queue_.push_back({&t, minimum, maximum, std::move(granted)});
+    queued_++;
+    return verdict::queued;
+}
+
+bool admission::resize(ticket &t, size_t memory)
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    if (!t.granted) {
+        return false;
+    }
+    if (memory < t.memory) {
+        memory_ -= t.memory - memory;
+        t.memory = memory;
+        grant_waiting();
+    } else if (memory > t.memory) {
+        if (memory - t.memory > limit_.memory - std::min(memory_, limit_.memory)) {
+            return false;
+        }
+        memory_ += memory - t.memory;
+        t.memory = memory;
+    }
+    return true;
+}
+
+bool admission::dequeue(ticket &t)
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    auto it = std::find_if(queue_.begin(), queue_.end(), [&t](const waiter &w) { return w.t == &t; });
+    if (it == queue_.end()) {
+        return false;
+    }
+    queue_.erase(it);
+    return true;
+}
+
+void admission::release(ticket &t)
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    if (!dequeue(t) && t.granted) {
+        memory_ -= t.memory;
+        sessions_--;
+        t = ticket{};
+        grant_waiting();
+    }
+}
+
+void admission::grant_waiting()
+{
+    // NOTE: in order, a large request is not overtaken by smaller ones
+    while (!queue_.empty() && fits(queue_.front().minimum)) {
+        auto w = std::move(queue_.front());
+        queue_.pop_front();
+        reserve(*w.t, w.minimum, w.maximum);
+        w.granted();
+    }
+}
+
+void admission::count(request_counters &counters) const
+{
+    std::lock_guard<std::recursive_mutex> const lock(mutex_);
+    counters.queued = queued_;
+    counters.refused = refused_;
+    counters.clamped = clamped_;
+    counters.sessions = sessions_;
+}
+
+} // namespace tftpd
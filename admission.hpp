@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * Admission control of the server sessions.
+ *
+ * A session reserves its buffer memory when its request is accepted, from
+ * a budget shared by all sessions of the process, together with a slot of
+ * the maximal number of sessions.  If the budget left is too small for the
+ * largest blksize, the session gets less and has to negotiate a smaller
+ * one.  A request which does not fit at all waits in a bounded queue for a
+ * session to end, beyond that it is refused.
+ */
+#include "async_tftpd_server.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace tftpd {
+
+class admission
+{
+public:
+    enum class verdict
+    {
+        admitted, ///< the memory is reserved
+        queued,   ///< the granted function is called when it is
+        refused,  ///< the queue is full too
+    };
+
+    struct ticket
+    {
+        size_t memory{0}; ///< reserved
+        bool granted{false};
+    };
+
+    explicit admission(const admission_limit &limit = {}) : limit_(limit) {}
+
+    /// the limit applies to the following requests, sessions running keep their memory
+    void configure(const admission_limit &limit);
+
+    /// reserve between minimum and maximum bytes of memory for a session
+    verdict acquire(ticket &t, size_t minimum, size_t maximum, std::function<void()> granted);
+
+    /// return what the session does not need of its reservation, or reserve what it needs more,
+    /// false if the budget left is too small for that
+    bool resize(ticket &t, size_t memory);
+
+    /// leave the queue, false if the ticket is granted already
+    bool dequeue(ticket &t);
+
+    /// the session ended or left the queue, the next ones waiting may start
+    void release(ticket &t);
+
+    /// adds the admission counters to the given ones
+    void count(request_counters &counters) const;
+
+private:
+    struct waiter
+    {
+        ticket *t;
+        size_t minimum;
+        size_t maximum;
+        std::function<void()> granted;
+    };
+
+    bool fits(size_t minimum) const { return sessions_ < limit_.max_sessions && memory_ + minimum <= limit_.memory; }
+    void reserve(ticket &t, size_t minimum, size_t maximum);
+    void grant_waiting();
+
+    // NOTE: recursive, the granted function may start the session at once
+    mutable std::recursive_mutex mutex_;
+    admission_limit limit_;
+    size_t sessions_{0};
+    size_t memory_{0};
+    std::deque<waiter> queue_;
+    uint64_t queued_{0};
+    uint64_t refused_{0};
+    uint64_t clamped_{0};
+};
+
+} // namespace tftpd
@@ -0,0 +1,133 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: counts the heap allocations of the receiver per DATA block received! CK
+//
+// The test is the client on a blocking socket and runs the io_context of the
+// server on the same thread, one handler at a time, until the ACK arrived.
+
+#include "tftpd.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+std::atomic<size_t> allocations{0};
+
+/// NOTE: both operator new use malloc(), so each delete frees with free() what it got
+void *counted_malloc(std::size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+} // namespace
+
+void *operator new(std::size_t size) { return counted_malloc(size); }
+void *operator new[](std::size_t size) { return counted_malloc(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t /*size*/) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t /*size*/) noexcept { std::free(p); }
+
+namespace {
+
+constexpr uint16_t port{6971};
+const char *const rootdir{"/tmp/tftpboot-alloc-test"};
+constexpr size_t blksize{1428};
+constexpr size_t warmup{100};
+constexpr size_t measured{2000};
+
+using boost::asio::ip::udp;
+
+/// the ACK of the next block, the server's handlers run meanwhile
+u_short wait_ack(boost::asio::io_context &io_context, udp::socket &client, udp::endpoint &tid)
+{
+    while (client.available() == 0) {
+        (void)io_context.run_one();
+    }
+    std::array<char, PKTSIZE> ack{};
+    (void)client.receive_from(boost::asio::buffer(ack), tid);
+    auto const *tp = reinterpret_cast<const struct tftphdr *>(ack.data());
+    assert(ntohs(tp->th_opcode) == ACK || ntohs(tp->th_opcode) == OACK);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    return ntohs(tp->th_opcode) == ACK ? ntohs(tp->th_block) : 0;
+}
+
+} // namespace
+
+int main()
+{
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_WARNING));
+    (void)mkdir(rootdir, 0777);
+    tftpd::g_rootdir = rootdir;
+
+    try {
+        boost::asio::io_context io_context;
+        tftpd::receiver session(io_context, port);
+
+        udp::socket client(io_context, udp::endpoint(udp::v4(), 0));
+        udp::endpoint tid;
+        const char wrq[] = "\0\2alloc_test.dat\0octet\0blksize\0001428"; // NOTE: ends with '\0' too
+        (void)client.send_to(boost::asio::buffer(wrq, sizeof(wrq)),
+                             udp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+        (void)wait_ack(io_context, client, tid);
+
+        std::vector<char> pkt(TFTP_HEADER + blksize);
+        auto *tp = reinterpret_cast<struct tftphdr *>(pkt.data());
+        tp->th_opcode = htons(static_cast<u_short>(DATA));
+        size_t before = 0;
+        for (size_t block = 1; block <= warmup + measured; ++block) {
+            if (block == warmup + 1) {
+                before = allocations;
+            }
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            tp->th_block = htons(static_cast<u_short>(block));
+            (void)client.send_to(boost::asio::buffer(pkt), tid);
+            assert(wait_ack(io_context, client, tid) == static_cast<u_short>(block));
+        }
+        size_t const steady = allocations - before;
+        std::cout << "allocations: " << steady << " for " << measured << " blocks" << std::endl;
+
+        // the last block, then the server dallies for the final ack
+        tp->th_block = htons(static_cast<u_short>(warmup + measured + 1));
+        (void)client.send_to(boost::asio::buffer(pkt.data(), TFTP_HEADER), tid);
+        io_context.run();
+        assert(session.get_filename() == std::string(rootdir) + "/alloc_test.dat");
+
+        assert(steady == 0);
+
+        // a packet buffer released is reused from the free list of its size class
+        {
+            auto buffer = tftpd::g_packets.get(1000);
+            assert(buffer.capacity() == TFTP_HEADER + 1428);
+        }
+        auto const reused = tftpd::g_packets.reused();
+        before = allocations;
+        {
+            auto buffer = tftpd::g_packets.get(1428);
+            buffer.resize(PKTSIZE);
+        }
+        assert(allocations == before);
+        assert(tftpd::g_packets.reused() == reused + 1);
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,615 @@
+/*
+ * Asynchronous TFTP client (RFC1350) with option negotiation after
+ * RFC2347 (options), RFC2348 (blksize), RFC2349 (timeout, tsize) and
+ * RFC7440 (windowsize).
+ *
+ * Every transfer owns its socket and timer and keeps itself alive with a
+ * shared_ptr captured by its pending handlers, so many transfers can run
+ * on one io_context.  Block numbers wrap from 65535 to 0.
+ */
+#include "async_tftp_client.hpp"
+
+#include "tftp/tftpsubs.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cerrno>
+#include <cinttypes> // strtoumax used
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <strings.h> // strcasecmp used
+#include <sys/stat.h>
+#include <utility>
+
+namespace tftpd {
+namespace {
+
+using boost::asio::ip::udp;
+using clock_type = std::chrono::steady_clock;
+
+/// fills the buffer with the next DATA payload, returns the length or -1
+using reader = std::function<ssize_t(char *, size_t)>;
+/// consumes a DATA payload, returns false on error (errno set)
+using writer = std::function<bool(const char *, size_t)>;
+
+std::chrono::microseconds since(clock_type::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start);
+}
+
+class transfer : public std::enable_shared_from_this<transfer>
+{
+public:
+    transfer(boost::asio::io_context &io_context, const udp::endpoint &server, std::string remote,
+             const client_options &options, client_handler handler)
+        : io_context_(io_context), timer_(io_context), server_(server), options_(options), handler_(std::move(handler)),
+          rexmt_(options.rexmt)
+    {
+        report_.peer_address = server.address().to_string();
+        report_.peer_port = server.port();
+        report_.filename = std::move(remote);
+        report_.blksize = blksize_;
+        report_.timeout_ms = static_cast<uint64_t>(options.rexmt.count());
+    }
+
+    void put(reader source, uint64_t tsize)
+    {
+        opcode_ = WRQ;
+        source_ = std::move(source);
+        tsize_ = tsize;
+        start();
+    }
+
+    void get(writer sink)
+    {
+        opcode_ = RRQ;
+        sink_ = std::move(sink);
+        start();
+    }
+
+    /// the transfer can not start, i.e. the local file can not be opened
+    void abort(int error)
+    {
+        started_ = clock_type::now();
+        finish(transfer_status::error_sent, error + ERRNO_OFFSET, strerror(error));
+    }
+
+private:
+    void start()
+    {
+        try {
+            udp_ = std::make_unique<udp_transport>(io_context_, udp::endpoint(server_.protocol(), 0));
+        } catch (boost::system::system_error &e) {
+            abort(e.code().value());
+            return;
+        }
+        socket_ = udp_.get();
+        if (options_.network.enabled()) {
+            impaired_ = std::make_unique<impaired_transport>(io_context_, *udp_, options_.network);
+            socket_ = impaired_.get();
+        }
+
+        build_request();
+        started_ = clock_type::now();
+        send(request_.data(), request_.size());
+        arm_timer();
+        receive();
+    }
+
+    void build_request()
+    {
+        auto append = [this](const std::string &s) {
+            request_.insert(request_.end(), s.c_str(), s.c_str() + s.size() + 1);
+        };
+        auto option = [&append](const char *opt, uint64_t value) {
+            append(opt);
+            append(std::to_string(value));
+        };
+
+        request_.assign({0, static_cast<char>(opcode_)});
+        append(report_.filename);
+        append("octet");
+        if (options_.blksize != 0) {
+            option("blksize", options_.blksize);
+        }
+        if (options_.tsize) {
+            option("tsize", tsize_); // NOTE: 0 for RRQ, the server answers the size
+        }
+        if (options_.timeout != 0) {
+            option("timeout", options_.timeout);
+        }
+        if (options_.windowsize > 1) {
+            option("windowsize", options_.windowsize);
+        }
+    }
+
+    void receive()
+    {
+        socket_->async_receive_from(boost::asio::buffer(rxbuf_), sender_,
+                                    [self = shared_from_this()](const boost::system::error_code &ec,
+                                                                std::size_t bytes_recvd) {
+                                        if (self->done_ || ec == boost::asio::error::operation_aborted) {
+                                            return;
+                                        }
+                                        if (!ec) {
+                                            self->on_packet(bytes_recvd);
+                                        }
+                                        if (!self->done_) {
+                                            self->receive();
+                                        }
+                                    });
+    }
+
+    void arm_timer()
+    {
+        timer_.expires_after(rexmt_);
+        timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+            // NOTE: a handler already queued when the timer was re-armed still sees success
+            if (!ec && !self->done_ && self->timer_.expiry() <= clock_type::now()) {
+                self->on_timeout();
+            }
+        });
+    }
+
+    void on_timeout()
+    {
+        if (++retries_ > options_.max_retries) {
+            finish(transfer_status::timeout);
+            return;
+        }
+
+        if (!negotiated_) {
+            report_.retransmits++;
+            send(request_.data(), request_.size());
+            arm_timer();
+        } else if (opcode_ == WRQ) {
+            next_ = base_; // go back N
+            fill();
+        } else {
+            send_ack(expected_ - 1);
+            arm_timer();
+        }
+    }
+
+    void on_packet(size_t rxlen)
+    {
+        if (rxlen < TFTP_HEADER) {
+            return;
+        }
+        if (!tid_) {
+            // the server answers from a new port, its TID
+            if (sender_.address() != server_.address()) {
+                return;
+            }
+            peer_ = sender_;
+            tid_ = true;
+            report_.peer_port = peer_.port();
+            report_.setup = since(started_);
+        } else if (sender_ != peer_) {
+            return; // NOTE: unknown transfer ID, ignored
+        }
+
+        auto *tp = reinterpret_cast<struct tftphdr *>(rxbuf_.data());
+        u_short const opcode = ntohs(static_cast<u_short>(tp->th_opcode));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        u_short const block = ntohs(tp->th_block);
+
+        if (opcode == ERROR) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            std::string const msg(tp->th_msg, strnlen(tp->th_msg, rxlen - TFTP_HEADER));
+            finish(transfer_status::error_received, static_cast<short>(block), msg);
+        } else if (opcode == OACK) {
+            if (!negotiated_) {
+                if (parse_oack(rxlen)) {
+                    negotiated();
+                    if (opcode_ == RRQ) {
+                        send_ack(0);
+                        arm_timer();
+                    }
+                }
+            } else if (opcode_ == RRQ && expected_ == 1) {
+                send_ack(0); // our ACK of the OACK was lost
+            }
+        } else if (opcode == ACK && opcode_ == WRQ) {
+            if (!negotiated_) {
+                if (block == 0) {
+                    negotiated(); // NOTE: no options accepted, use defaults
+                }
+            } else {
+                on_ack(block);
+            }
+        } else if (opcode == DATA && opcode_ == RRQ) {
+            if (!negotiated_) {
+                negotiated(); // NOTE: no options accepted, use defaults
+            }
+            on_data(block, rxlen - TFTP_HEADER);
+        } else {
+            send_error(EBADOP, "Illegal TFTP operation");
+        }
+    }
+
+    bool parse_oack(size_t rxlen)
+    {
+        const char *cp = rxbuf_.data() + 2;
+        const char *end = rxbuf_.data() + rxlen;
+        while (cp < end) {
+            size_t const optlen = strnlen(cp, end - cp);
+            const char *val = cp + optlen + 1;
+            if (val >= end) {
+                break;
+            }
+            size_t const vallen = strnlen(val, end - val);
+            uintmax_t const v = strtoumax(val, nullptr, 10);
+
+            if (strcasecmp(cp, "blksize") == 0) {
+                if (v < 8 || (options_.blksize != 0 && v > options_.blksize) || v > MAXSEGSIZE) {
+                    send_error(EOPTNEG, "Invalid blksize");
+                    return false;
+                }
+                blksize_ = v;
+            } else if (strcasecmp(cp, "windowsize") == 0) {
+                if (v < 1 || v > options_.windowsize) {
+                    send_error(EOPTNEG, "Invalid windowsize");
+                    return false;
+                }
+                window_ = v;
+            } else if (strcasecmp(cp, "timeout") == 0) {
+                if (v >= 1) {
+                    rexmt_ = std::chrono::seconds(v);
+                }
+            } else if (strcasecmp(cp, "tsize") == 0) {
+                tsize_ = v;
+            }
+            cp = val + vallen + 1;
+        }
+        return true;
+    }
+
+    void negotiated()
+    {
+        negotiated_ = true;
+        retries_ = 0;
+        report_.blksize = blksize_;
+        report_.windowsize = window_;
+        report_.timeout_ms = static_cast<uint64_t>(rexmt_.count());
+
+        if (opcode_ == WRQ) {
+            slots_.assign(window_, std::vector<char>(blksize_ + TFTP_HEADER));
+            first_sent_.assign(window_, clock_type::time_point{});
+            fill();
+        } else {
+            rxbuf_.resize(std::max(rxbuf_.size(), blksize_ + TFTP_HEADER));
+        }
+    }
+
+    //
+    // put (WRQ)
+    //
+
+    /// send every block of the window not sent yet
+    void fill()
+    {
+        while (next_ < base_ + window_ && (last_ == 0 || next_ <= last_)) {
+            if (next_ > fetched_ && !read_block(next_)) {
+                return;
+            }
+            send_block(next_);
+            next_++;
+        }
+        arm_timer();
+    }
+
+    bool read_block(uint64_t n)
+    {
+        auto &pkt = slots_[n % window_];
+        pkt.resize(blksize_ + TFTP_HEADER);
+        auto *tp = reinterpret_cast<struct tftphdr *>(pkt.data());
+        tp->th_opcode = htons(static_cast<u_short>(DATA));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        tp->th_block = htons(static_cast<u_short>(n));
+
+        ssize_t const len = source_(pkt.data() + TFTP_HEADER, blksize_);
+        if (len < 0) {
+            send_error(errno + ERRNO_OFFSET, strerror(errno));
+            return false;
+        }
+        pkt.resize(TFTP_HEADER + static_cast<size_t>(len));
+        fetched_ = n;
+        if (static_cast<size_t>(len) < blksize_) {
+            last_ = n; // NOTE: may be an empty block
+        }
+        return true;
+    }
+
+    void send_block(uint64_t n)
+    {
+        auto const &pkt = slots_[n % window_];
+        if (n > sent_) {
+            sent_ = n;
+            first_sent_[n % window_] = clock_type::now();
+        } else {
+            report_.retransmits++;
+            first_sent_[n % window_] = clock_type::time_point{}; // NOTE: no rtt sample (Karn)
+        }
+        send(pkt.data(), pkt.size());
+    }
+
+    void on_ack(u_short block)
+    {
+        // map the 16 bit block number into the window in flight
+        uint64_t const acked = base_ - 1 + static_cast<u_short>(block - static_cast<u_short>(base_ - 1));
+        if (acked < base_ || acked >= next_) {
+            // NOTE: never answer a duplicate ACK (Sorcerer's Apprentice Syndrome)
+            report_.duplicates++;
+            return;
+        }
+
+        auto const now = clock_type::now();
+        for (uint64_t n = base_; n <= acked; ++n) {
+            auto const sent = first_sent_[n % window_];
+            if (sent != clock_type::time_point{}) {
+                auto const latency = std::chrono::duration_cast<std::chrono::microseconds>(now - sent);
+                update_rtt(latency);
+                if (options_.block_latency) {
+                    options_.block_latency(latency);
+                }
+            }
+            report_.blocks++;
+            report_.bytes += slots_[n % window_].size() - TFTP_HEADER;
+        }
+
+        base_ = acked + 1;
+        retries_ = 0;
+        if (last_ != 0 && base_ > last_) {
+            finish(transfer_status::success);
+            return;
+        }
+
+        // NOTE: the next window starts after the block acknowledged (RFC7440),
+        // blocks still in flight after it are sent again
+        next_ = base_;
+        fill();
+    }
+
+    //
+    // get (RRQ)
+    //
+
+    void on_data(u_short block, size_t seglen)
+    {
+        uint64_t const n = expected_ - 1 + static_cast<u_short>(block - static_cast<u_short>(expected_ - 1));
+        if (n != expected_) {
+            if (n + 1 == expected_) {
+                report_.duplicates++;
+            }
+            send_ack(expected_ - 1); // NOTE: tell the server where to restart
+            return;
+        }
+
+        if (rtt_sample_) {
+            update_rtt(since(ack_sent_));
+            rtt_sample_ = false;
+        }
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        if (!sink_(reinterpret_cast<struct tftphdr *>(rxbuf_.data())->th_data, seglen)) {
+            send_error(errno + ERRNO_OFFSET, strerror(errno));
+            return;
+        }
+        report_.blocks++;
+        report_.bytes += seglen;
+        expected_++;
+        retries_ = 0;
+
+        if (seglen < blksize_) {
+            send_ack(n);
+            finish(transfer_status::success);
+            return;
+        }
+        if (++in_window_ >= window_) {
+            send_ack(n);
+        }
+        arm_timer();
+    }
+
+    void send_ack(uint64_t n)
+    {
+        if (ack_sent_once_ && n <= acked_) {
+            report_.retransmits++;
+            rtt_sample_ = false;
+        } else {
+            ack_sent_ = clock_type::now();
+            rtt_sample_ = true;
+        }
+        ack_sent_once_ = true;
+        acked_ = n;
+        in_window_ = 0;
+
+        std::array<char, sizeof(struct tftphdr)> ack{}; // NOTE: only the header is sent
+        auto *tp = reinterpret_cast<struct tftphdr *>(ack.data());
+        tp->th_opcode = htons(static_cast<u_short>(ACK));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        tp->th_block = htons(static_cast<u_short>(n));
+        send(ack.data(), TFTP_HEADER);
+    }
+
+    //
+    // common
+    //
+
+    void update_rtt(std::chrono::microseconds sample)
+    {
+        if (report_.rtt.count() == 0) {
+            report_.rtt = sample;
+        } else {
+            report_.rtt = (7 * report_.rtt + sample) / 8;
+        }
+    }
+
+    void send(const char *data, size_t len)
+    {
+        // NOTE: a failed send is a lost packet and retransmitted after timeout
+        socket_->send_to(boost::asio::buffer(data, len), tid_ ? peer_ : server_);
+    }
+
+    void send_error(int error, const std::string &msg)
+    {
+        std::vector<char> pkt(TFTP_HEADER);
+        auto *tp = reinterpret_cast<struct tftphdr *>(pkt.data());
+        tp->th_opcode = htons(static_cast<u_short>(ERROR));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        tp->th_code = htons(static_cast<u_short>(error < ERRNO_OFFSET ? error : EUNDEF));
+        pkt.insert(pkt.end(), msg.c_str(), msg.c_str() + msg.size() + 1);
+        send(pkt.data(), pkt.size());
+        finish(transfer_status::error_sent, error, msg);
+    }
+
+    void finish(transfer_status status, int error = 0, const std::string &message = {})
+    {
+        if (done_) {
+            return;
+        }
+        done_ = true;
+
+        (void)timer_.cancel();
+        if (socket_ != nullptr) {
+            socket_->close();
+        }
+
+        report_.duration = since(started_);
+        if (report_.duration.count() > 0) {
+            std::chrono::duration<double> const seconds = report_.duration;
+            report_.throughput = static_cast<double>(report_.bytes) / seconds.count();
+        }
+        report_.status = status;
+        report_.error = error;
+        report_.error_message = message;
+
+        // NOTE: never call the handler from inside the initiating function
+        boost::asio::post(timer_.get_executor(), [self = shared_from_this()] {
+            auto handler = std::move(self->handler_);
+            if (handler) {
+                handler(self->report_);
+            }
+        });
+    }
+
+    boost::asio::io_context &io_context_;
+    std::unique_ptr<udp_transport> udp_;
+    std::unique_ptr<impaired_transport> impaired_;
+    datagram_transport *socket_{nullptr};
+    boost::asio::steady_timer timer_;
+    udp::endpoint server_;
+    udp::endpoint peer_;   // the TID of the server
+    udp::endpoint sender_; // of the last packet received
+    client_options options_;
+    client_handler handler_;
+    transfer_report report_;
+
+    int opcode_{WRQ};
+    reader source_;
+    writer sink_;
+    uint64_t tsize_{0};
+    std::vector<char> request_;
+    std::vector<char> rxbuf_ = std::vector<char>(PKTSIZE);
+
+    bool tid_{false};
+    bool negotiated_{false};
+    bool done_{false};
+    size_t blksize_{SEGSIZE};
+    size_t window_{1};
+    std::chrono::steady_clock::duration rexmt_;
+    unsigned retries_{0};
+    clock_type::time_point started_;
+
+    // put: blocks base_ .. next_-1 are in flight
+    std::vector<std::vector<char>> slots_;
+    std::vector<clock_type::time_point> first_sent_;
+    uint64_t base_{1};
+    uint64_t next_{1};
+    uint64_t fetched_{0};
+    uint64_t sent_{0};
+    uint64_t last_{0};
+
+    // get: the next block expected
+    uint64_t expected_{1};
+    uint64_t acked_{0};
+    bool ack_sent_once_{false};
+    size_t in_window_{0};
+    clock_type::time_point ack_sent_;
+    bool rtt_sample_{false};
+};
+
+} // namespace
+
+void client::async_put(const udp::endpoint &server, const std::string &remote, const std::string &local,
+                       const client_options &options, client_handler handler)
+{
+    auto t = std::make_shared<transfer>(io_context_, server, remote, options, std::move(handler));
+    FILE *fp = fopen(local.c_str(), "rb");
+    if (fp == nullptr) {
+        t->abort(errno);
+        return;
+    }
+    std::shared_ptr<FILE> file(fp, std::fclose);
+
+    struct stat st = {};
+    (void)fstat(fileno(fp), &st);
+    t->put(
+        [file](char *buf, size_t len) -> ssize_t {
+            size_t const n = fread(buf, 1, len, file.get());
+            if (n < len && ferror(file.get()) != 0) {
+                return -1;
+            }
+            return static_cast<ssize_t>(n);
+        },
+        static_cast<uint64_t>(st.st_size));
+}
+
+void client::async_put(const udp::endpoint &server, const std::string &remote,
+                       std::shared_ptr<const std::vector<char>> data, const client_options &options,
+                       client_handler handler)
+{
+    auto t = std::make_shared<transfer>(io_context_, server, remote, options, std::move(handler));
+    uint64_t const tsize = data->size();
+    t->put(
+        [data, offset = size_t{0}](char *buf, size_t len) mutable -> ssize_t {
+            size_t const n = std::min(len, data->size() - offset);
+            memcpy(buf, data->data() + offset, n);
+            offset += n;
+            return static_cast<ssize_t>(n);
+        },
+        tsize);
+}
+
+void client::async_get(const udp::endpoint &server, const std::string &remote, const std::string &local,
+                       const client_options &options, client_handler handler)
+{
+    auto t = std::make_shared<transfer>(io_context_, server, remote, options, std::move(handler));
+    FILE *fp = fopen(local.c_str(), "wb");
+    if (fp == nullptr) {
+        t->abort(errno);
+        return;
+    }
+    std::shared_ptr<FILE> file(fp, std::fclose);
+
+    t->get([file](const char *buf, size_t len) {
+        return fwrite(buf, 1, len, file.get()) == len && (len != 0 || fflush(file.get()) == 0);
+    });
+}
+
+void client::async_get(const udp::endpoint &server, const std::string &remote, std::shared_ptr<std::vector<char>> data,
+                       const client_options &options, client_handler handler)
+{
+    auto t = std::make_shared<transfer>(io_context_, server, remote, options, std::move(handler));
+    t->get([data](const char *buf, size_t len) {
+        data->insert(data->end(), buf, buf + len);
+        return true;
+    });
+}
+
+} // namespace tftpd
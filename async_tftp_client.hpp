@@ -0,0 +1,69 @@
+#pragma once
+
+#include "async_tftpd_server.hpp"
+#include "transport.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tftpd {
+
+/// what a client asks for with RFC2347 option negotiation
+struct client_options
+{
+    size_t blksize{0};    ///< RFC2348, 0 to not ask (512)
+    size_t windowsize{0}; ///< RFC7440, 0 to not ask (1)
+    size_t timeout{0};    ///< RFC2349 in seconds, 0 to not ask
+    bool tsize{true};     ///< RFC2349 transfer size
+
+    std::chrono::milliseconds rexmt{1000}; ///< retransmission timeout unless negotiated
+    unsigned max_retries{5};               ///< retransmissions in a row before giving up
+
+    impairment network; ///< of the datagrams sent, for tests and benchmarks
+
+    /// called for every DATA block acknowledged by the server (put only),
+    /// with the time since the block was sent first
+    std::function<void(std::chrono::microseconds)> block_latency;
+};
+
+/// called once with the summary of the transfer, see transfer_report
+using client_handler = std::function<void(const transfer_report &)>;
+
+/// asynchronous TFTP client
+///
+/// Each transfer uses its own socket (TID) and timer, so any number of
+/// transfers may run concurrently on one io_context.
+class client
+{
+public:
+    explicit client(boost::asio::io_context &io_context) : io_context_(io_context) {}
+
+    /// upload the local file to the server
+    void async_put(const boost::asio::ip::udp::endpoint &server, const std::string &remote, const std::string &local,
+                   const client_options &options, client_handler handler);
+
+    /// upload a memory buffer to the server
+    void async_put(const boost::asio::ip::udp::endpoint &server, const std::string &remote,
+                   std::shared_ptr<const std::vector<char>> data, const client_options &options,
+                   client_handler handler);
+
+    /// download a file from the server into the local file
+    void async_get(const boost::asio::ip::udp::endpoint &server, const std::string &remote, const std::string &local,
+                   const client_options &options, client_handler handler);
+
+    /// download a file from the server into a memory buffer
+    void async_get(const boost::asio::ip::udp::endpoint &server, const std::string &remote,
+                   std::shared_ptr<std::vector<char>> data, const client_options &options, client_handler handler);
+
+private:
+    boost::asio::io_context &io_context_;
+};
+
+} // namespace tftpd
@@ -4,23 +4,251 @@
 
 #include <boost/filesystem.hpp>
 
-const char *tftpd::g_rootdir = "/tmp/tftpboot"; // the only tftp root dir used!
+#include <list>
+#include <memory>
+
+const char *tftpd::g_rootdir = "/tmp/tftpboot"; // of the sessions not given their own
 std::function<void(size_t)> tftpd::g_callback = nullptr;
+tftpd::report_sink tftpd::g_report = nullptr;
+tftpd::impairment tftpd::g_impairment;
+tftpd::rate_limiter tftpd::g_limiter;
+tftpd::request_table tftpd::g_requests;
+tftpd::admission tftpd::g_admission;
+tftpd::packet_pool tftpd::g_packets;
+tftpd::storage_selector tftpd::g_storage = nullptr;
+tftpd::checksum_type tftpd::g_checksum = tftpd::checksum_type::none;
+tftpd::dedup_store tftpd::g_dedup;
+tftpd::file_cache tftpd::g_files;
+tftpd::virtual_files tftpd::g_providers;
+tftpd::root_index tftpd::g_index;
+
+void tftpd::set_rate_limit(const rate_limit &limit) { g_limiter.configure(limit); }
+
+void tftpd::set_admission_limit(const admission_limit &limit) { g_admission.configure(limit); }
+
+void tftpd::set_storage(storage_selector selector) { g_storage = std::move(selector); }
+
+void tftpd::set_checksum(checksum_type type) { g_checksum = type; }
+
+void tftpd::set_dedup_store(const dedup_store &store) { g_dedup = store; }
+
+void tftpd::set_file_cache(const file_cache_limit &limit) { g_files.configure(limit); }
 
-std::string tftpd::receive_file(const char *rootdir, uint16_t port, std::function<void(size_t)> callback)
+tftpd::file_cache_counters tftpd::get_file_cache_counters()
 {
+    auto counters = g_files.counters();
+    g_providers.count(counters);
+    return counters;
+}
+
+void tftpd::add_file_provider(const std::string &pattern, file_provider provider, const provider_cache &cache)
+{
+    g_providers.add(pattern, std::move(provider), cache);
+}
+
+void tftpd::invalidate_file_provider(const std::string &pattern) { g_providers.invalidate(pattern); }
+
+void tftpd::clear_file_providers() { g_providers.clear(); }
+
+bool tftpd::set_root_index(const char *rootdir)
+{
+    g_index.stop();
+    if (rootdir == nullptr) {
+        return true;
+    }
+    // NOTE: a file changed is dropped from the cache at once, not only by its next request
+    g_index.on_change([](const std::string &path) { g_files.invalidate(path); });
+    return g_index.start(rootdir);
+}
+
+tftpd::root_index_counters tftpd::get_root_index_counters() { return g_index.counters(); }
+
+tftpd::request_counters tftpd::get_request_counters()
+{
+    auto counters = g_limiter.counters();
+    counters.duplicates = g_requests.suppressed();
+    g_admission.count(counters);
+    return counters;
+}
+
+std::string tftpd::receive_file(const char *rootdir, uint16_t port, std::function<void(size_t)> callback,
+                                report_sink report)
+{
+    std::error_code ec;
+    std::string file = receive_file(rootdir, port, std::move(callback), std::move(report), ec);
+    if (ec) {
+        throw std::system_error(ec);
+    }
+    return file;
+}
+
+std::string tftpd::receive_file(const char *rootdir, uint16_t port, std::function<void(size_t)> callback,
+                                report_sink report, std::error_code &ec)
+{
+    ec.clear();
     boost::asio::io_context io_context;
-    tftpd::g_rootdir = rootdir;
     tftpd::g_callback = std::move(callback);
-    tftpd::receiver s(io_context, port);
+    std::unique_ptr<tftpd::receiver> s;
+    try {
+        s = std::make_unique<tftpd::receiver>(io_context, port);
+    } catch (boost::system::system_error &e) {
+        ec = e.code();
+        return {};
+    }
+    s->serve_from(rootdir, std::move(report));
 
     // make sure the rootdir exists
 
     // NOTE: Creation failure because path resolves to an existing directory is not be treated as an error.
     boost::filesystem::path const dir(rootdir);
-    (void)boost::filesystem::create_directory(dir);
+    boost::system::error_code dir_error;
+    (void)boost::filesystem::create_directory(dir, dir_error);
+    if (dir_error) {
+        ec = dir_error;
+        return {};
+    }
 
     io_context.run(); // the server runs here ...
 
-    return s.get_filename();
+    ec = s->error();
+    return ec ? std::string() : s->get_filename();
+}
+
+namespace {
+
+/*
+ * The sessions started by async_receive_file() and async_serve() on an
+ * io_context, they are destroyed when they ended or with the io_context.
+ */
+class session_registry : public boost::asio::io_context::service
+{
+public:
+    static boost::asio::io_context::id id; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+    explicit session_registry(boost::asio::io_context &io_context) : boost::asio::io_context::service(io_context) {}
+
+    tftpd::receiver *add(std::unique_ptr<tftpd::receiver> session)
+    {
+        sessions_.push_back(std::move(session));
+        return sessions_.back().get();
+    }
+
+    void remove(tftpd::receiver *session)
+    {
+        sessions_.remove_if([session](const std::unique_ptr<tftpd::receiver> &s) { return s.get() == session; });
+    }
+
+private:
+    void shutdown() override { sessions_.clear(); }
+
+    std::list<std::unique_ptr<tftpd::receiver>> sessions_;
+};
+
+boost::asio::io_context::id session_registry::id;
+
+boost::system::error_code to_boost(const std::error_code &ec)
+{
+    if (ec.category() == std::generic_category()) {
+        return {ec.value(), boost::system::generic_category()};
+    }
+    return {ec.value(), boost::system::system_category()};
+}
+
+/// a listener on the port, added to the registry, or the error binding it
+tftpd::receiver *listen(boost::asio::io_context &io_context, uint16_t port, boost::system::error_code &ec)
+{
+    try {
+        return boost::asio::use_service<session_registry>(io_context).add(
+            std::make_unique<tftpd::receiver>(io_context, port));
+    } catch (boost::system::system_error &e) {
+        ec = e.code();
+    }
+    return nullptr;
+}
+
+/// the state of one async_serve(), shared by its sessions
+struct serve_state : std::enable_shared_from_this<serve_state>
+{
+    serve_state(boost::asio::io_context &context, std::string root, uint16_t listen_port, size_t max_count,
+                bool serve_downloads, tftpd::report_sink sink, tftpd::detail::serve_handler completion)
+        : io_context(context), rootdir(std::move(root)), port(listen_port), count(max_count),
+          downloads(serve_downloads), report(std::move(sink)), handler(std::move(completion))
+    {}
+
+    void next()
+    {
+        boost::system::error_code ec;
+        auto *session = listen(io_context, port, ec);
+        if (session == nullptr) {
+            finish(ec);
+            return;
+        }
+        session->listen_forever();
+        session->serve_downloads(downloads);
+        session->serve_from(rootdir, report);
+        listener = session;
+        auto self = shared_from_this();
+        session->on_port_released([self, session] {
+            if (self->listener == session) {
+                self->listener = nullptr;
+                if (self->handler != nullptr) {
+                    self->next();
+                }
+            }
+        });
+        session->on_complete([self, session](const std::error_code & /*error*/) {
+            boost::asio::use_service<session_registry>(self->io_context).remove(session);
+            if (self->handler != nullptr && ++self->served == self->count) {
+                self->finish({});
+            }
+        });
+    }
+
+    void finish(const boost::system::error_code &ec)
+    {
+        handler(ec);
+        handler = nullptr; // NOTE: no further listener
+        if (listener != nullptr) {
+            listener->stop();
+        }
+    }
+
+    tftpd::receiver *listener{nullptr}; // on the port
+
+    boost::asio::io_context &io_context;
+    std::string rootdir;
+    uint16_t port;
+    size_t count; // 0 for no limit
+    size_t served{0};
+    bool downloads;
+    tftpd::report_sink report; // of each session
+    tftpd::detail::serve_handler handler;
+};
+
+} // namespace
+
+void tftpd::detail::start_receive_file(boost::asio::io_context &io_context, std::string rootdir, uint16_t port,
+                                       report_sink report, receive_handler handler)
+{
+    boost::system::error_code ec;
+    auto *session = listen(io_context, port, ec);
+    if (session == nullptr) {
+        handler(ec, {});
+        return;
+    }
+    session->serve_from(std::move(rootdir), std::move(report));
+    session->on_complete([&io_context, session, handler](std::error_code error) {
+        std::string const file = error ? std::string() : session->get_filename();
+        boost::asio::use_service<session_registry>(io_context).remove(session);
+        handler(to_boost(error), file);
+    });
+}
+
+void tftpd::detail::start_serve(boost::asio::io_context &io_context, std::string rootdir, uint16_t port,
+                                size_t count, serve_requests requests, report_sink report, serve_handler handler)
+{
+    std::make_shared<serve_state>(io_context, std::move(rootdir), port, count,
+                                  requests == serve_requests::uploads_and_downloads, std::move(report),
+                                  std::move(handler))
+        ->next();
 }
@@ -1,19 +1,287 @@
 #pragma once
 
+#include "checksum.hpp"
+#include "storage.hpp"
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
 
 namespace tftpd {
 
+/// how a transfer ended
+enum class transfer_status
+{
+    success,        ///< file received and final ack sent, or sent and its last block acked
+    timeout,        ///< peer did not answer in time
+    error_sent,     ///< we aborted with an ERROR packet
+    error_received, ///< peer aborted with an ERROR packet
+};
+
+/// summary record of one transfer, delivered once when it ends
+struct transfer_report
+{
+    std::string peer_address; ///< client IP address
+    uint16_t peer_port{0};    ///< client UDP port (TID)
+    std::string filename;     ///< path of the file as resolved below rootdir
+
+    bool download{false}; ///< the file was sent (RRQ), else received
+
+    uint64_t bytes{0};  ///< payload bytes written, or sent and acknowledged
+    uint64_t blocks{0}; ///< DATA blocks accepted, or sent and acknowledged
+
+    size_t blksize{0};      ///< negotiated blksize (RFC2348)
+    size_t windowsize{1};   ///< windowsize (RFC7440), always 1 until the server negotiates it
+    uint64_t timeout_ms{0}; ///< negotiated retransmission timeout (RFC2349)
+
+    std::chrono::microseconds setup{0};    ///< from request to first answer (client only)
+    std::chrono::microseconds duration{0}; ///< from request to final ack or abort
+    double throughput{0};                  ///< payload bytes per second
+    uint64_t retransmits{0};               ///< ACKs (DATA blocks of a download) sent again
+    uint64_t duplicates{0};                ///< DATA blocks (ACKs of a download) received again
+    uint64_t reordered{0};                 ///< DATA blocks received ahead of sequence and held back
+    std::chrono::microseconds rtt{0};      ///< smoothed ACK to next DATA (DATA to its ACK) round trip
+
+    transfer_status status{transfer_status::success};
+    int error{0};              ///< TFTP error code (or errno + 100) if aborted
+    std::string error_message; ///< text of the ERROR packet sent or received
+    std::string checksum;      ///< "crc32c:<hex>" or "sha256:<hex>" of the payload, see set_checksum()
+};
+
+using report_sink = std::function<void(const transfer_report &)>;
+
+/// per source address token bucket for incoming requests
+struct rate_limit
+{
+    double rate{0};           ///< requests per second and source, 0 for no limit
+    double burst{40};         ///< requests a source may send at once (>= 1)
+    size_t max_sources{4096}; ///< sources tracked, requests of new ones are dropped beyond
+};
+
+/// sessions of all receive_file() calls together
+struct admission_limit
+{
+    size_t max_sessions{64};   ///< running at once
+    size_t memory{64UL << 20}; ///< buffer memory, the blksize of new sessions is clamped to fit
+    size_t queue{16};          ///< requests waiting for a session, refused as busy beyond
+};
+
+/// counters of the requests seen by all receive_file() calls
+struct request_counters
+{
+    uint64_t admitted{0};   ///< passed on to the protocol
+    uint64_t dropped{0};    ///< over the rate limit, dropped before they were parsed
+    uint64_t duplicates{0}; ///< retransmitted by a peer while its session is running
+    uint64_t sources{0};    ///< source addresses currently tracked
+    uint64_t queued{0};     ///< had to wait for a session to end
+    uint64_t refused{0};    ///< answered with a busy ERROR
+    uint64_t clamped{0};    ///< got less memory than for the largest blksize
+    uint64_t sessions{0};   ///< currently running
+};
+
+/// the content addressed store of the uploads below the rootdir, see dedup_sink
+struct dedup_store
+{
+    bool enabled{false};
+    std::string directory{".objects"};     ///< of the objects, below the rootdir
+    dedup_link link{dedup_link::hardlink}; ///< of the filename to its object
+    size_t spill{256UL << 10};             ///< uploads held in memory up to this size until their digest is known
+};
+
+/// the contents of the files sent by all sessions, see file_cache
+struct file_cache_limit
+{
+    size_t memory{64UL << 20};   ///< of all files cached, 0 to read each file for its session
+    size_t max_file{32UL << 20}; ///< larger files are not cached
+};
+
+/// counters of the file_cache
+struct file_cache_counters
+{
+    uint64_t hits{0};     ///< sent from the memory of a file cached
+    uint64_t misses{0};   ///< read into the cache
+    uint64_t stale{0};    ///< cached but changed on disk, read again (a miss too)
+    uint64_t evicted{0};  ///< dropped for the memory of others
+    uint64_t uncached{0}; ///< larger than max_file, read by their session
+    uint64_t files{0};    ///< currently cached
+    uint64_t memory{0};   ///< of the files currently cached
+
+    uint64_t rendered{0};      ///< by a file_provider
+    uint64_t rendered_hits{0}; ///< sent from the memory of a file rendered before
+};
+
+/// renders the content of a file to download in memory, std::nullopt if
+/// it has none, i.e. the file is looked up below the rootdir then
+using file_provider = std::function<std::optional<std::string>(const std::string &path)>;
+
+/// how the files rendered by a file_provider are kept
+struct provider_cache
+{
+    std::chrono::milliseconds max_age{60000}; ///< rendered again after, 0 for each request
+    size_t max_files{4096};                   ///< the oldest are dropped beyond
+};
+
+/// counters of the root_index
+struct root_index_counters
+{
+    uint64_t hits{0};        ///< files found or known to be absent without a stat()
+    uint64_t misses{0};      ///< stat() called, i.e. outside the root, a symlink or a file being written
+    uint64_t events{0};      ///< inotify events applied
+    uint64_t rescans{0};     ///< of the whole root, after the event queue overflowed
+    uint64_t files{0};       ///< currently indexed, directories included
+    uint64_t directories{0}; ///< currently watched
+};
+
+/// set the limit used by the following receive_file() calls, this clears the buckets
+void set_rate_limit(const rate_limit &limit);
+void set_admission_limit(const admission_limit &limit);
+request_counters get_request_counters();
+
+/// cache the files sent up to the limit given, this forgets the files cached
+void set_file_cache(const file_cache_limit &limit);
+file_cache_counters get_file_cache_counters();
+
+/// answer the downloads of the paths below the rootdir matching the
+/// fnmatch(3) pattern, i.e. "pxelinux.cfg/01-*", from the content the
+/// provider renders instead of a file; the providers are asked in the
+/// order added, each with the path relative to the rootdir
+void add_file_provider(const std::string &pattern, file_provider provider, const provider_cache &cache = {});
+
+/// forget the files rendered by the providers of the pattern, i.e. their data changed
+void invalidate_file_provider(const std::string &pattern);
+void clear_file_providers();
+
+/// keep the metadata of the files below the rootdir in memory, current by
+/// inotify(7), for the access checks and tsize answers of the following
+/// requests; nullptr stops it
+/// @return false if the rootdir can't be watched, the requests stat() their files then
+bool set_root_index(const char *rootdir);
+root_index_counters get_root_index_counters();
+
+/// select the storage of the following uploads by their path, i.e. a
+/// memory_sink for a config snapshot consumed at once, nullptr for files only;
+/// the memory() of the sink is reserved from the admission budget
+void set_storage(storage_selector selector);
+
+/// store the following uploads once by their content, each filename becomes
+/// a link to its object; a storage selected by set_storage() goes first and
+/// uploads into the objects directory itself are refused
+void set_dedup_store(const dedup_store &store);
+
+/// hash the following uploads while they are received, the digest is in
+/// the transfer_report and the sidecar file <path>.crc32c or <path>.sha256
+void set_checksum(checksum_type type);
+
 /// receive 1 file with tftp protocol
 ///
 /// @param port the UDP port used by tftpd
 /// @param rootdir the tftp upload dir used
+/// @param callback called with the progress in percent every 10%
+/// @param report called once with the summary of the transfer
 /// @note the rootdir must exist and world writable!
+/// @note a download (RRQ) is refused with EBADOP, see async_serve()
 /// @return path to file received or
 /// @throw std::exception on error
 std::string receive_file(const char *rootdir = "/srv/tftp", uint16_t port = 69,
-                         std::function<void(size_t)> callback = nullptr);
+                         std::function<void(size_t)> callback = nullptr, report_sink report = nullptr);
+
+/// receive 1 file with tftp protocol, as above
+///
+/// @param ec set to how the transfer ended, i.e. std::errc::timed_out, or
+///        why the port could not be bound
+/// @return path to file received or empty on error
+std::string receive_file(const char *rootdir, uint16_t port, std::function<void(size_t)> callback,
+                         report_sink report, std::error_code &ec);
+
+/// the requests answered by async_serve()
+enum class serve_requests
+{
+    uploads,               ///< a download (RRQ) is refused with EBADOP
+    uploads_and_downloads, ///< any file below the rootdir readable by others may be downloaded!
+};
+
+namespace detail {
+using receive_handler = std::function<void(const boost::system::error_code &, std::string)>;
+using serve_handler = std::function<void(const boost::system::error_code &)>;
+
+void start_receive_file(boost::asio::io_context &io_context, std::string rootdir, uint16_t port, report_sink report,
+                        receive_handler handler);
+void start_serve(boost::asio::io_context &io_context, std::string rootdir, uint16_t port, size_t count,
+                 serve_requests requests, report_sink report, serve_handler handler);
+
+/// a move only completion handler as copyable function, called on its associated executor
+template <typename Handler, typename... Args>
+std::function<void(Args...)> completion(boost::asio::io_context &io_context, Handler &&handler)
+{
+    auto shared = std::make_shared<std::decay_t<Handler>>(std::forward<Handler>(handler));
+    auto executor = boost::asio::get_associated_executor(*shared, io_context.get_executor());
+    return [shared, executor](Args... args) {
+        boost::asio::post(executor, [shared, args...]() mutable { std::move(*shared)(std::move(args)...); });
+    };
+}
+} // namespace detail
+
+/// receive 1 file with tftp protocol on the io_context of the caller
+///
+/// The completion token is any of asio, i.e. a callback, use_future or
+/// use_awaitable, with the signature void(boost::system::error_code, std::string)
+/// of receive_file().  Other sessions and transfers may run on the same
+/// io_context meanwhile, each with its own rootdir and report sink.
+template <typename CompletionToken>
+auto async_receive_file(boost::asio::io_context &io_context, const char *rootdir, uint16_t port, report_sink report,
+                        CompletionToken &&token)
+{
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>(
+        [&io_context, port](auto &&handler, std::string dir, report_sink sink) {
+            detail::start_receive_file(io_context, std::move(dir), port, std::move(sink),
+                                       detail::completion<decltype(handler), const boost::system::error_code &,
+                                                          std::string>(io_context,
+                                                                       std::forward<decltype(handler)>(handler)));
+        },
+        token, std::string(rootdir), std::move(report));
+}
+
+/// serve the uploads, and the downloads if asked for, of the port on the io_context of the caller
+///
+/// A listener waits on the port without the idle timeout, each request
+/// gets its own session and a new listener takes over the port.  Completes
+/// with void(boost::system::error_code) after count requests were served,
+/// never with count 0, or if the port can't be bound.
+///
+/// @param requests answered, a download only with serve_requests::uploads_and_downloads
+/// @param report called once with the summary of each transfer
+template <typename CompletionToken>
+auto async_serve(boost::asio::io_context &io_context, const char *rootdir, uint16_t port, size_t count,
+                 serve_requests requests, report_sink report, CompletionToken &&token)
+{
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+        [&io_context, port, count, requests](auto &&handler, std::string dir, report_sink sink) {
+            detail::start_serve(io_context, std::move(dir), port, count, requests, std::move(sink),
+                                detail::completion<decltype(handler), const boost::system::error_code &>(
+                                    io_context, std::forward<decltype(handler)>(handler)));
+        },
+        token, std::string(rootdir), std::move(report));
+}
+
+/// serve the uploads of the port on the io_context of the caller, as above
+template <typename CompletionToken>
+auto async_serve(boost::asio::io_context &io_context, const char *rootdir, uint16_t port, size_t count,
+                 report_sink report, CompletionToken &&token)
+{
+    return async_serve(io_context, rootdir, port, count, serve_requests::uploads, std::move(report),
+                       std::forward<CompletionToken>(token));
+}
 
 } // namespace tftpd
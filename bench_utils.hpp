@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * The helpers shared by the benchmark and load generator programs.
+ */
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace tftpd {
+namespace bench {
+
+/// a comma separated list of sizes, each may use a k or m suffix
+inline std::vector<size_t> parse_list(const std::string &arg)
+{
+    std::vector<size_t> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        char *end = nullptr;
+        size_t v = std::strtoul(item.c_str(), &end, 10);
+        if (*end == 'k' || *end == 'K') {
+            v <<= 10;
+        } else if (*end == 'm' || *end == 'M') {
+            v <<= 20;
+        }
+        list.push_back(v);
+    }
+    return list;
+}
+
+} // namespace bench
+} // namespace tftpd
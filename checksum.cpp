@@ -0,0 +1,369 @@
+#include "checksum.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <cpuid.h>
+#    include <immintrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#    include <arm_acle.h>
+#    include <asm/hwcap.h>
+#    include <sys/auxv.h>
+#endif
+
+namespace tftpd {
+
+namespace {
+
+// CRC32C, reflected polynomial
+constexpr uint32_t castagnoli{0x82F63B78};
+
+using crc_tables = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr crc_tables make_crc_tables()
+{
+    crc_tables t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = ((c & 1U) != 0) ? (c >> 1U) ^ castagnoli : c >> 1U;
+        }
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t k = 1; k < t.size(); ++k) {
+            t[k][i] = (t[k - 1][i] >> 8U) ^ t[0][t[k - 1][i] & 0xFFU];
+        }
+    }
+    return t;
+}
+
+constexpr crc_tables tables{make_crc_tables()};
+
+constexpr std::array<uint32_t, 64> sha256_k{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr std::array<uint32_t, 8> sha256_h0{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+constexpr uint32_t rotr(uint32_t x, unsigned n) { return (x >> n) | (x << (32U - n)); }
+
+uint32_t load_be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24U) | (static_cast<uint32_t>(p[1]) << 16U) |
+           (static_cast<uint32_t>(p[2]) << 8U) | static_cast<uint32_t>(p[3]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.2"))) uint32_t crc32c_sse42(uint32_t crc, const char *data, size_t length)
+{
+#    if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#    endif
+    for (; length >= 4; data += 4, length -= 4) {
+        uint32_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; length > 0; ++data, --length) {
+        crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+    }
+    return crc;
+}
+
+/*
+ * The SHA-256 rounds with the SHA extensions: the state is kept as ABEF
+ * and CDGH, each sha256rnds2 does 2 rounds, sha256msg1 and sha256msg2
+ * extend the message schedule 4 words at a time.
+ */
+__attribute__((target("sha,sse4.1,ssse3"))) void sha256_shani(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);               // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);         // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);      // CDGH
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i const abef = state0;
+        __m128i const cdgh = state1;
+        __m128i w[4]; // NOLINT(cppcoreguidelines-avoid-c-arrays): std::array drops the vector attributes
+
+#    pragma GCC unroll 16
+        for (size_t i = 0; i < 16; ++i) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), mask);
+            }
+            __m128i msg =
+                _mm_add_epi32(w[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(&sha256_k[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i < 15) {
+                __m128i const next = _mm_add_epi32(w[(i + 1) % 4], _mm_alignr_epi8(w[i % 4], w[(i + 3) % 4], 4));
+                w[(i + 1) % 4] = _mm_sha256msg2_epu32(next, w[i % 4]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (i >= 1 && i < 13) {
+                w[(i + 3) % 4] = _mm_sha256msg1_epu32(w[(i + 3) % 4], w[i % 4]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);    // ABEF
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+
+#elif defined(__aarch64__) && defined(__linux__)
+
+/*
+ * The CRC extension is optional in ARMv8.0, so it is enabled for this
+ * function only and used after getauxval(AT_HWCAP) reported it.
+ */
+__attribute__((target("+crc"))) uint32_t crc32c_armv8(uint32_t crc, const char *data, size_t length)
+{
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; ++data, --length) {
+        crc = __crc32cb(crc, static_cast<uint8_t>(*data));
+    }
+    return crc;
+}
+
+#endif
+
+using crc_function = uint32_t (*)(uint32_t, const char *, size_t);
+using sha256_function = void (*)(uint32_t *, const uint8_t *, size_t);
+
+crc_function crc32c_update()
+{
+    static crc_function const function =
+        detail::has_crc32c_instructions() ? detail::crc32c_accelerated : detail::crc32c_portable;
+    return function;
+}
+
+sha256_function sha256_update()
+{
+    static sha256_function const function =
+        detail::has_sha256_instructions() ? detail::sha256_accelerated : detail::sha256_portable;
+    return function;
+}
+
+} // namespace
+
+const char *checksum_name(checksum_type type)
+{
+    switch (type) {
+    case checksum_type::crc32c:
+        return "crc32c";
+    case checksum_type::sha256:
+        return "sha256";
+    case checksum_type::none:
+        break;
+    }
+    return "none";
+}
+
+checksum::checksum(checksum_type type) : type_(type), state_(sha256_h0) {}
+
+void checksum::update(const char *data, size_t length)
+{
+    switch (type_) {
+    case checksum_type::crc32c:
+        crc_ = crc32c_update()(crc_, data, length);
+        break;
+    case checksum_type::sha256: {
+        const auto *p = reinterpret_cast<const uint8_t *>(data);
+        size_t used = length_ % block_.size();
+        length_ += length;
+        if (used > 0) {
+            size_t const n = std::min(length, block_.size() - used);
+            memcpy(block_.data() + used, p, n);
+            p += n;
+            length -= n;
+            used += n;
+            if (used < block_.size()) {
+                break;
+            }
+            sha256_update()(state_.data(), block_.data(), 1);
+        }
+        sha256_update()(state_.data(), p, length / block_.size());
+        p += length - length % block_.size();
+        memcpy(block_.data(), p, length % block_.size());
+        break;
+    }
+    case checksum_type::none:
+        break;
+    }
+}
+
+std::string checksum::hex() const
+{
+    char text[2 * 32 + 1] = {};
+    switch (type_) {
+    case checksum_type::crc32c:
+        (void)snprintf(text, sizeof(text), "%08x", ~crc_);
+        break;
+    case checksum_type::sha256: {
+        // NOTE: the padding on a copy, so the digest may be asked for any time
+        auto state = state_;
+        std::array<uint8_t, 128> tail{};
+        size_t const used = length_ % block_.size();
+        memcpy(tail.data(), block_.data(), used);
+        tail[used] = 0x80;
+        size_t const blocks = (used + 1 + 8 <= block_.size()) ? 1 : 2;
+        uint64_t const bits = length_ * 8;
+        for (size_t i = 0; i < 8; ++i) {
+            tail[blocks * block_.size() - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        sha256_update()(state.data(), tail.data(), blocks);
+        for (size_t i = 0; i < state.size(); ++i) {
+            (void)snprintf(text + 8 * i, sizeof(text) - 8 * i, "%08x", state[i]);
+        }
+        break;
+    }
+    case checksum_type::none:
+        break;
+    }
+    return text;
+}
+
+bool detail::has_crc32c_instructions()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("sse4.2") != 0;
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+
+bool detail::has_sha256_instructions()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0;
+    unsigned ebx = 0;
+    unsigned ecx = 0;
+    unsigned edx = 0;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (ebx & (1U << 29U)) != 0 && __builtin_cpu_supports("sse4.1") != 0; // NOTE: SHA
+#else
+    return false;
+#endif
+}
+
+uint32_t detail::crc32c_portable(uint32_t crc, const char *data, size_t length)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        auto const lo = static_cast<uint32_t>(word) ^ crc;
+        auto const hi = static_cast<uint32_t>(word >> 32U);
+        crc = tables[7][lo & 0xFFU] ^ tables[6][(lo >> 8U) & 0xFFU] ^ tables[5][(lo >> 16U) & 0xFFU] ^
+              tables[4][lo >> 24U] ^ tables[3][hi & 0xFFU] ^ tables[2][(hi >> 8U) & 0xFFU] ^
+              tables[1][(hi >> 16U) & 0xFFU] ^ tables[0][hi >> 24U];
+    }
+#endif
+    for (; length > 0; ++data, --length) {
+        crc = tables[0][(crc ^ static_cast<uint8_t>(*data)) & 0xFFU] ^ (crc >> 8U);
+    }
+    return crc;
+}
+
+uint32_t detail::crc32c_accelerated(uint32_t crc, const char *data, size_t length)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return crc32c_sse42(crc, data, length);
+#elif defined(__aarch64__) && defined(__linux__)
+    return crc32c_armv8(crc, data, length);
+#else
+    return crc32c_portable(crc, data, length);
+#endif
+}
+
+void detail::sha256_portable(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+    for (; blocks > 0; --blocks, data += 64) {
+        std::array<uint32_t, 64> w{};
+        for (size_t i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (size_t i = 16; i < w.size(); ++i) {
+            uint32_t const s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3U);
+            uint32_t const s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10U);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        uint32_t f = state[5];
+        uint32_t g = state[6];
+        uint32_t h = state[7];
+        for (size_t i = 0; i < w.size(); ++i) {
+            uint32_t const t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            uint32_t const t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+void detail::sha256_accelerated(uint32_t *state, const uint8_t *data, size_t blocks)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    sha256_shani(state, data, blocks);
+#else
+    sha256_portable(state, data, blocks);
+#endif
+}
+
+} // namespace tftpd
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * The digest of an upload, computed while its blocks are written.
+ *
+ * CRC32C (Castagnoli, as iSCSI and ext4 use it) and SHA-256 (FIPS 180-4).
+ * Both use the instructions of the CPU if it has them: SSE4.2 crc32 or
+ * the ARMv8 CRC extension, the x86 SHA extensions.  Otherwise a portable
+ * slice by 8 CRC and the plain SHA-256 rounds are used.  The CPU is asked
+ * once at run time, so a generic build uses them too.
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tftpd {
+
+enum class checksum_type
+{
+    none,
+    crc32c,
+    sha256,
+};
+
+/// "crc32c", "sha256" or "none", the suffix of the sidecar file too
+const char *checksum_name(checksum_type type);
+
+class checksum
+{
+public:
+    explicit checksum(checksum_type type = checksum_type::none);
+
+    checksum_type type() const { return type_; }
+
+    void update(const char *data, size_t length);
+
+    /// the digest of the data so far in hex, empty for none
+    std::string hex() const;
+
+private:
+    checksum_type type_;
+    uint32_t crc_{~0U};
+    std::array<uint32_t, 8> state_{};
+    std::array<uint8_t, 64> block_{}; // NOTE: a partial SHA-256 block
+    uint64_t length_{0};
+};
+
+namespace detail {
+bool has_crc32c_instructions();
+bool has_sha256_instructions();
+
+/// the CRC32C continued after crc, without the final inversion
+uint32_t crc32c_portable(uint32_t crc, const char *data, size_t length);
+uint32_t crc32c_accelerated(uint32_t crc, const char *data, size_t length);
+
+/// the SHA-256 rounds of the 64 byte blocks given on the 8 words of state
+void sha256_portable(uint32_t *state, const uint8_t *data, size_t blocks);
+void sha256_accelerated(uint32_t *state, const uint8_t *data, size_t blocks);
+} // namespace detail
+
+} // namespace tftpd
@@ -0,0 +1,149 @@
+// NOTE: benchmark of the upload checksums, the CPU instructions versus the portable code! CK
+//
+// Hashes a buffer of random data in pieces of the blksize, as the session
+// does with the blocks of an upload, and reports the throughput in MiB/s.
+// Compare with tftpd_bench --checksum for the cost per transfer.  Results
+// go to stderr as a table and optional as JSON (--json=FILE, - for stdout).
+#include "checksum.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct bench_result
+{
+    std::string checksum;
+    std::string code;
+    size_t blksize{0};
+    double mib_per_s{0};
+};
+
+template <typename Update>
+bench_result run_case(const char *name, const char *code, const std::vector<char> &data, size_t blksize,
+                      size_t rounds, Update update)
+{
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t done = 0; done < data.size(); done += blksize) {
+            update(data.data() + done, std::min(blksize, data.size() - done));
+        }
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+    bench_result res;
+    res.checksum = name;
+    res.code = code;
+    res.blksize = blksize;
+    res.mib_per_s = static_cast<double>(rounds * data.size()) / (1 << 20) / elapsed.count();
+    return res;
+}
+
+std::vector<bench_result> run_blksize(const std::vector<char> &data, size_t blksize, size_t rounds)
+{
+    using namespace tftpd::detail;
+
+    uint32_t crc = ~0U;
+    uint32_t state[8] = {};
+    std::vector<bench_result> results;
+    results.push_back(run_case("crc32c", "portable", data, blksize, rounds,
+                               [&crc](const char *p, size_t n) { crc = crc32c_portable(crc, p, n); }));
+    results.push_back(run_case("crc32c", "cpu", data, blksize, rounds,
+                               [&crc](const char *p, size_t n) { crc = crc32c_accelerated(crc, p, n); }));
+    results.push_back(run_case("sha256", "portable", data, blksize, rounds, [&state](const char *p, size_t n) {
+        sha256_portable(state, reinterpret_cast<const uint8_t *>(p), n / 64);
+    }));
+    results.push_back(run_case("sha256", "cpu", data, blksize, rounds, [&state](const char *p, size_t n) {
+        sha256_accelerated(state, reinterpret_cast<const uint8_t *>(p), n / 64);
+    }));
+    if (crc == 0 && state[0] == 0) {
+        fprintf(stderr, "unlikely\n"); // NOTE: the results are used
+    }
+    return results;
+}
+
+std::vector<size_t> parse_list(const std::string &arg)
+{
+    std::vector<size_t> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        list.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    }
+    return list;
+}
+
+void write_json(std::ostream &os, const std::vector<bench_result> &results)
+{
+    os << "{\n  \"benchmark\": \"checksum_bench\",\n  \"results\": [";
+    const char *sep = "\n";
+    for (const auto &r : results) {
+        os << sep << "    {\"checksum\": \"" << r.checksum << "\", \"code\": \"" << r.code
+           << "\", \"blksize\": " << r.blksize << ", \"mib_per_s\": " << r.mib_per_s << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cerr << "Usage: checksum_bench [--blksize=LIST] [--rounds=N] [--json=FILE|-]\n"
+                 "       LIST is comma separated\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> blksizes{512, 1428, 8192, 65464};
+    size_t rounds = 16;
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        auto value = [&arg]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.rfind("--blksize=", 0) == 0) {
+            blksizes = parse_list(value());
+        } else if (arg.rfind("--rounds=", 0) == 0) {
+            rounds = std::strtoul(value().c_str(), nullptr, 10);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value();
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<char> data(16U << 20U);
+    std::mt19937 random(1); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    for (auto &c : data) {
+        c = static_cast<char>(random());
+    }
+
+    fprintf(stderr, "crc32c instructions: %d sha256 instructions: %d\n", tftpd::detail::has_crc32c_instructions(),
+            tftpd::detail::has_sha256_instructions());
+    std::vector<bench_result> results;
+    fprintf(stderr, "%-8s %-9s %8s %10s\n", "checksum", "code", "blksize", "MiB/s");
+    for (auto blksize : blksizes) {
+        for (auto const &r : run_blksize(data, blksize, rounds)) {
+            fprintf(stderr, "%-8s %-9s %8zu %10.1f\n", r.checksum.c_str(), r.code.c_str(), r.blksize, r.mib_per_s);
+            results.push_back(r);
+        }
+    }
+
+    if (json == "-") {
+        write_json(std::cout, results);
+    } else if (!json.empty()) {
+        std::ofstream os(json);
+        write_json(os, results);
+    }
+
+    return EXIT_SUCCESS;
+}
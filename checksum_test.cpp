@@ -0,0 +1,96 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the known answers of CRC32C and SHA-256, and the instructions of the CPU versus the portable code! CK
+
+#include "checksum.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string digest(tftpd::checksum_type type, const std::string &data)
+{
+    tftpd::checksum sum(type);
+    sum.update(data.data(), data.size());
+    return sum.hex();
+}
+
+} // namespace
+
+int main()
+{
+    using tftpd::checksum_type;
+
+    try {
+        std::cout << "crc32c instructions: " << tftpd::detail::has_crc32c_instructions()
+                  << " sha256 instructions: " << tftpd::detail::has_sha256_instructions() << std::endl;
+
+        // RFC 3720 B.4 and the check value of the catalogue
+        assert(digest(checksum_type::crc32c, "123456789") == "e3069283");
+        assert(digest(checksum_type::crc32c, std::string(32, '\0')) == "8a9136aa");
+        assert(digest(checksum_type::crc32c, std::string(32, '\xff')) == "62a8ab43");
+        assert(digest(checksum_type::crc32c, "") == "00000000");
+
+        // FIPS 180-4 examples
+        assert(digest(checksum_type::sha256, "") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        assert(digest(checksum_type::sha256, "abc") ==
+               "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        assert(digest(checksum_type::sha256, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+               "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        assert(digest(checksum_type::sha256, std::string(1000000, 'a')) ==
+               "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        assert(digest(checksum_type::none, "abc").empty());
+        assert(std::string(tftpd::checksum_name(checksum_type::sha256)) == "sha256");
+
+        std::mt19937 random(1); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+        std::vector<char> data(1U << 16U);
+        for (auto &c : data) {
+            c = static_cast<char>(random());
+        }
+
+        // the instructions give the same result as the portable code, at any length and alignment
+        for (size_t i = 0; i < 1000; ++i) {
+            size_t const offset = random() % 64;
+            size_t const length = random() % (data.size() - offset);
+            const char *p = data.data() + offset;
+            assert(tftpd::detail::crc32c_portable(~0U, p, length) == tftpd::detail::crc32c_accelerated(~0U, p, length));
+
+            uint32_t portable[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+            uint32_t accelerated[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+            const auto *blocks = reinterpret_cast<const uint8_t *>(p);
+            tftpd::detail::sha256_portable(portable, blocks, length / 64);
+            tftpd::detail::sha256_accelerated(accelerated, blocks, length / 64);
+            assert(memcmp(portable, accelerated, sizeof(portable)) == 0);
+        }
+
+        // fed in pieces as the blocks of an upload, the digest is the same as at once
+        for (auto type : {checksum_type::crc32c, checksum_type::sha256}) {
+            tftpd::checksum sum(type);
+            size_t done = 0;
+            while (done < data.size()) {
+                size_t const length = std::min<size_t>(random() % 1500, data.size() - done);
+                sum.update(data.data() + done, length);
+                done += length;
+                if (done == 512) {
+                    (void)sum.hex(); // NOTE: asked for meanwhile, it goes on
+                }
+            }
+            assert(sum.hex() == digest(type, std::string(data.begin(), data.end())));
+        }
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
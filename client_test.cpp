@@ -0,0 +1,467 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+#include "async_tftp_client.hpp"
+#include "tftp/tftpsubs.h"
+#include "storage.hpp"
+#include "tftpd.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_future.hpp>
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t port{6970};
+const char *const rootdir{"/tmp/tftpboot-client-test"};
+const boost::asio::ip::udp::endpoint server(boost::asio::ip::address_v4::loopback(), port);
+
+tftpd::transfer_report run(const std::function<void(tftpd::client &, tftpd::client_handler)> &start)
+{
+    boost::asio::io_context io_context;
+    tftpd::client client(io_context);
+    tftpd::transfer_report result;
+    start(client, [&result](const tftpd::transfer_report &r) { result = r; });
+    io_context.run();
+    return result;
+}
+
+tftpd::transfer_report upload(const std::string &name, size_t size, const tftpd::client_options &options,
+                              tftpd::transfer_report &server_report)
+{
+    auto data = std::make_shared<std::vector<char>>(size);
+    for (size_t i = 0; i < size; ++i) {
+        (*data)[i] = static_cast<char>(i * 7);
+    }
+
+    std::thread srv([&server_report] {
+        (void)tftpd::receive_file(rootdir, port, nullptr,
+                                  [&server_report](const tftpd::transfer_report &r) { server_report = r; });
+    });
+    auto result = run([&](tftpd::client &c, tftpd::client_handler h) { c.async_put(server, name, data, options, h); });
+    srv.join();
+
+    std::ifstream is(std::string(rootdir) + "/" + name, std::ios::binary);
+    std::vector<char> const received((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    assert(received == *data);
+    return result;
+}
+
+tftpd::transfer_report download(const std::string &name, std::shared_ptr<std::vector<char>> sink,
+                                const tftpd::client_options &options, tftpd::transfer_report &server_report)
+{
+    boost::asio::io_context io_context;
+    tftpd::async_serve(
+        io_context, rootdir, port, 1, tftpd::serve_requests::uploads_and_downloads,
+        [&server_report](const tftpd::transfer_report &r) { server_report = r; },
+        [](const boost::system::error_code & /*ec*/) {});
+    tftpd::client client(io_context);
+    tftpd::transfer_report result;
+    client.async_get(server, name, std::move(sink), options, [&result](const tftpd::transfer_report &r) { result = r; });
+    io_context.run();
+    return result;
+}
+
+/// a sink which takes every 64th block with would_block too and resumes the session from its own thread
+class deferring_sink : public tftpd::storage_sink
+{
+public:
+    deferring_sink(std::unique_ptr<tftpd::storage_sink> sink, size_t &blocked)
+        : sink_(std::move(sink)), blocked_(blocked)
+    {}
+    ~deferring_sink() override
+    {
+        if (resumer_.joinable()) {
+            resumer_.join();
+        }
+    }
+
+    deferring_sink(const deferring_sink &) = delete;
+    deferring_sink &operator=(const deferring_sink &) = delete;
+
+    int write(const char *data, size_t length) override
+    {
+        int const error = sink_->write(data, length);
+        if (error != 0 && error != would_block) {
+            return error;
+        }
+        deferred_ = (++written_ % 64) == 0;
+        if (error == would_block || deferred_) {
+            blocked_++;
+            return would_block;
+        }
+        return 0; // OK
+    }
+    bool ready(bool drained, const std::function<void()> &resume) override
+    {
+        if (!sink_->ready(drained, resume)) {
+            return false;
+        }
+        if (!deferred_) {
+            return true;
+        }
+        deferred_ = false;
+        if (resumer_.joinable()) {
+            resumer_.join();
+        }
+        resumer_ = std::thread([resume] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            resume();
+        });
+        return false;
+    }
+    int commit() override { return sink_->commit(); }
+
+private:
+    std::unique_ptr<tftpd::storage_sink> sink_;
+    size_t &blocked_;
+    size_t written_{0};
+    bool deferred_{false};
+    std::thread resumer_;
+};
+
+} // namespace
+
+int main()
+{
+    tftpd::client_options options;
+    options.rexmt = std::chrono::milliseconds(100); // NOTE: the server may not listen yet
+    options.max_retries = 20;
+
+    try {
+        tftpd::transfer_report srv;
+
+        // default options: blksize 512 and an empty last block
+        auto r = upload("client_test_1k.dat", 1024, options, srv);
+        assert(r.status == tftpd::transfer_status::success);
+        assert(r.bytes == 1024);
+        assert(r.blocks == 3);
+        assert(r.blksize == SEGSIZE);
+        assert(srv.status == tftpd::transfer_status::success);
+        assert(srv.bytes == 1024);
+
+        // negotiated blksize
+        options.blksize = 1428;
+        r = upload("client_test_100k.dat", 100000, options, srv);
+        std::cout << r.filename << " bytes:" << r.bytes << " blocks:" << r.blocks << " blksize:" << r.blksize
+                  << " setup:" << r.setup.count() << "us duration:" << r.duration.count() << "us rtt:" << r.rtt.count()
+                  << "us\n";
+        assert(r.status == tftpd::transfer_status::success);
+        assert(r.blksize == 1428);
+        assert(r.blocks == 100000 / 1428 + 1);
+        assert(srv.blksize == 1428);
+        assert(srv.bytes == 100000);
+
+        // lossy network in both directions, reproducible by the seeds
+        options.network.loss = 0.05;
+        options.network.seed = 7;
+        tftpd::g_impairment.loss = 0.05;
+        tftpd::g_impairment.seed = 11;
+        r = upload("client_test_lossy.dat", 100000, options, srv);
+        std::cout << r.filename << " retransmits:" << r.retransmits << " server duplicates:" << srv.duplicates
+                  << " server retransmits:" << srv.retransmits << "\n";
+        assert(r.status == tftpd::transfer_status::success);
+        assert(r.retransmits > 0);
+        assert(srv.bytes == 100000);
+        options.network = {};
+        tftpd::g_impairment = {};
+
+        // a lossy download of some MB: more timeouts in total than maxtimeout allows in a row
+        constexpr size_t large{4 * 1024 * 1024};
+        r = upload("client_test_4m.dat", large, options, srv);
+        assert(r.status == tftpd::transfer_status::success);
+        (void)chmod((std::string(rootdir) + "/client_test_4m.dat").c_str(), 0644);
+        tftpd::g_impairment.loss = 0.002;
+        tftpd::g_impairment.seed = 17;
+        auto lossy = std::make_shared<std::vector<char>>();
+        r = download("client_test_4m.dat", lossy, options, srv);
+        std::cout << r.filename << " download server retransmits:" << srv.retransmits << "\n";
+        assert(r.status == tftpd::transfer_status::success);
+        assert(srv.status == tftpd::transfer_status::success);
+        assert(srv.retransmits >= 4);
+        assert(lossy->size() == large);
+        for (size_t i = 0; i < lossy->size(); ++i) {
+            assert((*lossy)[i] == static_cast<char>(i * 7));
+        }
+        tftpd::g_impairment = {};
+
+        // compressed while received: the ACKs wait for the storage, not the thread of the session
+        if (tftpd::compression_available(tftpd::compression::gzip)) {
+            size_t blocked = 0;
+            tftpd::set_storage([&blocked](const std::string &path) -> std::unique_ptr<tftpd::storage_sink> {
+                return std::make_unique<deferring_sink>(tftpd::compressed_sink::open(path, tftpd::compression::gzip),
+                                                        blocked);
+            });
+            std::string const name = std::string(rootdir) + "/client_test_compressed.log";
+            (void)remove((name + ".gz").c_str());
+            auto data = std::make_shared<std::vector<char>>(large);
+            std::mt19937 random(5);
+            for (auto &c : *data) {
+                c = static_cast<char>('a' + random() % 26);
+            }
+            std::thread srv_thread([&srv] {
+                (void)tftpd::receive_file(rootdir, port, nullptr,
+                                          [&srv](const tftpd::transfer_report &rep) { srv = rep; });
+            });
+            r = run([&](tftpd::client &c, tftpd::client_handler h) {
+                c.async_put(server, "client_test_compressed.log", data, options, h);
+            });
+            srv_thread.join();
+            tftpd::set_storage(nullptr);
+            std::cout << r.filename << " blocks taken with would_block:" << blocked << "\n";
+            assert(r.status == tftpd::transfer_status::success);
+            assert(srv.status == tftpd::transfer_status::success && srv.bytes == large);
+            assert(blocked >= large / 1428 / 64);
+            struct stat st = {};
+            assert(stat((name + ".gz").c_str(), &st) == 0 && st.st_size > 0 && static_cast<size_t>(st.st_size) < large);
+            assert(stat((name + ".gz.upload").c_str(), &st) != 0);
+        }
+
+        // downloads of the files uploaded, sent from the file cache, checked by the root index
+        (void)chmod((std::string(rootdir) + "/client_test_100k.dat").c_str(), 0644);
+        (void)chmod((std::string(rootdir) + "/client_test_1k.dat").c_str(), 0600);
+        assert(tftpd::set_root_index(rootdir));
+        auto const cached = tftpd::get_file_cache_counters();
+        auto sink = std::make_shared<std::vector<char>>();
+        r = download("client_test_100k.dat", sink, options, srv);
+        std::cout << r.filename << " download bytes:" << r.bytes << " blocks:" << r.blocks << " rtt:" << r.rtt.count()
+                  << "us\n";
+        assert(r.status == tftpd::transfer_status::success);
+        assert(srv.status == tftpd::transfer_status::success);
+        assert(srv.download && srv.bytes == 100000 && srv.blocks == 100000 / 1428 + 1 && srv.blksize == 1428);
+        assert(sink->size() == 100000);
+        for (size_t i = 0; i < sink->size(); ++i) {
+            assert((*sink)[i] == static_cast<char>(i * 7));
+        }
+        sink->clear();
+        tftpd::client_options plain;
+        plain.rexmt = options.rexmt;
+        plain.max_retries = options.max_retries;
+        plain.tsize = false;
+        r = download("client_test_100k.dat", sink, plain, srv);
+        assert(r.status == tftpd::transfer_status::success);
+        assert(srv.blksize == SEGSIZE && srv.blocks == 100000 / SEGSIZE + 1);
+        assert(sink->size() == 100000);
+        auto counters = tftpd::get_file_cache_counters();
+        assert(counters.misses == cached.misses + 1 && counters.hits == cached.hits + 1);
+
+        // a file not found, or without read access for others
+        sink->clear();
+        r = download("client_test_missing.dat", sink, options, srv);
+        assert(r.status == tftpd::transfer_status::error_received);
+        assert(r.error == ENOTFOUND);
+        assert(srv.status == tftpd::transfer_status::error_sent);
+        r = download("client_test_1k.dat", sink, options, srv);
+        assert(r.status == tftpd::transfer_status::error_received);
+        assert(r.error == EACCESS);
+        assert(sink->empty());
+        assert(tftpd::get_root_index_counters().hits >= 4);
+        assert(tftpd::set_root_index(nullptr));
+
+        // receive_file() accepts an upload only, a download is refused
+        {
+            std::error_code ec;
+            std::string file("none");
+            std::thread srv_thread([&file, &ec] { file = tftpd::receive_file(rootdir, port, nullptr, nullptr, ec); });
+            r = run([&](tftpd::client &c, tftpd::client_handler h) {
+                c.async_get(server, "client_test_100k.dat", sink, options, h);
+            });
+            srv_thread.join();
+            assert(r.status == tftpd::transfer_status::error_received && r.error == EBADOP);
+            assert(ec && file.empty());
+            assert(sink->empty());
+        }
+
+        // a config rendered in memory for the MAC, no such file on disk
+        tftpd::add_file_provider("pxelinux.cfg/01-*", [](const std::string &path) {
+            return std::optional<std::string>("DEFAULT linux\n# " + path + "\n");
+        });
+        r = download("pxelinux.cfg/01-00-11-22-33-44-55", sink, options, srv);
+        assert(r.status == tftpd::transfer_status::success);
+        assert(std::string(sink->begin(), sink->end()) == "DEFAULT linux\n# pxelinux.cfg/01-00-11-22-33-44-55\n");
+        assert(srv.download && srv.bytes == sink->size());
+        assert(tftpd::get_file_cache_counters().rendered == 1);
+        tftpd::clear_file_providers();
+
+        // received on the caller's io_context, completed through a future
+        {
+            boost::asio::io_context io_context;
+            auto file = tftpd::async_receive_file(io_context, rootdir, port, nullptr, boost::asio::use_future);
+            std::thread t([&io_context] { io_context.run(); });
+            auto data = std::make_shared<std::vector<char>>(1000, 'f');
+            r = run([&](tftpd::client &c, tftpd::client_handler h) {
+                c.async_put(server, "client_test_future.dat", data, options, h);
+            });
+            t.join();
+            assert(r.status == tftpd::transfer_status::success);
+            assert(file.get() == std::string(rootdir) + "/client_test_future.dat");
+        }
+
+        // several uploads served on the io_context of the clients, no thread needed
+        {
+            boost::asio::io_context io_context;
+            std::vector<tftpd::transfer_report> reports;
+            boost::system::error_code served = boost::asio::error::would_block;
+            tftpd::async_serve(
+                io_context, rootdir, port, 3, [&reports](const tftpd::transfer_report &rep) { reports.push_back(rep); },
+                [&served](const boost::system::error_code &ec) { served = ec; });
+            tftpd::client c(io_context);
+            std::vector<tftpd::transfer_report> results;
+            for (int i = 0; i < 3; ++i) {
+                c.async_put(server, "client_test_serve" + std::to_string(i) + ".dat",
+                            std::make_shared<std::vector<char>>(5000, static_cast<char>('a' + i)), options,
+                            [&results](const tftpd::transfer_report &rep) { results.push_back(rep); });
+            }
+            io_context.run();
+            assert(!served);
+            assert(results.size() == 3 && reports.size() == 3);
+            for (size_t i = 0; i < 3; ++i) {
+                assert(results[i].status == tftpd::transfer_status::success);
+                assert(reports[i].status == tftpd::transfer_status::success);
+                assert(reports[i].bytes == 5000);
+
+                // NOTE: each session writes from its own buffers
+                std::ifstream is(std::string(rootdir) + "/client_test_serve" + std::to_string(i) + ".dat");
+                std::string const content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                assert(content == std::string(5000, static_cast<char>('a' + i)));
+            }
+        }
+
+        // listeners on the same io_context, each with its own rootdir and report sink
+        {
+            std::string const other = std::string(rootdir) + "-other";
+            (void)mkdir(other.c_str(), 0777);
+            const boost::asio::ip::udp::endpoint other_server(boost::asio::ip::address_v4::loopback(), port + 1);
+
+            boost::asio::io_context io_context;
+            std::vector<tftpd::transfer_report> reports;
+            std::vector<tftpd::transfer_report> other_reports;
+            {
+                std::string const temporary = other; // NOTE: copied, need not outlive the operation
+                tftpd::async_serve(
+                    io_context, temporary.c_str(), port + 1, 1,
+                    [&other_reports](const tftpd::transfer_report &rep) { other_reports.push_back(rep); },
+                    [](const boost::system::error_code & /*ec*/) {});
+            }
+            tftpd::async_serve(
+                io_context, rootdir, port, 1, [&reports](const tftpd::transfer_report &rep) { reports.push_back(rep); },
+                [](const boost::system::error_code & /*ec*/) {});
+            tftpd::client c(io_context);
+            std::vector<tftpd::transfer_report> results;
+            auto const handler = [&results](const tftpd::transfer_report &rep) { results.push_back(rep); };
+            c.async_put(server, "client_test_root.dat", std::make_shared<std::vector<char>>(3000, 'r'), options,
+                        handler);
+            c.async_put(other_server, "client_test_root.dat", std::make_shared<std::vector<char>>(2000, 'o'), options,
+                        handler);
+            io_context.run();
+            assert(results.size() == 2);
+            assert(reports.size() == 1 && reports[0].bytes == 3000);
+            assert(other_reports.size() == 1 && other_reports[0].bytes == 2000);
+            assert(other_reports[0].filename == other + "/client_test_root.dat");
+
+            std::ifstream is(std::string(rootdir) + "/client_test_root.dat");
+            std::string const content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+            assert(content == std::string(3000, 'r'));
+            std::ifstream os(other + "/client_test_root.dat");
+            std::string const other_content((std::istreambuf_iterator<char>(os)), std::istreambuf_iterator<char>());
+            assert(other_content == std::string(2000, 'o'));
+        }
+
+        // concurrent uploads each with the blksize of its own request
+        {
+            boost::asio::io_context io_context;
+            std::vector<tftpd::transfer_report> reports;
+            boost::system::error_code served = boost::asio::error::would_block;
+            tftpd::async_serve(
+                io_context, rootdir, port, 2, [&reports](const tftpd::transfer_report &rep) { reports.push_back(rep); },
+                [&served](const boost::system::error_code &ec) { served = ec; });
+            tftpd::client c(io_context);
+            std::vector<std::shared_ptr<std::vector<char>>> data;
+            std::vector<tftpd::transfer_report> results;
+            auto put = [&](size_t blksize, size_t size) {
+                data.push_back(std::make_shared<std::vector<char>>(size));
+                for (size_t i = 0; i < size; ++i) {
+                    (*data.back())[i] = static_cast<char>(i * 7 + blksize);
+                }
+                tftpd::client_options opts = options;
+                opts.blksize = blksize;
+                c.async_put(server, "client_test_blksize" + std::to_string(blksize) + ".dat", data.back(), opts,
+                            [&results](const tftpd::transfer_report &rep) { results.push_back(rep); });
+            };
+            put(1428, 20000000);
+            // NOTE: the second request arrives while the first upload is running
+            boost::asio::steady_timer later(io_context, std::chrono::milliseconds(50));
+            later.async_wait([&put](const boost::system::error_code & /*ec*/) { put(512, 100000); });
+            io_context.run();
+            assert(!served);
+            assert(results.size() == 2 && reports.size() == 2);
+            for (const auto &rep : reports) {
+                assert(rep.status == tftpd::transfer_status::success);
+                assert(rep.bytes == ((rep.blksize == 1428) ? 20000000 : 100000));
+            }
+            for (size_t n = 0; n < 2; ++n) {
+                assert(results[n].status == tftpd::transfer_status::success);
+                std::ifstream is(std::string(rootdir) + "/client_test_blksize" + std::to_string(n == 0 ? 1428 : 512) +
+                                     ".dat",
+                                 std::ios::binary);
+                std::vector<char> const received((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+                assert(received == *data[n]);
+            }
+        }
+        tftpd::g_report = nullptr;
+
+        // a retransmitted request is not answered by its session destroyed meanwhile
+        {
+            boost::asio::io_context io_context;
+            auto session = std::make_unique<tftpd::receiver>(io_context, port);
+            boost::asio::ip::udp::socket peer(io_context, {boost::asio::ip::address_v4::loopback(), 0});
+            const char wrq[] = "\0\2client_test_gone.dat\0octet"; // NOTE: ends with '\0' too
+            std::vector<char> const request(wrq, wrq + sizeof(wrq));
+            peer.send_to(boost::asio::buffer(request), server);
+            while (tftpd::g_requests.size() == 0) {
+                (void)io_context.run_one();
+            }
+            session->stop();
+            (void)io_context.poll();
+
+            // NOTE: the answer again is posted to the io_context of the session
+            assert(!tftpd::g_requests.claim(peer.local_endpoint(), request, nullptr));
+            session.reset();
+            io_context.restart();
+            (void)io_context.poll();
+            assert(tftpd::g_requests.size() == 0);
+        }
+
+        // missing local file
+        r = run([&](tftpd::client &c, tftpd::client_handler h) {
+            c.async_put(server, "none.dat", "/nonexistent/none.dat", options, h);
+        });
+        assert(r.status == tftpd::transfer_status::error_sent);
+        assert(r.error == ENOENT + ERRNO_OFFSET);
+
+        // nobody listens
+        options.max_retries = 2;
+        r = run([&](tftpd::client &c, tftpd::client_handler h) {
+            c.async_put(server, "none.dat", std::make_shared<std::vector<char>>(10), options, h);
+        });
+        assert(r.status == tftpd::transfer_status::timeout);
+        assert(r.retransmits == 2);
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,199 @@
+#include "compression.hpp"
+
+#include <array>
+
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+#    include <zlib.h>
+#endif
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+#    include <zstd.h>
+#endif
+
+#include <syslog.h>
+
+namespace tftpd {
+
+namespace {
+
+/// the size of the compressed data written at once
+constexpr size_t output_size{1UL << 17};
+
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+constexpr bool have_zlib{true};
+#else
+constexpr bool have_zlib{false};
+#endif
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+constexpr bool have_zstd{true};
+#else
+constexpr bool have_zstd{false};
+#endif
+
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+
+class gzip_encoder : public encoder
+{
+public:
+    explicit gzip_encoder(int level)
+    {
+        // NOTE: 15 + 16 for the gzip header and trailer instead of zlib
+        if (deflateInit2(&stream_, (level != 0) ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            syslog(LOG_ERR, "tftpd: deflateInit2() failed!\n");
+            failed_ = true;
+        }
+    }
+    ~gzip_encoder() override { (void)deflateEnd(&stream_); }
+
+    gzip_encoder(const gzip_encoder &) = delete;
+    gzip_encoder &operator=(const gzip_encoder &) = delete;
+
+    bool write(FILE *file, const char *data, size_t length) override
+    {
+        stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data)); // NOLINT: zlib is not const
+        stream_.avail_in = static_cast<uInt>(length);
+        return deflate_all(file, Z_NO_FLUSH);
+    }
+
+    bool finish(FILE *file) override { return deflate_all(file, Z_FINISH); }
+
+private:
+    bool deflate_all(FILE *file, int flush)
+    {
+        if (failed_) {
+            return false;
+        }
+        int result = Z_OK;
+        do {
+            stream_.next_out = output_.data();
+            stream_.avail_out = static_cast<uInt>(output_.size());
+            result = deflate(&stream_, flush);
+            if (result == Z_STREAM_ERROR) {
+                syslog(LOG_ERR, "tftpd: deflate() failed!\n");
+                return false;
+            }
+            size_t const n = output_.size() - stream_.avail_out;
+            if (n > 0 && fwrite(output_.data(), 1, n, file) != n) {
+                return false;
+            }
+        } while (stream_.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+        return true;
+    }
+
+    z_stream stream_{};
+    bool failed_{false};
+    std::array<Bytef, output_size> output_{};
+};
+
+#endif
+
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+
+class zstd_encoder : public encoder
+{
+public:
+    explicit zstd_encoder(int level) : context_(ZSTD_createCCtx())
+    {
+        if (context_ != nullptr && level != 0) {
+            (void)ZSTD_CCtx_setParameter(context_, ZSTD_c_compressionLevel, level);
+        }
+    }
+    ~zstd_encoder() override { (void)ZSTD_freeCCtx(context_); }
+
+    zstd_encoder(const zstd_encoder &) = delete;
+    zstd_encoder &operator=(const zstd_encoder &) = delete;
+
+    bool write(FILE *file, const char *data, size_t length) override
+    {
+        ZSTD_inBuffer input{data, length, 0};
+        while (input.pos < input.size) {
+            if (!compress(file, input, ZSTD_e_continue)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool finish(FILE *file) override
+    {
+        ZSTD_inBuffer input{nullptr, 0, 0};
+        size_t remaining = 1;
+        while (remaining != 0) {
+            if (!compress(file, input, ZSTD_e_end, &remaining)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool compress(FILE *file, ZSTD_inBuffer &input, ZSTD_EndDirective mode, size_t *remaining = nullptr)
+    {
+        if (context_ == nullptr) {
+            return false;
+        }
+        ZSTD_outBuffer output{output_.data(), output_.size(), 0};
+        size_t const result = ZSTD_compressStream2(context_, &output, &input, mode);
+        if (ZSTD_isError(result) != 0) {
+            syslog(LOG_ERR, "tftpd: ZSTD_compressStream2() failed! %s\n", ZSTD_getErrorName(result));
+            return false;
+        }
+        if (remaining != nullptr) {
+            *remaining = result;
+        }
+        return output.pos == 0 || fwrite(output_.data(), 1, output.pos, file) == output.pos;
+    }
+
+    ZSTD_CCtx *context_;
+    std::array<char, output_size> output_{};
+};
+
+#endif
+
+} // namespace
+
+const char *compression_suffix(compression codec)
+{
+    switch (codec) {
+    case compression::gzip:
+        return ".gz";
+    case compression::zstd:
+        return ".zst";
+    case compression::none:
+        break;
+    }
+    return "";
+}
+
+bool compression_available(compression codec)
+{
+    switch (codec) {
+    case compression::gzip:
+        return have_zlib;
+    case compression::zstd:
+        return have_zstd;
+    case compression::none:
+        break;
+    }
+    return true;
+}
+
+std::unique_ptr<encoder> make_encoder(compression codec, int level)
+{
+    switch (codec) {
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+    case compression::gzip:
+        return std::make_unique<gzip_encoder>(level);
+#endif
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+    case compression::zstd:
+        return std::make_unique<zstd_encoder>(level);
+#endif
+    default:
+        break;
+    }
+    (void)level;
+    return nullptr;
+}
+
+} // namespace tftpd
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * The stream compressors of the compressed_sink.
+ *
+ * zstd and gzip (zlib) are used if they were found when tftpd was built,
+ * see compression_available().
+ */
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+namespace tftpd {
+
+enum class compression
+{
+    none,
+    gzip,
+    zstd,
+};
+
+/// ".gz" or ".zst" appended to the name of the file, "" for none
+const char *compression_suffix(compression codec);
+
+/// true if tftpd was built with the library of the codec
+bool compression_available(compression codec);
+
+/// one compressed stream written to a file
+class encoder
+{
+public:
+    virtual ~encoder() = default;
+
+    /// compress the data, false if it failed
+    virtual bool write(FILE *file, const char *data, size_t length) = 0;
+
+    /// the end of the stream, false if it failed
+    virtual bool finish(FILE *file) = 0;
+};
+
+/// @param level of the codec, 0 for its default
+/// @return nullptr if the codec is not available
+std::unique_ptr<encoder> make_encoder(compression codec, int level = 0);
+
+} // namespace tftpd
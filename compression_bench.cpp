@@ -0,0 +1,207 @@
+// NOTE: benchmark of the compressed storage, CPU cost versus bytes written! CK
+//
+// Writes synthetic uploads through a file_sink and a compressed_sink for
+// every codec and level available, in blocks of the blksize as a session
+// does.  Reports the bytes written, the ratio, the CPU seconds of the
+// process (with the worker) per GiB uploaded and how long the session
+// waited for the storage, to decide per directory which uploads to compress.  Results
+// go to stderr as a table and optional as JSON (--json=FILE, - for stdout).
+#include "storage.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace {
+
+struct bench_result
+{
+    std::string data;
+    std::string codec;
+    int level{0};
+    uint64_t size{0};
+    uint64_t written{0};
+    double ratio{1};
+    double cpu_sec_per_gib{0};
+    double session_ms{0}; // in write(), commit() and waiting for the worker
+};
+
+double cpu_seconds()
+{
+    struct rusage ru = {};
+    (void)getrusage(RUSAGE_SELF, &ru);
+    return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+std::vector<char> make_data(const std::string &kind, size_t size)
+{
+    std::string text;
+    std::mt19937 random(1); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    for (size_t i = 0; text.size() < size; ++i) {
+        if (kind == "log") {
+            text += "Jan  1 00:00:" + std::to_string(10 + i % 50) + " device kernel: [" + std::to_string(i * 37) +
+                    "] eth0: link up, 1000 Mbps, full duplex, rx " + std::to_string(random() % 100003) + " packets\n";
+        } else if (kind == "config") {
+            text += "interface GigabitEthernet0/" + std::to_string(i % 48) + "\n description port " +
+                    std::to_string(i) + "\n switchport access vlan " + std::to_string(random() % 4096) + "\n!\n";
+        } else {
+            text += static_cast<char>(random());
+        }
+    }
+    return {text.begin(), text.begin() + static_cast<std::ptrdiff_t>(size)};
+}
+
+template <typename Sink>
+bench_result run_case(const std::string &kind, const std::vector<char> &data, size_t blksize, Sink &sink)
+{
+    double const cpu = cpu_seconds();
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < data.size(); done += blksize) {
+        int const error = sink.write(data.data() + done, std::min(blksize, data.size() - done));
+        if (error == tftpd::storage_sink::would_block) {
+            tftpd::wait_ready(sink, false); // NOTE: as the session holds back the ACK
+        } else if (error != 0) {
+            std::cerr << "write failed!\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    tftpd::wait_ready(sink, true);
+    if (sink.commit() != 0) {
+        std::cerr << "commit failed!\n";
+        exit(EXIT_FAILURE);
+    }
+    std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+
+    bench_result res;
+    res.data = kind;
+    res.size = data.size();
+    res.cpu_sec_per_gib = (cpu_seconds() - cpu) * static_cast<double>(1UL << 30) / static_cast<double>(data.size());
+    res.session_ms = elapsed.count();
+    return res;
+}
+
+std::vector<std::string> parse_list(const std::string &arg)
+{
+    std::vector<std::string> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        list.push_back(item);
+    }
+    return list;
+}
+
+void write_json(std::ostream &os, const std::vector<bench_result> &results)
+{
+    os << "{\n  \"benchmark\": \"compression_bench\",\n  \"results\": [";
+    const char *sep = "\n";
+    for (const auto &r : results) {
+        os << sep << "    {\"data\": \"" << r.data << "\", \"codec\": \"" << r.codec << "\", \"level\": " << r.level
+           << ", \"size\": " << r.size << ", \"written\": " << r.written << ", \"ratio\": " << r.ratio
+           << ", \"cpu_sec_per_gib\": " << r.cpu_sec_per_gib << ", \"session_ms\": " << r.session_ms << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cerr << "Usage: compression_bench [--data=LIST] [--size=N] [--blksize=N] [--dir=DIR] [--json=FILE|-]\n"
+                 "       LIST is comma separated of log, config and random\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> kinds{"log", "config", "random"};
+    size_t size = 16UL << 20;
+    size_t blksize = 1428;
+    std::string dir("/tmp");
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        auto value = [&arg]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.rfind("--data=", 0) == 0) {
+            kinds = parse_list(value());
+        } else if (arg.rfind("--size=", 0) == 0) {
+            size = std::strtoul(value().c_str(), nullptr, 10);
+        } else if (arg.rfind("--blksize=", 0) == 0) {
+            blksize = std::strtoul(value().c_str(), nullptr, 10);
+        } else if (arg.rfind("--dir=", 0) == 0) {
+            dir = value();
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value();
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct codec_level
+    {
+        tftpd::compression codec;
+        const char *name;
+        int level;
+    };
+    std::vector<codec_level> const codecs{{tftpd::compression::gzip, "gzip", 1},  {tftpd::compression::gzip, "gzip", 6},
+                                          {tftpd::compression::gzip, "gzip", 9},  {tftpd::compression::zstd, "zstd", 1},
+                                          {tftpd::compression::zstd, "zstd", 3},  {tftpd::compression::zstd, "zstd", 9},
+                                          {tftpd::compression::zstd, "zstd", 19}};
+    std::string const path = dir + "/compression_bench.dat";
+
+    std::vector<bench_result> results;
+    fprintf(stderr, "%-7s %-5s %5s %10s %10s %7s %10s %10s\n", "data", "codec", "level", "size", "written", "ratio",
+            "cpu s/GiB", "session ms");
+    for (auto const &kind : kinds) {
+        auto const data = make_data(kind, size);
+
+        FILE *file = fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            perror(path.c_str());
+            return EXIT_FAILURE;
+        }
+        tftpd::file_sink plain(file, path, path);
+        auto r = run_case(kind, data, blksize, plain);
+        r.codec = "none";
+        r.written = r.size;
+        results.push_back(r);
+        (void)remove(path.c_str());
+
+        for (auto const &c : codecs) {
+            auto sink = tftpd::compressed_sink::open(path, c.codec, c.level);
+            if (!sink) {
+                continue; // NOTE: not available
+            }
+            r = run_case(kind, data, blksize, *sink);
+            r.codec = c.name;
+            r.level = c.level;
+            r.written = sink->compressed_size();
+            r.ratio = static_cast<double>(r.size) / static_cast<double>(std::max<uint64_t>(r.written, 1));
+            results.push_back(r);
+            (void)remove((path + tftpd::compression_suffix(c.codec)).c_str());
+        }
+    }
+    for (auto const &r : results) {
+        fprintf(stderr, "%-7s %-5s %5d %10lu %10lu %7.2f %10.2f %10.1f\n", r.data.c_str(), r.codec.c_str(), r.level,
+                r.size, r.written, r.ratio, r.cpu_sec_per_gib, r.session_ms);
+    }
+
+    if (json == "-") {
+        write_json(std::cout, results);
+    } else if (!json.empty()) {
+        std::ofstream os(json);
+        write_json(os, results);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the uploads compressed on the worker of the compressed_sink, decompressed again! CK
+
+#include "storage.hpp"
+
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+#    include <zlib.h>
+#endif
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+#    include <zstd.h>
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const std::string path{"/tmp/compression_test.log"};
+
+/// like the syslog of a device
+std::vector<char> log_lines(size_t size)
+{
+    std::string text;
+    for (size_t i = 0; text.size() < size; ++i) {
+        text += "Jan  1 00:00:" + std::to_string(10 + i % 50) + " device kernel: [" + std::to_string(i * 37) +
+                "] eth0: link up, 1000 Mbps, full duplex, rx " + std::to_string(i * i % 100003) + " packets\n";
+    }
+    return {text.begin(), text.begin() + static_cast<std::ptrdiff_t>(size)};
+}
+
+std::vector<char> read_file(const std::string &name)
+{
+    std::ifstream is(name, std::ios::binary);
+    return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+bool exists(const std::string &name)
+{
+    struct stat st = {};
+    return stat(name.c_str(), &st) == 0;
+}
+
+std::vector<char> decompress(const std::vector<char> &data, tftpd::compression codec)
+{
+    std::vector<char> out(1UL << 16);
+    size_t done = 0;
+#if defined(NETKIT_TFTP_HAVE_ZLIB)
+    if (codec == tftpd::compression::gzip) {
+        z_stream stream{};
+        assert(inflateInit2(&stream, 15 + 16) == Z_OK);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data())); // NOLINT
+        stream.avail_in = static_cast<uInt>(data.size());
+        int result = Z_OK;
+        while (result != Z_STREAM_END) {
+            out.resize(std::max(out.size(), 2 * done));
+            stream.next_out = reinterpret_cast<Bytef *>(out.data() + done);
+            stream.avail_out = static_cast<uInt>(out.size() - done);
+            result = inflate(&stream, Z_NO_FLUSH);
+            assert(result == Z_OK || result == Z_STREAM_END);
+            done = out.size() - stream.avail_out;
+        }
+        (void)inflateEnd(&stream);
+    }
+#endif
+#if defined(NETKIT_TFTP_HAVE_ZSTD)
+    if (codec == tftpd::compression::zstd) {
+        ZSTD_DCtx *context = ZSTD_createDCtx();
+        ZSTD_inBuffer input{data.data(), data.size(), 0};
+        size_t result = 1;
+        while (result != 0) {
+            out.resize(std::max(out.size(), 2 * done));
+            ZSTD_outBuffer output{out.data() + done, out.size() - done, 0};
+            result = ZSTD_decompressStream(context, &output, &input);
+            assert(ZSTD_isError(result) == 0);
+            done += output.pos;
+        }
+        (void)ZSTD_freeDCtx(context);
+    }
+#endif
+    (void)data;
+    out.resize(done);
+    return out;
+}
+
+} // namespace
+
+int main()
+{
+    using tftpd::compression;
+
+    try {
+        auto const data = log_lines(5UL << 20); // NOTE: more than the queue holds
+
+        assert(!tftpd::compressed_sink::open(path, compression::none));
+        for (auto codec : {compression::gzip, compression::zstd}) {
+            std::string const target = path + tftpd::compression_suffix(codec);
+            if (!tftpd::compression_available(codec)) {
+                std::cout << target << ": not available" << std::endl;
+                assert(!tftpd::compressed_sink::open(path, codec));
+                continue;
+            }
+
+            // compressed in the blocks of an upload
+            {
+                auto sink = tftpd::compressed_sink::open(path, codec);
+                assert(sink);
+                for (size_t done = 0; done < data.size(); done += 1428) {
+                    int const error = sink->write(data.data() + done, std::min<size_t>(1428, data.size() - done));
+                    assert(error == 0 || error == tftpd::storage_sink::would_block);
+                    if (error != 0) {
+                        tftpd::wait_ready(*sink, false);
+                    }
+                }
+                assert(!exists(target));
+                tftpd::wait_ready(*sink, true);
+                assert(sink->commit() == 0);
+                tftpd::checksum digest(tftpd::checksum_type::crc32c);
+                digest.update(data.data(), data.size());
+                sink->sidecar(digest);
+
+                std::cout << target << ": " << sink->size() << " compressed to " << sink->compressed_size()
+                          << std::endl;
+                assert(sink->size() == data.size());
+                assert(sink->compressed_size() < data.size() / 5);
+            }
+            assert(!exists(target + ".upload"));
+            auto const compressed = read_file(target);
+            assert(decompress(compressed, codec) == data);
+            auto const sidecar = read_file(path + ".crc32c");
+            assert(std::string(sidecar.begin(), sidecar.end()).find("  compression_test.log\n") == 8);
+            (void)remove(target.c_str());
+            (void)remove((path + ".crc32c").c_str());
+
+            // an upload which failed leaves nothing
+            {
+                auto sink = tftpd::compressed_sink::open(path, codec);
+                assert(sink);
+                assert(sink->write(data.data(), 100000) == 0);
+                assert(sink->write(data.data(), 1UL << 20) == tftpd::storage_sink::would_block);
+            }
+            assert(!exists(target) && !exists(target + ".upload"));
+
+            // empty
+            {
+                auto sink = tftpd::compressed_sink::open(path, codec);
+                assert(sink && sink->commit() == 0);
+            }
+            assert(decompress(read_file(target), codec).empty());
+            (void)remove(target.c_str());
+        }
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
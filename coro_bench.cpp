@@ -0,0 +1,221 @@
+// NOTE: benchmark of the callback receiver versus the coroutine receiver! CK
+//
+// Both receive uploads of the tftpd::client over 127.0.0.1 on the same
+// io_context and thread as the client, one transfer at a time, for every
+// blksize given.  Measured are the blocks per second of the data phase,
+// the CPU time per block and the heap allocations per block, of server
+// and client together.  Results go to stderr as a table and optional as
+// JSON (--json=FILE, - for stdout).
+#include "async_tftp_client.hpp"
+#include "coro_receiver.hpp"
+#include "tftp/tftpsubs.h"
+#include "tftpd.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <vector>
+
+namespace {
+std::atomic<size_t> allocations{0};
+
+/// NOTE: both operator new use malloc(), so each delete frees with free() what it got
+void *counted_malloc(std::size_t size)
+{
+    allocations++;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+} // namespace
+
+void *operator new(std::size_t size) { return counted_malloc(size); }
+void *operator new[](std::size_t size) { return counted_malloc(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t /*size*/) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t /*size*/) noexcept { std::free(p); }
+
+namespace {
+
+struct bench_result
+{
+    std::string receiver;
+    size_t blksize{0};
+    size_t filesize{0};
+    bool ok{false};
+    uint64_t blocks{0};
+    double blocks_per_sec{0};
+    double cpu_us_per_block{0};
+    double allocations_per_block{0};
+};
+
+double cpu_seconds()
+{
+    struct rusage ru = {};
+    (void)getrusage(RUSAGE_SELF, &ru);
+    return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+bench_result run_case(bool coroutine, size_t blksize, size_t filesize, uint16_t port)
+{
+    bench_result res;
+    res.receiver = coroutine ? "coroutine" : "callback";
+    res.blksize = blksize;
+    res.filesize = filesize;
+
+    auto data = std::make_shared<std::vector<char>>(filesize);
+    for (size_t i = 0; i < data->size(); ++i) {
+        (*data)[i] = static_cast<char>((i * 131) >> 7);
+    }
+
+    boost::asio::io_context io_context;
+    tftpd::transfer_report server;
+    tftpd::report_sink const sink = [&server](const tftpd::transfer_report &r) { server = r; };
+    std::unique_ptr<tftpd::coro_receiver> session;
+    if (coroutine) {
+        tftpd::g_report = sink;
+        session = std::make_unique<tftpd::coro_receiver>(io_context, port);
+        boost::asio::co_spawn(io_context, session->run(), boost::asio::detached);
+    } else {
+        tftpd::async_receive_file(io_context, tftpd::g_rootdir, port, sink,
+                                  [](const boost::system::error_code & /*ec*/, const std::string & /*file*/) {});
+    }
+
+    tftpd::client_options options;
+    options.blksize = blksize;
+    tftpd::client client(io_context);
+    tftpd::transfer_report result;
+    auto const cpu = cpu_seconds();
+    size_t const before = allocations;
+    client.async_put(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), port), "coro_bench.dat",
+                     data, options, [&result](const tftpd::transfer_report &r) { result = r; });
+    io_context.run();
+    auto const used = cpu_seconds() - cpu;
+
+    res.ok = result.status == tftpd::transfer_status::success && server.status == tftpd::transfer_status::success &&
+             server.bytes == filesize;
+    res.blocks = server.blocks;
+    if (res.blocks > 0 && result.duration.count() > 0) {
+        std::chrono::duration<double> const seconds = result.duration;
+        res.blocks_per_sec = static_cast<double>(res.blocks) / seconds.count();
+        res.cpu_us_per_block = used * 1e6 / static_cast<double>(res.blocks);
+        res.allocations_per_block = static_cast<double>(allocations - before) / static_cast<double>(res.blocks);
+    }
+    tftpd::g_report = nullptr;
+    return res;
+}
+
+std::vector<size_t> parse_list(const std::string &arg)
+{
+    std::vector<size_t> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        char *end = nullptr;
+        size_t v = std::strtoul(item.c_str(), &end, 10);
+        if (*end == 'k' || *end == 'K') {
+            v <<= 10;
+        } else if (*end == 'm' || *end == 'M') {
+            v <<= 20;
+        }
+        list.push_back(v);
+    }
+    return list;
+}
+
+void write_json(std::ostream &os, const std::vector<bench_result> &results)
+{
+    os << "{\n  \"benchmark\": \"coro_bench\",\n  \"results\": [";
+    const char *sep = "\n";
+    for (const auto &r : results) {
+        os << sep << "    {\"receiver\": \"" << r.receiver << "\", \"blksize\": " << r.blksize
+           << ", \"filesize\": " << r.filesize << ", \"ok\": " << (r.ok ? "true" : "false")
+           << ", \"blocks\": " << r.blocks << ", \"blocks_per_sec\": " << r.blocks_per_sec
+           << ", \"cpu_us_per_block\": " << r.cpu_us_per_block
+           << ", \"allocations_per_block\": " << r.allocations_per_block << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cerr << "Usage: coro_bench [--port=N] [--rootdir=DIR] [--blksize=LIST] [--size=N] [--json=FILE|-]\n"
+                 "       LIST is comma separated, sizes may use k or m suffix\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 6969;
+    std::string rootdir("/tmp/tftpboot-bench");
+    std::string json;
+    std::vector<size_t> blksizes{SEGSIZE, 1428, 8192};
+    size_t size = 16UL << 20;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        auto value = [&arg]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.rfind("--port=", 0) == 0) {
+            port = static_cast<uint16_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else if (arg.rfind("--rootdir=", 0) == 0) {
+            rootdir = value();
+        } else if (arg.rfind("--blksize=", 0) == 0) {
+            blksizes = parse_list(value());
+        } else if (arg.rfind("--size=", 0) == 0) {
+            size = parse_list(value()).at(0);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value();
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_WARNING));
+    (void)mkdir(rootdir.c_str(), 0777);
+    tftpd::g_rootdir = rootdir.c_str();
+    tftpd::set_rate_limit({0}); // NOTE: all requests come from the loopback address
+
+    std::vector<bench_result> results;
+    bool all_ok = true;
+    fprintf(stderr, "%-10s %8s %10s %12s %10s %10s %4s\n", "receiver", "blksize", "size", "blocks/s", "cpu us/blk",
+            "allocs/blk", "ok");
+    for (auto blk : blksizes) {
+        for (bool coroutine : {false, true}) {
+            auto const r = run_case(coroutine, blk, size, port);
+            fprintf(stderr, "%-10s %8zu %10zu %12.0f %10.2f %10.2f %4s\n", r.receiver.c_str(), r.blksize, r.filesize,
+                    r.blocks_per_sec, r.cpu_us_per_block, r.allocations_per_block, r.ok ? "yes" : "NO");
+            all_ok = all_ok && r.ok;
+            results.push_back(r);
+        }
+    }
+    (void)unlink((rootdir + "/coro_bench.dat").c_str());
+
+    if (json == "-") {
+        write_json(std::cout, results);
+    } else if (!json.empty()) {
+        std::ofstream os(json);
+        write_json(os, results);
+    }
+
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,343 @@
+#include "coro_receiver.hpp"
+
+#include "tftpd.hpp"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <cstring>
+
+namespace tftpd {
+
+using boost::asio::awaitable;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+
+coro_receiver::coro_receiver(boost::asio::io_context &io_context, uint16_t port)
+    : memory_(std::make_shared<handler_memory>()), socket_(io_context, udp::endpoint(udp::v4(), port)),
+      timer_(io_context), storage_wait_(io_context), rxbuf_(MAXPKTSIZE)
+{}
+
+coro_receiver::~coro_receiver()
+{
+    g_admission.release(ticket_);
+    if (claimed_) {
+        g_requests.release(peer_, request_);
+    }
+}
+
+awaitable<size_t> coro_receiver::receive(std::vector<char> &buffer, std::chrono::seconds timeout)
+{
+    timed_out_ = false;
+    timer_.expires_after(timeout);
+    timer_.async_wait([this](const boost::system::error_code &error) {
+        if (!error) {
+            timed_out_ = true;
+            boost::system::error_code ignored;
+            (void)socket_.cancel(ignored);
+        }
+    });
+    return socket_.async_receive_from(boost::asio::buffer(buffer), sender_,
+                                      redirect_error(with_memory(memory_, use_awaitable), rx_error_));
+}
+
+boost::system::error_code coro_receiver::received(size_t length)
+{
+    timer_.cancel();
+    // NOTE: the timer may expire in the turn the datagram completes, it is received then
+    if (timed_out_ && (rx_error_ || length == 0)) {
+        return boost::asio::error::timed_out;
+    }
+    if (!rx_error_ && peer_.port() != 0 && sender_ != peer_) {
+        return boost::asio::error::try_again; // NOTE: not of our peer, ignored
+    }
+    if (!rx_error_) {
+        peer_ = sender_;
+    }
+    return rx_error_;
+}
+
+awaitable<size_t> coro_receiver::send(const char *data, size_t length)
+{
+    // NOTE: a failure is a lost datagram, as with send_to()
+    return socket_.async_send_to(boost::asio::buffer(data, length), peer_,
+                                 redirect_error(with_memory(memory_, use_awaitable), tx_error_));
+}
+
+awaitable<void> coro_receiver::send_error(int error, const char *message)
+{
+    std::string text = (message != nullptr) ? message : "";
+    if (message == nullptr) {
+        const struct errmsg *pe = errmsgs;
+        while (pe->e_code >= 0 && pe->e_code != error) {
+            pe++;
+        }
+        text = (pe->e_code >= 0) ? pe->e_msg : strerror(error - ERRNO_OFFSET);
+    }
+    syslog(LOG_ERR, "tftpd: send_error(%d): %s\n", error, text.c_str());
+    text.resize(std::min(text.size(), PKTSIZE - TFTP_HEADER - 1));
+
+    std::vector<char> pkt(TFTP_HEADER + text.size() + 1);
+    auto *tp = reinterpret_cast<struct tftphdr *>(pkt.data());
+    tp->th_opcode = htons(static_cast<u_short>(ERROR));
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    tp->th_code = htons(static_cast<u_short>(error < ERRNO_OFFSET ? error : EUNDEF));
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    memcpy(tp->th_msg, text.c_str(), text.size() + 1);
+
+    finish_report(transfer_status::error_sent, error, text);
+    (void)co_await send(pkt.data(), pkt.size());
+    error_ = std::make_error_code(std::errc::operation_canceled);
+}
+
+void coro_receiver::make_ack(uint64_t number)
+{
+    answer_.resize(TFTP_HEADER);
+    auto *ap = reinterpret_cast<struct tftphdr *>(answer_.data());
+    ap->th_opcode = htons(static_cast<u_short>(ACK));
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    ap->th_block = htons(receiver::wire(number, options_.rollover));
+}
+
+int coro_receiver::write(size_t length)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    const char *data = reinterpret_cast<struct tftphdr *>(rxbuf_.data())->th_data;
+    int const error = sink_->write(data, length);
+    if (error != 0 && error != storage_sink::would_block) {
+        return error;
+    }
+    digest_.update(data, length);
+    report_.bytes += length;
+    report_.blocks++;
+
+    if (options_.tsize != 0) { // NOTE: prevent division by zero! CK
+        auto const percent = static_cast<size_t>(100U * report_.bytes / static_cast<uint64_t>(options_.tsize));
+        if (percent != percent_) {
+            percent_ = percent;
+            if (g_callback != nullptr && (percent % 10) == 0) {
+                g_callback(percent);
+            }
+        }
+    }
+    return error; // NOTE: 0 or would_block
+}
+
+awaitable<void> coro_receiver::storage_ready(bool drained)
+{
+    auto executor = co_await boost::asio::this_coro::executor;
+    resumed_ = false;
+    storage_wait_.expires_at(boost::asio::steady_timer::time_point::max());
+    if (sink_->ready(drained, [this, executor, alive = std::weak_ptr<bool>(alive_)] {
+            boost::asio::post(executor, [this, alive] {
+                if (!alive.expired()) {
+                    resumed_ = true;
+                    storage_wait_.cancel();
+                }
+            });
+        })) {
+        co_return;
+    }
+    boost::system::error_code ignored;
+    if (!resumed_) {
+        co_await storage_wait_.async_wait(redirect_error(use_awaitable, ignored));
+    }
+}
+
+awaitable<void> coro_receiver::run()
+{
+    auto executor = co_await boost::asio::this_coro::executor;
+    boost::system::error_code ec;
+
+    // the request, dropped over the rate limit or if retransmitted
+    std::vector<char> request(PKTSIZE);
+    size_t length = 0;
+    for (;;) {
+        length = co_await receive(request, std::chrono::seconds(maxtimeout));
+        ec = received(length);
+        if (ec == boost::asio::error::timed_out) {
+            co_return; // NOTE: idle, no request received
+        }
+        if (ec || length < TFTP_HEADER || !g_limiter.admit(peer_.address(), std::chrono::steady_clock::now())) {
+            peer_ = {};
+            continue;
+        }
+        request.resize(length);
+        claimed_ = g_requests.claim(peer_, request, [this, executor, alive = std::weak_ptr<bool>(alive_)] {
+            boost::asio::post(executor, [this, alive] {
+                if (!alive.expired() && report_.blocks == 0 && !answer_.empty() && socket_.is_open()) {
+                    report_.retransmits++;
+                    boost::system::error_code ignored;
+                    (void)socket_.send_to(boost::asio::buffer(answer_), peer_, 0, ignored);
+                }
+            });
+        });
+        if (claimed_) {
+            request_ = request;
+            break;
+        }
+        request.resize(PKTSIZE);
+        peer_ = {};
+    }
+
+    // admitted without waiting or refused
+    auto const verdict = g_admission.acquire(ticket_, sizeof(*this) + BUFSIZ + MAXPKTSIZE,
+                                             sizeof(*this) + BUFSIZ + MAXPKTSIZE, [] {});
+    if (verdict != admission::verdict::admitted) {
+        (void)g_admission.dequeue(ticket_);
+        start_report();
+        co_await send_error(EUNDEF, "Server busy");
+        co_return;
+    }
+
+    std::vector<char> optack;
+    int const error = tftp(request, sink_, file_path_, optack, options_, g_rootdir);
+    start_report();
+    if (error != 0) {
+        co_await send_error(error);
+        co_return;
+    }
+    if (!sink_) {
+        co_return; // NOTE: access denied silently
+    }
+    digest_ = checksum(g_checksum);
+
+    // a new TID for the transfer
+    socket_.close();
+    socket_.open(udp::v4());
+    socket_.bind(udp::endpoint(udp::v4(), 0));
+
+    uint64_t block = 1;
+    if (optack.empty()) {
+        make_ack(0);
+    } else {
+        answer_ = std::move(optack);
+    }
+
+    int timeout = rexmtval;
+    bool answer = true;
+    for (;;) {
+        if (answer) {
+            (void)co_await send(answer_.data(), answer_.size());
+        }
+        answer = true;
+
+        length = co_await receive(rxbuf_, std::chrono::seconds(rexmtval));
+        ec = received(length);
+        if (ec == boost::asio::error::timed_out) {
+            timeout += rexmtval;
+            if (timeout >= maxtimeout) {
+                syslog(LOG_ERR, "tftpd: maxtimeout!\n");
+                finish_report(transfer_status::timeout);
+                error_ = std::make_error_code(std::errc::timed_out);
+                co_return;
+            }
+            syslog(LOG_WARNING, "tftpd: timeout\n");
+            report_.retransmits++;
+            continue; // NOTE: send the last answer again
+        }
+        if (ec || length < TFTP_HEADER) {
+            answer = false; // NOTE: not of our peer
+            continue;
+        }
+
+        auto *dp = reinterpret_cast<struct tftphdr *>(rxbuf_.data());
+        u_short const opcode = ntohs(dp->th_opcode);
+        if (opcode == ERROR) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            std::string const msg(dp->th_msg, strnlen(dp->th_msg, length - TFTP_HEADER));
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            finish_report(transfer_status::error_received, ntohs(dp->th_code), msg);
+            error_ = std::make_error_code(std::errc::connection_aborted);
+            co_return;
+        }
+        if (opcode != DATA) {
+            syslog(LOG_ERR, "tftpd: Invalid opcode, DATA expected!\n");
+            co_await send_error(EBADID);
+            co_return;
+        }
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        u_short const number = ntohs(dp->th_block);
+        if (number != receiver::wire(block, options_.rollover)) {
+            report_.duplicates++;
+            continue; // NOTE: the last answer again, if the peer missed it
+        }
+        timeout = rexmtval; // NOTE: maxtimeout counts the timeouts in a row only
+
+        size_t const seg_length = length - TFTP_HEADER;
+        int const err = write(seg_length);
+        if (err != 0 && err != storage_sink::would_block) {
+            co_await send_error(err);
+            co_return;
+        }
+        make_ack(block++);
+        if (seg_length == options_.segsize) {
+            if (err == storage_sink::would_block) {
+                co_await storage_ready(false); // NOTE: the ACK is held back
+            }
+            continue;
+        }
+
+        // the final data segment
+        co_await storage_ready(true);
+        int const commit_error = sink_->commit();
+        if (commit_error != 0) {
+            co_await send_error(commit_error);
+            co_return;
+        }
+        if (digest_.type() != checksum_type::none) {
+            report_.checksum = std::string(checksum_name(digest_.type())) + ":" + digest_.hex();
+            sink_->sidecar(digest_);
+        }
+        syslog(LOG_NOTICE, "tftpd: successfully received file: %s\n", file_path_.c_str());
+        finish_report(transfer_status::success);
+        break;
+    }
+
+    // dally: the final ack again if the last block is received again
+    (void)co_await send(answer_.data(), answer_.size());
+    length = co_await receive(rxbuf_, std::chrono::seconds(rexmtval));
+    ec = received(length);
+    if (!ec && length >= TFTP_HEADER && ntohs(reinterpret_cast<struct tftphdr *>(rxbuf_.data())->th_opcode) == DATA) {
+        report_.retransmits++;
+        (void)co_await send(answer_.data(), answer_.size());
+    }
+}
+
+void coro_receiver::start_report()
+{
+    started_ = std::chrono::steady_clock::now();
+    report_ = transfer_report{};
+    report_.peer_address = peer_.address().to_string();
+    report_.peer_port = peer_.port();
+    report_.filename = file_path_;
+    report_.blksize = options_.segsize;
+    report_.timeout_ms = options_.timeout;
+    reporting_ = true;
+}
+
+void coro_receiver::finish_report(transfer_status status, int error, const std::string &message)
+{
+    if (!reporting_) {
+        return;
+    }
+    reporting_ = false;
+
+    report_.duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_);
+    if (report_.duration.count() > 0) {
+        std::chrono::duration<double> const seconds = report_.duration;
+        report_.throughput = static_cast<double>(report_.bytes) / seconds.count();
+    }
+    report_.status = status;
+    report_.error = error;
+    report_.error_message = message;
+
+    if (g_report != nullptr) {
+        g_report(report_);
+    }
+}
+
+} // namespace tftpd
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * The upload session of tftpd::receiver as a C++20 coroutine.
+ *
+ * Instead of a chain of completion handlers with the state in members,
+ * run() is one loop: answer, co_await the next DATA block or the
+ * retransmission timeout, write it.  On a timeout the last answer is sent
+ * again.  The request is parsed, limited and admitted as by the server,
+ * but a request is not queued for a session and blocks ahead of sequence
+ * are not held back.  The data is written to the storage_sink opened by
+ * tftp().
+ *
+ * Built only if the compiler has coroutines, see CMakeLists.txt.
+ */
+#include "admission.hpp"
+#include "async_tftpd_server.hpp"
+#include "tftpd_options.hpp"
+#include "timer_wheel.hpp"
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace tftpd {
+
+class coro_receiver
+{
+public:
+    /// @throw boost::system::system_error if the port can't be bound
+    coro_receiver(boost::asio::io_context &io_context, uint16_t port);
+    ~coro_receiver();
+
+    coro_receiver(const coro_receiver &) = delete;
+    coro_receiver &operator=(const coro_receiver &) = delete;
+
+    /// wait for 1 request and receive the file, co_spawn it on the io_context
+    boost::asio::awaitable<void> run();
+
+    std::string get_filename() const { return file_path_; }
+
+    /// how the session ended, as server::error()
+    std::error_code error() const { return error_; }
+
+private:
+    using udp = boost::asio::ip::udp;
+
+    /*
+     * Receive a datagram, then received() with its length gives timed_out
+     * after the seconds given, unless a datagram arrived nevertheless.
+     * Not coroutines themselves, so no frame is allocated per block.
+     */
+    boost::asio::awaitable<size_t> receive(std::vector<char> &buffer, std::chrono::seconds timeout);
+    boost::system::error_code received(size_t length);
+    boost::asio::awaitable<size_t> send(const char *data, size_t length);
+    boost::asio::awaitable<void> send_error(int error, const char *message = nullptr);
+
+    /// the ACK of the block, of the absolute block number
+    void make_ack(uint64_t number);
+
+    /// write the payload of the DATA block in rxbuf_ to the sink, 0, storage_sink::would_block or the TFTP error
+    int write(size_t length);
+
+    /// until the sink takes blocks again, or with drained has written all
+    boost::asio::awaitable<void> storage_ready(bool drained);
+
+    void start_report();
+    void finish_report(transfer_status status, int error = 0, const std::string &message = {});
+
+    std::shared_ptr<handler_memory> memory_; // of the socket operations
+    udp::socket socket_;
+    wheel_session_timer timer_;
+    boost::asio::steady_timer storage_wait_; // cancelled when the sink is ready
+    bool resumed_{false};                    // by the sink
+    udp::endpoint peer_;
+    udp::endpoint sender_; // of the datagram received
+    boost::system::error_code rx_error_;
+    boost::system::error_code tx_error_;
+    std::unique_ptr<storage_sink> sink_;
+    checksum digest_; // of the blocks written
+    std::string file_path_;
+    session_options options_; // negotiated by the request
+    std::vector<char> rxbuf_;
+    std::vector<char> answer_; // the OACK or ACK sent last
+    bool timed_out_{false};
+    bool claimed_{false};
+    std::vector<char> request_; // claimed
+    admission::ticket ticket_;
+    size_t percent_{0};
+    transfer_report report_;
+    bool reporting_{false};
+    std::chrono::steady_clock::time_point started_;
+    std::error_code error_;
+    // NOTE: the answer again posted from another thread holds it weak, the receiver may be gone when it runs
+    std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+} // namespace tftpd
@@ -0,0 +1,119 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the coroutine receiver with the async client on one io_context! CK
+
+#include "async_tftp_client.hpp"
+#include "coro_receiver.hpp"
+#include "tftp/tftpsubs.h"
+#include "tftpd.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t port{6972};
+const char *const rootdir{"/tmp/tftpboot-coro-test"};
+const boost::asio::ip::udp::endpoint server(boost::asio::ip::address_v4::loopback(), port);
+
+struct outcome
+{
+    tftpd::transfer_report client;
+    tftpd::transfer_report server;
+    std::error_code error;
+};
+
+outcome transfer(const std::function<void(tftpd::client &, tftpd::client_handler)> &start)
+{
+    outcome result;
+    tftpd::g_report = [&result](const tftpd::transfer_report &r) { result.server = r; };
+    boost::asio::io_context io_context;
+    tftpd::coro_receiver session(io_context, port);
+    boost::asio::co_spawn(io_context, session.run(), boost::asio::detached);
+    tftpd::client client(io_context);
+    start(client, [&result](const tftpd::transfer_report &r) { result.client = r; });
+    io_context.run();
+    result.error = session.error();
+    tftpd::g_report = nullptr;
+    return result;
+}
+
+void check_file(const std::string &name, const std::vector<char> &data)
+{
+    std::ifstream is(std::string(rootdir) + "/" + name, std::ios::binary);
+    std::vector<char> const received((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    assert(received == data);
+}
+
+} // namespace
+
+int main()
+{
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_WARNING));
+    (void)mkdir(rootdir, 0777);
+    tftpd::g_rootdir = rootdir;
+
+    try {
+        auto data = std::make_shared<std::vector<char>>(100000);
+        for (size_t i = 0; i < data->size(); ++i) {
+            (*data)[i] = static_cast<char>(i * 13);
+        }
+
+        // negotiated blksize
+        tftpd::client_options options;
+        options.blksize = 1428;
+        auto r = transfer([&](tftpd::client &c, tftpd::client_handler h) {
+            c.async_put(server, "coro_test_100k.dat", data, options, h);
+        });
+        assert(r.client.status == tftpd::transfer_status::success);
+        assert(r.server.status == tftpd::transfer_status::success);
+        assert(r.server.blksize == 1428);
+        assert(r.server.bytes == data->size());
+        assert(r.server.blocks == data->size() / 1428 + 1);
+        assert(!r.error);
+        check_file("coro_test_100k.dat", *data);
+
+        // lossy client: the receiver times out and answers again, more often than maxtimeout allows in a row
+        options.rexmt = std::chrono::milliseconds(1200); // NOTE: after the receiver's timeout
+        options.network.loss = 0.2;
+        options.network.seed = 4;
+        auto small = std::make_shared<std::vector<char>>(data->begin(), data->begin() + 20000);
+        r = transfer([&](tftpd::client &c, tftpd::client_handler h) {
+            c.async_put(server, "coro_test_lossy.dat", small, options, h);
+        });
+        std::cout << "lossy: server retransmits " << r.server.retransmits << "\n";
+        assert(r.client.status == tftpd::transfer_status::success);
+        assert(r.server.status == tftpd::transfer_status::success);
+        assert(r.server.retransmits >= 4);
+        check_file("coro_test_lossy.dat", *small);
+        options.network = {};
+
+        // only upload supported
+        auto sink = std::make_shared<std::vector<char>>();
+        r = transfer([&](tftpd::client &c, tftpd::client_handler h) {
+            c.async_get(server, "coro_test_100k.dat", sink, options, h);
+        });
+        assert(r.client.status == tftpd::transfer_status::error_received);
+        assert(r.client.error == EBADOP);
+        assert(r.server.status == tftpd::transfer_status::error_sent);
+        assert(r.error == std::errc::operation_canceled);
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
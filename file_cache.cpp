@@ -0,0 +1,216 @@
+#include "file_cache.hpp"
+
+#include "tftp/tftpsubs.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <syslog.h>
+#include <utility>
+
+#ifdef __APPLE__
+#    define st_mtim st_mtimespec
+#endif
+
+namespace tftpd {
+
+file_stamp::file_stamp(const struct stat &st)
+    : device(st.st_dev), inode(st.st_ino), size(st.st_size),
+      mtime_ns(static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec)
+{}
+
+file_content::file_content(const file_stamp &stamp, std::vector<char> data) : stamp_(stamp), data_(std::move(data)) {}
+
+file_content::file_content(const file_stamp &stamp, int fd) : stamp_(stamp), fd_(fd) {}
+
+file_content::~file_content()
+{
+    if (fd_ >= 0) {
+        (void)close(fd_);
+    }
+}
+
+ssize_t file_content::read(uint64_t offset, char *buffer, size_t length) const
+{
+    if (offset >= size()) {
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, size() - offset));
+    if (fd_ < 0) {
+        memcpy(buffer, data_.data() + offset, length);
+        return static_cast<ssize_t>(length);
+    }
+    return pread(fd_, buffer, length, static_cast<off_t>(offset));
+}
+
+void file_cache::configure(const file_cache_limit &limit)
+{
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    limit_ = limit;
+    entries_.clear();
+    memory_ = 0;
+}
+
+content_ptr file_cache::open(const std::string &path, const struct stat &st, int &error)
+{
+    file_stamp const stamp(st);
+    file_cache_limit limit;
+    std::shared_future<content_ptr> loading;
+    {
+        std::shared_lock<std::shared_mutex> const lock(mutex_);
+        limit = limit_;
+        auto it = entries_.find(path);
+        if (it != entries_.end()) {
+            if (it->second->stamp == stamp) {
+                it->second->used = ++clock_;
+                hits_++;
+                loading = it->second->content;
+            } else {
+                stale_++;
+            }
+        }
+    }
+    if (loading.valid()) {
+        auto content = loading.get(); // NOTE: waits if another request reads the file still
+        if (content) {
+            return content;
+        }
+    }
+
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = errno + ERRNO_OFFSET;
+        return nullptr;
+    }
+    struct stat opened = {};
+    if (fstat(fd, &opened) < 0) {
+        error = errno + ERRNO_OFFSET;
+        (void)close(fd);
+        return nullptr;
+    }
+
+    // NOTE: the stamp of the file opened, it may have changed since the stat of the request
+    file_stamp const current(opened);
+    size_t const size = static_cast<size_t>(current.size);
+    if (limit.memory == 0 || size > limit.max_file || size > limit.memory) {
+        uncached_++;
+        return std::make_shared<file_content>(current, fd);
+    }
+
+    std::promise<content_ptr> loaded;
+    uint64_t id = 0;
+    {
+        std::unique_lock<std::shared_mutex> const lock(mutex_);
+        auto &slot = entries_[path];
+        if (slot && slot->stamp == current) {
+            slot->used = ++clock_;
+            hits_++;
+            loading = slot->content; // NOTE: a miss of the same file came first
+        } else {
+            if (slot) {
+                memory_ -= static_cast<size_t>(slot->stamp.size);
+            } else {
+                slot = std::make_unique<entry>();
+            }
+            id = ++clock_;
+            slot->stamp = current;
+            slot->content = loaded.get_future().share();
+            slot->loaded_by = id;
+            slot->used = id;
+            memory_ += size;
+            evict(slot.get());
+            misses_++;
+        }
+    }
+    if (id == 0) {
+        auto content = loading.get();
+        if (content) {
+            (void)close(fd);
+            return content;
+        }
+        uncached_++; // NOTE: its load failed, this session reads the file itself
+        return std::make_shared<file_content>(current, fd);
+    }
+
+    auto content = load(fd, current, error);
+    if (!content) {
+        std::unique_lock<std::shared_mutex> const lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second->loaded_by == id) {
+            memory_ -= size;
+            entries_.erase(it);
+        }
+    }
+    loaded.set_value(content);
+    return content;
+}
+
+content_ptr file_cache::load(int fd, const file_stamp &stamp, int &error)
+{
+    std::vector<char> data(static_cast<size_t>(stamp.size));
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t const n = ::read(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // NOTE: truncated meanwhile, the next request sees the new stamp
+            error = (n < 0) ? errno + ERRNO_OFFSET : EUNDEF;
+            syslog(LOG_ERR, "tftpd: read() of %lu bytes failed at %lu\n", data.size(), done);
+            (void)close(fd);
+            return nullptr;
+        }
+        done += static_cast<size_t>(n);
+    }
+    (void)close(fd);
+    return std::make_shared<file_content>(stamp, std::move(data));
+}
+
+void file_cache::evict(const entry *keep)
+{
+    while (memory_ > limit_.memory) {
+        auto victim = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.get() != keep && (victim == entries_.end() || it->second->used < victim->second->used)) {
+                victim = it;
+            }
+        }
+        if (victim == entries_.end()) {
+            break;
+        }
+        memory_ -= static_cast<size_t>(victim->second->stamp.size);
+        entries_.erase(victim);
+        evicted_++;
+    }
+}
+
+void file_cache::invalidate(const std::string &path)
+{
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        memory_ -= static_cast<size_t>(it->second->stamp.size);
+        entries_.erase(it);
+    }
+}
+
+file_cache_counters file_cache::counters() const
+{
+    file_cache_counters counters;
+    counters.hits = hits_;
+    counters.misses = misses_;
+    counters.stale = stale_;
+    counters.evicted = evicted_;
+    counters.uncached = uncached_;
+    std::shared_lock<std::shared_mutex> const lock(mutex_);
+    counters.files = entries_.size();
+    counters.memory = memory_;
+    return counters;
+}
+
+} // namespace tftpd
@@ -0,0 +1,131 @@
+#pragma once
+
+/*
+ * The contents of the files sent, shared by all sessions.
+ *
+ * In a PXE boot storm every client downloads the same few files
+ * (pxelinux.0, the kernel, the initrd).  The first RRQ of a file reads it
+ * into an immutable buffer, the sessions sending it hold the buffer by a
+ * shared_ptr and copy their DATA blocks from it without a lock or a
+ * system call.  The cache keeps the files used most recently up to
+ * file_cache_limit::memory bytes; the buffer of a file evicted or changed
+ * meanwhile lives on until its last session ended.
+ *
+ * A file changed on disk, i.e. its inode, size or mtime differ from the
+ * stat(2) of the request, is read again.  A hit takes a shared lock only,
+ * the recency of an entry is an atomic stamp; a miss enters the file as
+ * loading and reads it without any lock held, the requests of the same
+ * file meanwhile wait for that read instead of their own.  Files larger
+ * than file_cache_limit::max_file are not cached but read by their
+ * session with pread(2).
+ */
+#include "async_tftpd_server.hpp"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tftpd {
+
+/// what identifies a version of a file
+struct file_stamp
+{
+    dev_t device{0};
+    ino_t inode{0};
+    off_t size{0};
+    int64_t mtime_ns{0};
+
+    file_stamp() = default;
+    explicit file_stamp(const struct stat &st);
+
+    bool operator==(const file_stamp &other) const
+    {
+        return device == other.device && inode == other.inode && size == other.size && mtime_ns == other.mtime_ns;
+    }
+    bool operator!=(const file_stamp &other) const { return !(*this == other); }
+};
+
+/// the content of a file sent, in memory or read from its descriptor
+class file_content
+{
+public:
+    /// the whole file in memory
+    file_content(const file_stamp &stamp, std::vector<char> data);
+
+    /// read from the open file, which is closed with the content
+    file_content(const file_stamp &stamp, int fd);
+
+    ~file_content();
+
+    file_content(const file_content &) = delete;
+    file_content &operator=(const file_content &) = delete;
+
+    const file_stamp &stamp() const { return stamp_; }
+    uint64_t size() const { return static_cast<uint64_t>(stamp_.size); }
+    bool cached() const { return fd_ < 0; }
+
+    /// copy up to length bytes from the offset, returns the bytes copied
+    /// (less only at the end) or -1 with errno set
+    ssize_t read(uint64_t offset, char *buffer, size_t length) const;
+
+private:
+    file_stamp stamp_;
+    std::vector<char> data_;
+    int fd_{-1};
+};
+
+using content_ptr = std::shared_ptr<const file_content>;
+
+class file_cache
+{
+public:
+    explicit file_cache(const file_cache_limit &limit = {}) { configure(limit); }
+
+    /// set a new limit and forget all files
+    void configure(const file_cache_limit &limit);
+
+    /// the content of the file at the path with the stat given
+    /// @return nullptr with the TFTP error code (or errno + 100) set
+    content_ptr open(const std::string &path, const struct stat &st, int &error);
+
+    /// forget the file, i.e. it was changed
+    void invalidate(const std::string &path);
+
+    file_cache_counters counters() const;
+
+private:
+    struct entry
+    {
+        file_stamp stamp;
+        std::shared_future<content_ptr> content; // NOTE: nullptr if the load failed, the entry is gone then
+        uint64_t loaded_by{0};                   // the clock_ of the miss
+        std::atomic<uint64_t> used{0};           // NOTE: the clock_ of the last hit
+    };
+
+    /// the content of the file just opened, it is closed
+    static content_ptr load(int fd, const file_stamp &stamp, int &error);
+
+    /// drop the entries used least recently until the memory fits, the one given is kept
+    void evict(const entry *keep);
+
+    file_cache_limit limit_;
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<entry>> entries_;
+    size_t memory_{0}; // of the entries
+    std::atomic<uint64_t> clock_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> stale_{0};
+    std::atomic<uint64_t> evicted_{0};
+    std::atomic<uint64_t> uncached_{0};
+};
+
+} // namespace tftpd
@@ -0,0 +1,179 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the files sent from memory, read again when changed and evicted least recently used! CK
+
+#include "file_cache.hpp"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const std::string dir{"/tmp/file_cache_test"};
+
+std::string write_file(const std::string &name, size_t size, char fill)
+{
+    std::string const path = dir + "/" + name;
+    std::ofstream(path, std::ios::binary) << std::string(size, fill);
+    return path;
+}
+
+/// a new mtime, the same second may have been written twice
+void touch(const std::string &path, time_t seconds)
+{
+    struct timespec const times[2]{{seconds, 0}, {seconds, 0}};
+    assert(utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+}
+
+tftpd::content_ptr request(tftpd::file_cache &cache, const std::string &path)
+{
+    struct stat st = {};
+    assert(stat(path.c_str(), &st) == 0);
+    int error = 0;
+    auto content = cache.open(path, st, error);
+    assert(content && error == 0);
+    return content;
+}
+
+std::string read_all(const tftpd::content_ptr &content, size_t blksize)
+{
+    std::string data;
+    std::vector<char> block(blksize);
+    for (uint64_t offset = 0;; offset += blksize) {
+        ssize_t const n = content->read(offset, block.data(), blksize);
+        assert(n >= 0);
+        data.append(block.data(), static_cast<size_t>(n));
+        if (static_cast<size_t>(n) < blksize) {
+            return data;
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    try {
+        (void)mkdir(dir.c_str(), 0777);
+        tftpd::file_cache cache({3000, 2000});
+
+        // the first request reads the file, the others share its buffer
+        auto const pxelinux = write_file("pxelinux.0", 1000, 'p');
+        auto first = request(cache, pxelinux);
+        auto second = request(cache, pxelinux);
+        assert(first == second && first->cached());
+        assert(read_all(first, 512) == std::string(1000, 'p'));
+        auto counters = cache.counters();
+        assert(counters.misses == 1 && counters.hits == 1 && counters.files == 1 && counters.memory == 1000);
+
+        // changed on disk: read again, the session sending the old one keeps it
+        (void)write_file("pxelinux.0", 1200, 'q');
+        touch(pxelinux, 1000000000);
+        auto changed = request(cache, pxelinux);
+        assert(changed != first && changed->size() == 1200);
+        assert(read_all(first, 512) == std::string(1000, 'p'));
+        counters = cache.counters();
+        assert(counters.stale == 1 && counters.misses == 2 && counters.memory == 1200);
+
+        // the least recently used file is evicted for a new one
+        auto const kernel = write_file("kernel", 1000, 'k');
+        auto const initrd = write_file("initrd", 1500, 'i');
+        (void)request(cache, kernel);
+        (void)request(cache, pxelinux); // NOTE: the kernel is the oldest now
+        (void)request(cache, initrd);
+        counters = cache.counters();
+        assert(counters.evicted == 1 && counters.files == 2 && counters.memory == 2700);
+        (void)request(cache, pxelinux);
+        assert(cache.counters().hits == 3);
+        (void)request(cache, kernel);
+        assert(cache.counters().misses == 5);
+
+        // larger than max_file: read by its session from the file
+        auto const image = write_file("image", 5000, 'x');
+        auto uncached = request(cache, image);
+        assert(!uncached->cached());
+        assert(read_all(uncached, 1428) == std::string(5000, 'x'));
+        assert(cache.counters().uncached == 1);
+
+        // an empty file is one empty block
+        auto empty = request(cache, write_file("empty", 0, 0));
+        assert(read_all(empty, 512).empty());
+
+        // invalidated, i.e. by a change notification
+        cache.invalidate(pxelinux);
+        (void)request(cache, pxelinux);
+        assert(cache.counters().misses == 7);
+
+        // many sessions at once
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&cache, &kernel] {
+                for (int n = 0; n < 1000; ++n) {
+                    assert(read_all(request(cache, kernel), 512) == std::string(1000, 'k'));
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        // a boot storm: the requests of a file not cached yet wait for its first read
+        {
+            tftpd::file_cache storm({64UL << 20, 16UL << 20});
+            auto const initramfs = write_file("initramfs", 8UL << 20, 'r');
+            std::atomic<bool> go{false};
+            std::vector<tftpd::content_ptr> contents(8);
+            std::vector<std::thread> clients;
+            for (size_t i = 0; i < contents.size(); ++i) {
+                clients.emplace_back([&storm, &initramfs, &go, &contents, i] {
+                    while (!go) {
+                        std::this_thread::yield();
+                    }
+                    contents[i] = request(storm, initramfs);
+                });
+            }
+            go = true;
+            for (auto &t : clients) {
+                t.join();
+            }
+            for (auto const &content : contents) {
+                assert(content == contents[0]);
+            }
+            auto const loaded = storm.counters();
+            assert(loaded.misses == 1 && loaded.hits == contents.size() - 1 && loaded.memory == 8UL << 20);
+        }
+
+        counters = cache.counters();
+        std::cout << "hits " << counters.hits << " misses " << counters.misses << " stale " << counters.stale
+                  << " evicted " << counters.evicted << " uncached " << counters.uncached << " files "
+                  << counters.files << " memory " << counters.memory << std::endl;
+        assert(counters.memory <= 3000);
+
+        // not cached at all
+        cache.configure({0, 2000});
+        assert(!request(cache, kernel)->cached());
+        assert(cache.counters().files == 0);
+
+        for (const char *name : {"pxelinux.0", "kernel", "initrd", "image", "empty", "initramfs"}) {
+            (void)remove((dir + "/" + name).c_str());
+        }
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
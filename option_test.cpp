@@ -17,15 +17,18 @@ int main()
 
         std::vector<char> ackbuf;
         std::string path;
-        FILE *fp{nullptr};
+        std::unique_ptr<tftpd::storage_sink> sink;
+        tftpd::session_options negotiated;
+        std::string const rootdir{tftpd::g_rootdir};
 
         const char corrupt[]{"invalid data block"};
-        int err = tftpd::tftp(std::vector<char>(corrupt, corrupt + sizeof(corrupt)), fp, path, ackbuf);
+        int err =
+            tftpd::tftp(std::vector<char>(corrupt, corrupt + sizeof(corrupt)), sink, path, ackbuf, negotiated, rootdir);
         assert(err);
-        assert(tftpd::g_segsize == SEGSIZE);
+        assert(negotiated.segsize == SEGSIZE);
         assert(path.empty());
         assert(ackbuf.empty());
-        assert(fp == nullptr);
+        assert(!sink);
 
         std::string test1 = {"\0\2testfile.dat\0octet\0"s
                              "blksize\0"s
@@ -42,39 +45,44 @@ int main()
                              "12345678910\0"s};
         std::vector<char> msg(test1.begin(), test1.end());
         // TODO(CK): why? msg.resize(PKTSIZE);
-        err = tftpd::tftp(msg, fp, path, ackbuf);
-        std::cout << path << " segsize:" << tftpd::g_segsize << " tsize:" << tftpd::g_tsize
-                  << " timeout: " << tftpd::g_timeout << std::endl;
+        err = tftpd::tftp(msg, sink, path, ackbuf, negotiated, rootdir);
+        std::cout << path << " segsize:" << negotiated.segsize << " tsize:" << negotiated.tsize
+                  << " timeout: " << negotiated.timeout << std::endl;
         assert(!err);
         assert(!ackbuf.empty());
-        assert(tftpd::g_segsize == 1047);
-        assert(tftpd::g_tsize == 12345678910);
-        assert(tftpd::g_timeout == 33); // NOTE: ms
+        assert(negotiated.segsize == 1047);
+        assert(negotiated.tsize == 12345678910);
+        assert(negotiated.timeout == 33); // NOTE: ms
+        assert(negotiated.rollover == 1);
 
         std::string test2 = {"\0\2testfile.dat\0octet\0"s
                              "timeout\0"s
                              "2\0"s
+                             "rollover\0"s
+                             "65535\0"s
                              "blksize2\0"s
                              "65464\0"s};
-        err = tftpd::tftp(std::vector<char>(test2.begin(), test2.end()), fp, path, ackbuf);
-        std::cout << path << " segsize:" << tftpd::g_segsize << " tsize:" << tftpd::g_tsize
-                  << " timeout: " << tftpd::g_timeout << std::endl;
+        err = tftpd::tftp(std::vector<char>(test2.begin(), test2.end()), sink, path, ackbuf, negotiated, rootdir);
+        std::cout << path << " segsize:" << negotiated.segsize << " tsize:" << negotiated.tsize
+                  << " timeout: " << negotiated.timeout << std::endl;
         assert(!err);
-        assert(tftpd::g_segsize == (1 << 15));
-        assert(tftpd::g_tsize == 0);
-        assert(tftpd::g_timeout == 2000); // NOTE: ms
+        assert(negotiated.segsize == (1 << 15));
+        assert(negotiated.tsize == 0);
+        assert(negotiated.timeout == 2000); // NOTE: ms
+        assert(negotiated.rollover == 0);
+        assert(std::string(ackbuf.begin(), ackbuf.end()).find("rollover") == std::string::npos);
 
         std::string test3 = {"\0\2testfile.dat\0octet\0"s
                              "blksize2\0"s
                              "1234\0"s
                              "utimeout\0"s
                              "10000\0"s}; // us!
-        err = tftpd::tftp(std::vector<char>(test3.begin(), test3.end()), fp, path, ackbuf);
-        std::cout << path << " segsize:" << tftpd::g_segsize << " tsize:" << tftpd::g_tsize
-                  << " timeout: " << tftpd::g_timeout << std::endl;
+        err = tftpd::tftp(std::vector<char>(test3.begin(), test3.end()), sink, path, ackbuf, negotiated, rootdir);
+        std::cout << path << " segsize:" << negotiated.segsize << " tsize:" << negotiated.tsize
+                  << " timeout: " << negotiated.timeout << std::endl;
         assert(!err);
-        assert(tftpd::g_segsize == 1024);
-        assert(tftpd::g_timeout == 10); // NOTE: ms
+        assert(negotiated.segsize == 1024);
+        assert(negotiated.timeout == 10); // NOTE: ms
 
         std::string test4 = {"\0\2minimal.dat\0octet\0"s
                              "blksize\0"s
@@ -89,27 +97,28 @@ int main()
                              "NoNumber\0"s
                              "utimeout\0"s
                              "999\0"s}; // us!
-        err = tftpd::tftp(std::vector<char>(test4.begin(), test4.end()), fp, path, ackbuf);
-        std::cout << path << " segsize:" << tftpd::g_segsize << " tsize:" << tftpd::g_tsize
-                  << " timeout: " << tftpd::g_timeout << std::endl;
+        err = tftpd::tftp(std::vector<char>(test4.begin(), test4.end()), sink, path, ackbuf, negotiated, rootdir);
+        std::cout << path << " segsize:" << negotiated.segsize << " tsize:" << negotiated.tsize
+                  << " timeout: " << negotiated.timeout << std::endl;
         assert(!err);
         assert(!ackbuf.empty());
-        assert(tftpd::g_segsize == MAXSEGSIZE);
-        assert(tftpd::g_timeout == 1000); // NOTE: ms
+        assert(negotiated.segsize == MAXSEGSIZE);
+        assert(negotiated.timeout == 1000); // NOTE: ms
 
         const char unknown[] = {"\0\1unknown_mode.dat\0netascii\0"};
-        err = tftpd::tftp(std::vector<char>(unknown, unknown + sizeof(unknown)), fp, path, ackbuf);
+        err = tftpd::tftp(std::vector<char>(unknown, unknown + sizeof(unknown)), sink, path, ackbuf, negotiated, rootdir);
         assert(err);
-        assert(tftpd::g_segsize == SEGSIZE);
+        assert(negotiated.segsize == SEGSIZE);
         assert(!path.empty());
         assert(ackbuf.empty());
 
         const char missing[] = {"\0\1missing_mode.dat\0"};
-        err = tftpd::tftp(std::vector<char>(missing, missing + sizeof(missing)), fp, path, ackbuf);
+        err = tftpd::tftp(std::vector<char>(missing, missing + sizeof(missing)), sink, path, ackbuf, negotiated, rootdir);
         assert(ackbuf.empty());
         assert(err);
 
-        // err = tftpd::tftp(std::vector<char>(missing, missing + sizeof(missing) - 3), fp, path, ackbuf);
+        // err = tftpd::tftp(std::vector<char>(missing, missing + sizeof(missing) - 3), sink, path, ackbuf, negotiated,
+        //                   rootdir);
         // assert(ackbuf.empty());
         // assert(err);
 
@@ -0,0 +1,68 @@
+#include "packet_pool.hpp"
+
+#include <cassert>
+#include <utility>
+
+namespace tftpd {
+
+void packet_buffer::resize(size_t size)
+{
+    assert(size <= capacity_);
+    size_ = size;
+}
+
+void packet_buffer::reset()
+{
+    if (data_ != nullptr) {
+        pool_->put(data_, size_class_);
+    }
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = capacity_ = 0;
+}
+
+void packet_buffer::swap(packet_buffer &other) noexcept
+{
+    std::swap(pool_, other.pool_);
+    std::swap(data_, other.data_);
+    std::swap(size_class_, other.size_class_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+}
+
+packet_pool::~packet_pool()
+{
+    for (auto &list : free_) {
+        char *data = nullptr;
+        while (list.pop(data)) {
+            delete[] data;
+        }
+    }
+}
+
+packet_buffer packet_pool::get(size_t payload)
+{
+    size_t size_class = 0;
+    while (size_class < classes.size() && classes[size_class] < payload) {
+        size_class++;
+    }
+    size_t const capacity = TFTP_HEADER + ((size_class < classes.size()) ? classes[size_class] : payload);
+
+    char *data = nullptr;
+    if (size_class < classes.size() && free_[size_class].pop(data)) {
+        reused_++;
+    } else {
+        data = new char[capacity];
+        allocated_++;
+    }
+    return {this, data, size_class, capacity};
+}
+
+void packet_pool::put(char *data, size_t size_class)
+{
+    if (size_class >= classes.size() || !free_[size_class].bounded_push(data)) {
+        delete[] data; // NOTE: not pooled or the free list is full
+    }
+}
+
+} // namespace tftpd
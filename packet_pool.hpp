@@ -0,0 +1,101 @@
+#pragma once
+
+/*
+ * Packet buffers recycled by size class.
+ *
+ * A buffer has room for a TFTP header and the payload of the smallest size
+ * class fitting the blksize asked for: 512 (RFC1350), 1428 (an Ethernet
+ * MTU), 8 KiB or the largest blksize of RFC2348.  Released buffers go to a
+ * lock free free list of their class, up to cached ones each, so many short
+ * transfers don't churn the heap.  Larger requests are not pooled.
+ */
+#include "tftp/tftpsubs.h"
+
+#include <boost/lockfree/stack.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace tftpd {
+
+class packet_pool;
+
+/// a move only buffer of a packet_pool
+class packet_buffer
+{
+public:
+    packet_buffer() = default;
+    ~packet_buffer() { reset(); }
+
+    packet_buffer(packet_buffer &&other) noexcept { swap(other); }
+    packet_buffer &operator=(packet_buffer &&other) noexcept
+    {
+        reset();
+        swap(other);
+        return *this;
+    }
+
+    packet_buffer(const packet_buffer &) = delete;
+    packet_buffer &operator=(const packet_buffer &) = delete;
+
+    char *data() { return data_; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+    /// @note within the capacity only
+    void resize(size_t size);
+
+    /// back to the pool
+    void reset();
+
+private:
+    friend class packet_pool;
+
+    packet_buffer(packet_pool *pool, char *data, size_t size_class, size_t capacity)
+        : pool_(pool), data_(data), size_class_(size_class), capacity_(capacity)
+    {}
+
+    void swap(packet_buffer &other) noexcept;
+
+    packet_pool *pool_{nullptr};
+    char *data_{nullptr};
+    size_t size_class_{0};
+    size_t size_{0};
+    size_t capacity_{0};
+};
+
+class packet_pool
+{
+public:
+    /// the payload sizes
+    static constexpr std::array<size_t, 4> classes{SEGSIZE, 1428, 8192, MAXSEGSIZE};
+    static constexpr size_t cached{64}; ///< free buffers kept per class
+
+    packet_pool() = default;
+    ~packet_pool();
+
+    packet_pool(const packet_pool &) = delete;
+    packet_pool &operator=(const packet_pool &) = delete;
+
+    /// a buffer with room for a header and the payload, of size 0
+    packet_buffer get(size_t payload);
+
+    uint64_t allocated() const { return allocated_; } ///< from the heap
+    uint64_t reused() const { return reused_; }       ///< from a free list
+
+private:
+    friend class packet_buffer;
+
+    void put(char *data, size_t size_class);
+
+    using free_list = boost::lockfree::stack<char *, boost::lockfree::capacity<cached>>;
+
+    std::array<free_list, classes.size()> free_;
+    std::atomic<uint64_t> allocated_{0};
+    std::atomic<uint64_t> reused_{0};
+};
+
+} // namespace tftpd
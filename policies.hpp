@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * The compile time policies of tftpd::basic_receiver.
+ *
+ * Storage   takes the sink of the upload opened by tftp() and writes the
+ *           blocks to it, see storage.hpp:
+ *             void open(std::unique_ptr<storage_sink> sink)
+ *             int write(const char *data, size_t length)
+ *                                                0, would_block or the TFTP error code
+ *             bool ready(bool drained, const std::function<void()> &resume)
+ *                                                false to resume later, on any thread
+ *             int commit()                       after the last block
+ *             void sidecar(const checksum &)     the digest after commit
+ *             size_t memory(const storage_sink *sink) const
+ *                                                buffer memory besides the session, of a file if nullptr
+ * Progress  is told the size of the transfer, 0 if unknown, and the
+ *           payload bytes transferred after each block:
+ *             void start(uint64_t size)
+ *             void update(uint64_t bytes)
+ * Logger    gets the syslog(3) messages of the session:
+ *             static void log(int priority, const char *format, ...)
+ *
+ * A policy which does nothing is inlined away, i.e. the null_logger
+ * leaves no call per block behind.
+ */
+#include "storage.hpp"
+#include "tftp/tftpsubs.h"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <syslog.h>
+#include <utility>
+
+namespace tftpd {
+extern std::function<void(size_t)> g_callback;
+
+/// the storage_sink selected for the upload, see set_storage()
+class sink_storage
+{
+public:
+    void open(std::unique_ptr<storage_sink> sink) { sink_ = std::move(sink); }
+    int write(const char *data, size_t length) { return sink_->write(data, length); }
+    bool ready(bool drained, const std::function<void()> &resume) { return sink_->ready(drained, resume); }
+    int commit() { return sink_->commit(); }
+    void sidecar(const checksum &digest) { sink_->sidecar(digest); }
+
+    /// what the sink may buffer, the stdio buffer of a file
+    static size_t memory(const storage_sink *sink) { return sink != nullptr ? sink->memory() : BUFSIZ; }
+
+private:
+    std::unique_ptr<storage_sink> sink_;
+};
+
+/// g_callback every 10% of the transfer size, if the client sent a tsize
+class callback_progress
+{
+public:
+    void start(uint64_t size) { size_ = size; }
+
+    void update(uint64_t bytes)
+    {
+        if (size_ == 0) { // NOTE: prevent division by zero! CK
+            return;
+        }
+        auto const percent = static_cast<size_t>(100U * bytes / size_);
+        if (percent != percent_) {
+            syslog(LOG_NOTICE, "tftpd: Progress: %lu%% received\n", percent);
+            percent_ = percent;
+            if (g_callback != nullptr && (percent % 10) == 0) {
+                g_callback(percent);
+            }
+        }
+    }
+
+private:
+    uint64_t size_{0};
+    size_t percent_{0};
+};
+
+struct null_progress
+{
+    void start(uint64_t /*size*/) {}
+    void update(uint64_t /*bytes*/) {}
+};
+
+struct syslog_logger
+{
+    __attribute__((format(printf, 2, 3))) static void log(int priority, const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        vsyslog(priority, format, args);
+        va_end(args);
+    }
+};
+
+struct null_logger
+{
+    template <typename... Args> static void log(int /*priority*/, const char * /*format*/, Args &&.../*args*/) {}
+};
+
+} // namespace tftpd
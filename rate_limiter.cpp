@@ -0,0 +1,98 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+namespace tftpd {
+
+// NOTE: std::hash<address> is not provided by all boost versions used
+size_t rate_limiter::address_hash::operator()(const boost::asio::ip::address &a) const
+{
+    if (a.is_v4()) {
+        return std::hash<uint32_t>{}(a.to_v4().to_uint());
+    }
+    auto const bytes = a.to_v6().to_bytes();
+    return std::hash<std::string_view>{}(
+        std::string_view(reinterpret_cast<const char *>(bytes.data()), bytes.size()));
+}
+
+void rate_limiter::configure(const rate_limit &limit)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    limit_ = limit;
+    limit_.burst = std::max(limit_.burst, 1.0);
+    buckets_.clear();
+    next_expire_ = {};
+}
+
+double rate_limiter::refill(bucket &b, clock_type::time_point now) const
+{
+    if (now > b.last) {
+        std::chrono::duration<double> const elapsed = now - b.last;
+        b.tokens = std::min(limit_.burst, b.tokens + elapsed.count() * limit_.rate);
+    }
+    b.last = now;
+    return b.tokens;
+}
+
+void rate_limiter::expire(clock_type::time_point now)
+{
+    if (now < next_expire_) {
+        return;
+    }
+    std::chrono::duration<double> const interval(1 / limit_.rate);
+    next_expire_ = now + std::chrono::duration_cast<clock_type::duration>(interval);
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+        if (refill(it->second, now) >= limit_.burst) {
+            it = buckets_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool rate_limiter::admit(const boost::asio::ip::address &source, clock_type::time_point now)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    if (limit_.rate <= 0) {
+        counters_.admitted++;
+        return true;
+    }
+
+    auto it = buckets_.find(source);
+    if (it == buckets_.end()) {
+        if (buckets_.size() >= limit_.max_sources) {
+            expire(now);
+        }
+        if (buckets_.size() >= limit_.max_sources) {
+            counters_.dropped++; // NOTE: rather than to track more sources of a storm
+            return false;
+        }
+        it = buckets_.emplace(source, bucket{limit_.burst, now}).first;
+    }
+
+    if (refill(it->second, now) < 1) {
+        counters_.dropped++;
+        return false;
+    }
+    it->second.tokens -= 1;
+    counters_.admitted++;
+    return true;
+}
+
+rate_limit rate_limiter::limit() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return limit_;
+}
+
+request_counters rate_limiter::counters() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    request_counters c = counters_;
+    c.sources = buckets_.size();
+    return c;
+}
+
+} // namespace tftpd
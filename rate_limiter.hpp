@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * Per source address request rate limiting.
+ *
+ * Every source address gets a token bucket of rate_limit::burst tokens,
+ * refilled with rate_limit::rate tokens per second.  A request takes one
+ * token, without a token left it is dropped before it is parsed, so a
+ * request storm costs a hash lookup per datagram and neither a syslog
+ * line nor a filesystem access.  Once max_sources are tracked, the
+ * sources with a full bucket again are forgotten by a sweep at most once
+ * per token refilled, a storm of new sources is dropped in between.  The
+ * limiter is shared by all sessions of the process, so it is guarded by a
+ * mutex.
+ */
+#include "async_tftpd_server.hpp"
+#include "transport.hpp"
+
+#include <boost/asio/ip/address.hpp>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace tftpd {
+
+class rate_limiter
+{
+public:
+    using clock_type = session_timer::clock_type;
+
+    explicit rate_limiter(const rate_limit &limit = {}) { configure(limit); }
+
+    /// set a new limit and forget all sources
+    void configure(const rate_limit &limit);
+
+    /// take a token of the source's bucket, false if the request is to be dropped
+    bool admit(const boost::asio::ip::address &source, clock_type::time_point now);
+
+    rate_limit limit() const;
+    request_counters counters() const;
+
+private:
+    struct bucket
+    {
+        double tokens;
+        clock_type::time_point last; // of the refill
+    };
+
+    struct address_hash
+    {
+        size_t operator()(const boost::asio::ip::address &a) const;
+    };
+
+    /// forget the sources with a full bucket again, at most once per token refilled
+    void expire(clock_type::time_point now);
+
+    double refill(bucket &b, clock_type::time_point now) const;
+
+    mutable std::mutex mutex_;
+    rate_limit limit_;
+    request_counters counters_;
+    std::unordered_map<boost::asio::ip::address, bucket, address_hash> buckets_;
+    clock_type::time_point next_expire_{}; // NOTE: the sweep is O(max_sources)
+};
+
+} // namespace tftpd
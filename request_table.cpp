@@ -0,0 +1,42 @@
+#include "request_table.hpp"
+
+#include <utility>
+
+namespace tftpd {
+
+bool request_table::claim(const endpoint &peer, const std::vector<char> &request, std::function<void()> answer_again)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    auto const inserted =
+        requests_.emplace(key(peer, std::string(request.begin(), request.end())), std::move(answer_again));
+    if (inserted.second) {
+        return true;
+    }
+
+    suppressed_++;
+    // NOTE: under the lock, so the owner can't release it meanwhile
+    if (inserted.first->second) {
+        inserted.first->second();
+    }
+    return false;
+}
+
+void request_table::release(const endpoint &peer, const std::vector<char> &request)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    (void)requests_.erase(key(peer, std::string(request.begin(), request.end())));
+}
+
+size_t request_table::size() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return requests_.size();
+}
+
+uint64_t request_table::suppressed() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return suppressed_;
+}
+
+} // namespace tftpd
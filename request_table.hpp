@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * The requests in flight, of all server sessions in the process.
+ *
+ * A client which does not see the OACK or ACK 0 in time sends its request
+ * again.  If it arrives while the session it started is still running, a
+ * listener would start a second session for the same file racing on the
+ * same ".upload" file.  So a request is claimed by the peer endpoint and its
+ * bytes before it is parsed, a retransmitted one is passed to the session
+ * owning it to answer again instead.  The claim is released when the
+ * session ends.
+ */
+#include <boost/asio/ip/udp.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tftpd {
+
+class request_table
+{
+public:
+    using endpoint = boost::asio::ip::udp::endpoint;
+
+    /// claim a request for a new session, false if it is in flight already;
+    /// then the answer_again function of its owner is called instead
+    bool claim(const endpoint &peer, const std::vector<char> &request, std::function<void()> answer_again);
+
+    void release(const endpoint &peer, const std::vector<char> &request);
+
+    size_t size() const;
+
+    /// the retransmitted requests seen
+    uint64_t suppressed() const;
+
+private:
+    using key = std::pair<endpoint, std::string>;
+
+    mutable std::mutex mutex_;
+    std::map<key, std::function<void()>> requests_;
+    uint64_t suppressed_{0};
+};
+
+} // namespace tftpd
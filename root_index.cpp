@@ -0,0 +1,365 @@
+#include "root_index.hpp"
+
+#if defined(__linux__)
+#    include <sys/eventfd.h>
+#    include <sys/inotify.h>
+#endif
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <syslog.h>
+#include <utility>
+#include <vector>
+
+namespace tftpd {
+
+namespace {
+
+#if defined(__linux__)
+// NOTE: IN_MODIFY only marks a file dirty, it is indexed again on IN_CLOSE_WRITE
+constexpr uint32_t watch_mask{IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_ONLYDIR};
+#endif
+
+std::string join(const std::string &directory, const char *name)
+{
+    return directory.empty() ? std::string(name) : directory + "/" + name;
+}
+
+/// the relative path is the directory or below it
+bool below(const std::string &relative, const std::string &directory)
+{
+    return directory.empty() || relative == directory ||
+           (relative.size() > directory.size() && relative.compare(0, directory.size(), directory) == 0 &&
+            relative[directory.size()] == '/');
+}
+
+} // namespace
+
+bool root_index::start(const std::string &root)
+{
+    stop();
+#if defined(__linux__)
+    root_ = root;
+    while (root_.size() > 1 && root_.back() == '/') {
+        root_.pop_back();
+    }
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wakeup_ = eventfd(0, EFD_CLOEXEC);
+    if (inotify_ < 0 || wakeup_ < 0) {
+        syslog(LOG_ERR, "tftpd: inotify_init1() failed! %s\n", strerror(errno));
+        stop();
+        return false;
+    }
+
+    scan("");
+    if (watches_.empty()) {
+        syslog(LOG_ERR, "tftpd: can't watch %s\n", root_.c_str());
+        stop();
+        return false;
+    }
+    worker_ = std::thread([this] { run(); });
+    running_ = true;
+    return true;
+#else
+    (void)root;
+    return false;
+#endif
+}
+
+void root_index::stop()
+{
+    running_ = false;
+    if (worker_.joinable()) {
+        uint64_t const one = 1;
+        (void)write(wakeup_, &one, sizeof(one));
+        worker_.join();
+    }
+    if (inotify_ >= 0) {
+        (void)close(inotify_); // NOTE: removes the watches
+        inotify_ = -1;
+    }
+    if (wakeup_ >= 0) {
+        (void)close(wakeup_);
+        wakeup_ = -1;
+    }
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    entries_.clear();
+    watches_.clear();
+    directories_ = 0;
+}
+
+root_index::lookup_result root_index::lookup(const std::string &path, struct stat &st)
+{
+    std::string relative;
+    if (!relative_path(path, relative)) {
+        misses_++;
+        return lookup_result::unknown;
+    }
+
+    std::shared_lock<std::shared_mutex> const lock(mutex_);
+    auto it = entries_.find(relative);
+    if (it != entries_.end()) {
+        if (it->second.dirty) {
+            misses_++;
+            return lookup_result::unknown;
+        }
+        st = it->second.st;
+        hits_++;
+        return lookup_result::found;
+    }
+
+    // NOTE: absent if its directory is indexed, as all below the root are
+    auto const slash = relative.rfind('/');
+    auto parent = entries_.find((slash == std::string::npos) ? std::string() : relative.substr(0, slash));
+    if (parent != entries_.end() && !parent->second.dirty && S_ISDIR(parent->second.st.st_mode)) {
+        hits_++;
+        return lookup_result::absent;
+    }
+    misses_++;
+    return lookup_result::unknown;
+}
+
+void root_index::refresh(const std::string &path)
+{
+    std::string relative;
+    if (!relative_path(path, relative)) {
+        return;
+    }
+    update(relative);
+    if (changed_ != nullptr) {
+        changed_(path);
+    }
+}
+
+bool root_index::relative_path(const std::string &path, std::string &relative) const
+{
+    if (!running_ || path.size() <= root_.size() || path.compare(0, root_.size(), root_) != 0 ||
+        path[root_.size()] != '/') {
+        return false;
+    }
+
+    relative.clear();
+    size_t begin = root_.size() + 1;
+    while (begin <= path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        std::string const part = path.substr(begin, end - begin);
+        if (part == "..") {
+            return false;
+        }
+        if (!part.empty() && part != ".") {
+            relative = relative.empty() ? part : relative + "/" + part;
+        }
+        begin = end + 1;
+    }
+    return !relative.empty();
+}
+
+void root_index::run()
+{
+#if defined(__linux__)
+    // NOTE: aligned for the events in it
+    alignas(struct inotify_event) char buffer[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    std::array<struct pollfd, 2> fds{{{inotify_, POLLIN, 0}, {wakeup_, POLLIN, 0}}};
+    for (;;) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_ERR, "tftpd: poll() failed! %s\n", strerror(errno));
+            return;
+        }
+        if ((fds[1].revents & POLLIN) != 0) {
+            return; // NOTE: stop()
+        }
+
+        ssize_t length = 0;
+        while ((length = read(inotify_, buffer, sizeof(buffer))) > 0) {
+            for (const char *p = buffer; p < buffer + length;) {
+                const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+                apply(*event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+}
+
+void root_index::apply(const struct inotify_event &event)
+{
+#if defined(__linux__)
+    events_++;
+    if ((event.mask & IN_Q_OVERFLOW) != 0) {
+        syslog(LOG_WARNING, "tftpd: inotify queue overflow, scan %s again\n", root_.c_str());
+        rescans_++;
+        for (auto const &watch : watches_) {
+            (void)inotify_rm_watch(inotify_, watch.first);
+        }
+        {
+            std::unique_lock<std::shared_mutex> const lock(mutex_);
+            entries_.clear();
+            watches_.clear();
+            directories_ = 0;
+        }
+        scan("");
+        return;
+    }
+
+    auto watch = watches_.find(event.wd);
+    if (watch == watches_.end()) {
+        return;
+    }
+    if ((event.mask & IN_IGNORED) != 0) {
+        watches_.erase(watch);
+        directories_--;
+        return;
+    }
+    if (event.len == 0) {
+        return; // NOTE: of the directory itself, its parent tells
+    }
+
+    std::string const relative = join(watch->second, static_cast<const char *>(event.name));
+    if ((event.mask & IN_MODIFY) != 0) {
+        std::unique_lock<std::shared_mutex> const lock(mutex_);
+        auto it = entries_.find(relative);
+        if (it != entries_.end()) {
+            it->second.dirty = true;
+        }
+        return;
+    }
+
+    if ((event.mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+        if ((event.mask & IN_MOVED_FROM) != 0 && (event.mask & IN_ISDIR) != 0) {
+            // NOTE: the watches moved with the directory, they are set again at its new path
+            for (auto it = watches_.begin(); it != watches_.end();) {
+                if (below(it->second, relative)) {
+                    (void)inotify_rm_watch(inotify_, it->first);
+                    it = watches_.erase(it);
+                    directories_--;
+                } else {
+                    ++it;
+                }
+            }
+        }
+        erase(relative);
+    } else if ((event.mask & IN_ISDIR) != 0 && (event.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        scan(relative);
+    } else {
+        update(relative);
+    }
+
+    if (changed_ != nullptr) {
+        changed_(root_ + "/" + relative);
+    }
+#else
+    (void)event;
+#endif
+}
+
+void root_index::scan(const std::string &relative)
+{
+#if defined(__linux__)
+    std::string const path = relative.empty() ? root_ : root_ + "/" + relative;
+
+    // NOTE: watched before it is read, a file created meanwhile is not missed
+    int const wd = inotify_add_watch(inotify_, path.c_str(), watch_mask);
+    if (wd < 0) {
+        syslog(LOG_WARNING, "tftpd: inotify_add_watch(%s) failed! %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    if (watches_.emplace(wd, relative).second) {
+        directories_++;
+    } else {
+        watches_[wd] = relative; // NOTE: the same directory by another path
+    }
+    update(relative);
+
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    std::vector<std::pair<std::string, bool>> children;
+    while (const struct dirent *child = readdir(dir)) {
+        if (strcmp(child->d_name, ".") == 0 || strcmp(child->d_name, "..") == 0) {
+            continue;
+        }
+        std::string name = join(relative, static_cast<const char *>(child->d_name));
+        bool directory = child->d_type == DT_DIR;
+        if (child->d_type == DT_UNKNOWN) {
+            struct stat st = {};
+            directory = lstat((root_ + "/" + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        children.emplace_back(std::move(name), directory);
+    }
+    (void)closedir(dir);
+
+    for (auto const &child : children) {
+        if (child.second) {
+            scan(child.first);
+        } else {
+            update(child.first);
+        }
+    }
+#else
+    (void)relative;
+#endif
+}
+
+void root_index::update(const std::string &relative)
+{
+    std::string const path = relative.empty() ? root_ : root_ + "/" + relative;
+    entry e{};
+    // NOTE: the root may be a symlink, a symlink below it is not followed
+    if ((relative.empty() ? stat(path.c_str(), &e.st) : lstat(path.c_str(), &e.st)) < 0) {
+        erase(relative);
+        return;
+    }
+    e.dirty = S_ISLNK(e.st.st_mode);
+
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    entries_[relative] = e;
+}
+
+void root_index::erase(const std::string &relative)
+{
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    auto found = entries_.find(relative);
+    if (found == entries_.end() || relative.empty()) {
+        return;
+    }
+    bool const directory = S_ISDIR(found->second.st.st_mode);
+    entries_.erase(found);
+    if (!directory) {
+        return;
+    }
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (below(it->first, relative)) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+root_index_counters root_index::counters() const
+{
+    root_index_counters counters;
+    counters.hits = hits_;
+    counters.misses = misses_;
+    counters.events = events_;
+    counters.rescans = rescans_;
+    counters.directories = directories_;
+    std::shared_lock<std::shared_mutex> const lock(mutex_);
+    counters.files = entries_.size();
+    return counters;
+}
+
+} // namespace tftpd
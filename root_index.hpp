@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * The metadata of the files below the tftp root, in memory.
+ *
+ * Every request checks its file with stat(2), a download needs its size
+ * for the tsize answer too; on a slow or network backed root these calls
+ * dominate the request handling.  The root_index scans the root once and
+ * keeps the stat of each file and directory current with inotify(7), so a
+ * lookup is a hash lookup under a shared lock.  A file not in an indexed
+ * directory is known to be absent, i.e. the many config files a PXE client
+ * probes for cost no system call either.
+ *
+ * The events are applied on a worker thread.  A file being written (only
+ * IN_MODIFY seen so far), a symlink, whose target may be outside the root,
+ * and any path not below the root are looked up with stat(2) again.  After
+ * the event queue overflowed the root is scanned again.  Linux only, on
+ * other systems start() fails and every lookup is unknown.
+ */
+#include "async_tftpd_server.hpp"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+struct inotify_event;
+
+namespace tftpd {
+
+class root_index
+{
+public:
+    enum class lookup_result
+    {
+        found,   ///< the stat is set
+        absent,  ///< no such file
+        unknown, ///< not indexed, stat(2) it
+    };
+
+    root_index() = default;
+    ~root_index() { stop(); }
+
+    root_index(const root_index &) = delete;
+    root_index &operator=(const root_index &) = delete;
+
+    /// scan the root and watch it, false if it can't be watched
+    bool start(const std::string &root);
+
+    /// forget the root
+    void stop();
+
+    bool running() const { return running_; }
+
+    /// the stat of the file at the path, as stat(2) follows symlinks
+    lookup_result lookup(const std::string &path, struct stat &st);
+
+    /// index the file at the path at once, i.e. an upload committed, its
+    /// events are applied by the worker later
+    void refresh(const std::string &path);
+
+    /// called on the worker, or by refresh(), with the path of a file
+    /// changed, created or removed; set before start()
+    void on_change(std::function<void(const std::string &path)> handler) { changed_ = std::move(handler); }
+
+    root_index_counters counters() const;
+
+private:
+    struct entry
+    {
+        struct stat st;
+        bool dirty; // NOTE: being written or a symlink, stat(2) it
+    };
+
+    void run();
+
+    /// watch the directory and index it with all below
+    void scan(const std::string &relative);
+
+    /// index the file again, it is removed if it is gone
+    void update(const std::string &relative);
+
+    /// remove the file, with all below if it was a directory
+    void erase(const std::string &relative);
+
+    void apply(const struct inotify_event &event);
+
+    /// the path relative to the root without "." and empty parts, false if
+    /// it is not below the root
+    bool relative_path(const std::string &path, std::string &relative) const;
+
+    std::string root_;
+    int inotify_{-1};
+    int wakeup_{-1};
+    std::thread worker_;
+    std::atomic<bool> running_{false};
+    std::function<void(const std::string &)> changed_;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, entry> entries_; // by the relative path, "" is the root
+    std::unordered_map<int, std::string> watches_;   // NOTE: of the worker, relative path by watch descriptor
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> rescans_{0};
+    std::atomic<uint64_t> directories_{0};
+};
+
+extern root_index g_index; // of the rootdir, if set_root_index()
+
+} // namespace tftpd
@@ -0,0 +1,156 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the metadata of the tftp root in memory, kept current by inotify! CK
+
+#include "root_index.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+const std::string root{"/tmp/root_index_test"};
+
+using lookup_result = tftpd::root_index::lookup_result;
+
+void write_file(const std::string &name, size_t size)
+{
+    std::ofstream(root + "/" + name, std::ios::binary) << std::string(size, 'x');
+}
+
+/// the events are applied on the worker, wait for the index to see it
+lookup_result wait_for(tftpd::root_index &index, const std::string &name, lookup_result expected, struct stat &st)
+{
+    lookup_result result = lookup_result::unknown;
+    for (int i = 0; i < 500; ++i) {
+        result = index.lookup(root + "/" + name, st);
+        if (result == expected) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return result;
+}
+
+/// the index has the stat(2) of the file
+bool same_stat(tftpd::root_index &index, const std::string &name)
+{
+    struct stat indexed = {};
+    struct stat st = {};
+    assert(stat((root + "/" + name).c_str(), &st) == 0);
+    for (int i = 0; i < 500; ++i) {
+        if (index.lookup(root + "/" + name, indexed) == lookup_result::found && indexed.st_ino == st.st_ino &&
+            indexed.st_size == st.st_size && indexed.st_mode == st.st_mode &&
+            indexed.st_mtim.tv_nsec == st.st_mtim.tv_nsec && indexed.st_mtim.tv_sec == st.st_mtim.tv_sec) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+} // namespace
+
+int main()
+{
+    try {
+        boost::filesystem::remove_all(root);
+        assert(mkdir(root.c_str(), 0777) == 0);
+        assert(mkdir((root + "/pxelinux.cfg").c_str(), 0777) == 0);
+        write_file("pxelinux.0", 1000);
+        write_file("pxelinux.cfg/default", 100);
+
+        tftpd::root_index index;
+        struct stat st = {};
+        assert(index.lookup(root + "/pxelinux.0", st) == lookup_result::unknown);
+        assert(!index.start("/tmp/root_index_test_missing"));
+        assert(index.start(root + "/"));
+
+        // scanned at start, a file not there is absent without a stat()
+        assert(same_stat(index, "pxelinux.0"));
+        assert(same_stat(index, "pxelinux.cfg/default"));
+        assert(same_stat(index, "/./pxelinux.cfg//default"));
+        assert(index.lookup(root + "/pxelinux.cfg/01-00-11-22-33-44-55", st) == lookup_result::absent);
+        assert(index.lookup(root + "/missing/file", st) == lookup_result::unknown);
+        assert(index.lookup(root + "/pxelinux.cfg/../pxelinux.0", st) == lookup_result::unknown);
+        assert(index.lookup("/tmp/other/pxelinux.0", st) == lookup_result::unknown);
+        auto counters = index.counters();
+        assert(counters.files == 4 && counters.directories == 2);
+
+        // created, written, renamed and removed
+        write_file("kernel", 5000);
+        assert(same_stat(index, "kernel"));
+        write_file("kernel", 7000);
+        assert(same_stat(index, "kernel"));
+        assert(chmod((root + "/kernel").c_str(), 0600) == 0);
+        assert(same_stat(index, "kernel"));
+        assert(rename((root + "/kernel").c_str(), (root + "/vmlinuz").c_str()) == 0);
+        assert(wait_for(index, "kernel", lookup_result::absent, st) == lookup_result::absent);
+        assert(same_stat(index, "vmlinuz"));
+        assert(unlink((root + "/vmlinuz").c_str()) == 0);
+        assert(wait_for(index, "vmlinuz", lookup_result::absent, st) == lookup_result::absent);
+
+        // an upload is indexed by its writer at once, a download may follow before the event
+        write_file("upload.tmp", 2000);
+        assert(rename((root + "/upload.tmp").c_str(), (root + "/uploaded").c_str()) == 0);
+        index.refresh(root + "/uploaded");
+        assert(index.lookup(root + "/uploaded", st) == lookup_result::found && st.st_size == 2000);
+        assert(same_stat(index, "uploaded"));
+
+        // a file being written is looked up with stat() until it is closed
+        {
+            std::ofstream os(root + "/initrd", std::ios::binary);
+            os << std::string(1000, 'i') << std::flush;
+            assert(wait_for(index, "initrd", lookup_result::unknown, st) == lookup_result::unknown);
+        }
+        assert(same_stat(index, "initrd"));
+
+        // directories created and moved with their files
+        assert(mkdir((root + "/images").c_str(), 0777) == 0);
+        write_file("images/disk.img", 300);
+        assert(same_stat(index, "images/disk.img"));
+        assert(rename((root + "/images").c_str(), (root + "/old").c_str()) == 0);
+        assert(wait_for(index, "images", lookup_result::absent, st) == lookup_result::absent);
+        assert(same_stat(index, "old/disk.img"));
+        write_file("old/new.img", 10);
+        assert(same_stat(index, "old/new.img"));
+        boost::filesystem::remove_all(root + "/old");
+        assert(wait_for(index, "old", lookup_result::absent, st) == lookup_result::absent);
+        assert(index.lookup(root + "/old/disk.img", st) == lookup_result::unknown);
+
+        // a symlink may point outside of the root
+        assert(symlink("/etc/hostname", (root + "/link").c_str()) == 0);
+        assert(wait_for(index, "link", lookup_result::unknown, st) == lookup_result::unknown);
+
+        counters = index.counters();
+        std::cout << "hits " << counters.hits << " misses " << counters.misses << " events " << counters.events
+                  << " files " << counters.files << " directories " << counters.directories << std::endl;
+        assert(counters.hits > 0 && counters.events > 0 && counters.rescans == 0);
+        assert(counters.directories == 2);
+
+        index.stop();
+        assert(index.lookup(root + "/pxelinux.0", st) == lookup_result::unknown);
+        assert(index.counters().files == 0);
+
+        boost::filesystem::remove_all(root);
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,646 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+#include "simulation.hpp"
+#include "tftpd.hpp"
+
+#include <arpa/inet.h>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const char *const rootdir{"/tmp/tftpboot-sim-test"};
+const tftpd::datagram_transport::endpoint server(boost::asio::ip::address_v4::loopback(), 69);
+constexpr std::chrono::microseconds latency{500};
+
+struct outcome
+{
+    bool success{false};
+    std::chrono::steady_clock::duration elapsed{}; // of the client, virtual
+    std::chrono::steady_clock::time_point end{};   // of the simulation, virtual
+    uint64_t retransmits{0};
+    tftpd::transfer_report report;
+};
+
+outcome upload(const std::string &name, size_t size, size_t blksize, const tftpd::impairment &profile,
+               int rollover = -1)
+{
+    outcome result;
+    tftpd::g_report = [&result](const tftpd::transfer_report &r) { result.report = r; };
+
+    tftpd::simulator sim;
+    tftpd::simulated_network network(sim, latency, profile);
+    tftpd::simulated_transport transport(network, server);
+    tftpd::simulated_timer timer(sim);
+    tftpd::receiver session(transport, timer);
+
+    tftpd::simulated_upload::options options;
+    options.blksize = blksize;
+    options.rollover = rollover;
+    options.rexmt = std::chrono::milliseconds(200); // NOTE: before the session times out
+    options.max_retries = 10;
+    tftpd::simulated_upload client(network, server, name, size, options);
+    client.start();
+    (void)sim.run();
+
+    result.success = client.success();
+    result.elapsed = client.elapsed();
+    result.end = sim.now();
+    result.retransmits = client.retransmits();
+
+    std::ifstream is(std::string(rootdir) + "/" + name, std::ios::binary);
+    std::vector<char> const received((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    if (result.success) {
+        assert(received.size() == size);
+        for (size_t i = 0; i < size; ++i) {
+            assert(received[i] == tftpd::simulated_upload::pattern(i));
+        }
+    }
+    return result;
+}
+
+/// a datagram with the opcode, the block or the request text and payload
+std::vector<char> packet(u_short opcode, u_short block, size_t size, size_t offset = 0)
+{
+    std::vector<char> pkt(TFTP_HEADER + size);
+    auto *tp = reinterpret_cast<struct tftphdr *>(pkt.data());
+    tp->th_opcode = htons(opcode);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    tp->th_block = htons(block);
+    for (size_t i = 0; i < size; ++i) {
+        pkt[TFTP_HEADER + i] = tftpd::simulated_upload::pattern(offset + i);
+    }
+    return pkt;
+}
+
+/// a progress policy of basic_receiver
+struct counting_progress
+{
+    void start(uint64_t /*size*/) {}
+    void update(uint64_t bytes)
+    {
+        calls++;
+        last = bytes;
+    }
+    static inline size_t calls{0};
+    static inline uint64_t last{0};
+};
+
+} // namespace
+
+int main()
+{
+    using std::chrono::milliseconds;
+    using std::chrono::seconds;
+
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_WARNING));
+    (void)mkdir(rootdir, 0777);
+    tftpd::g_rootdir = rootdir;
+    tftpd::set_rate_limit({0}); // NOTE: every simulation starts at the same virtual time
+
+    try {
+        // the idle timeout costs no wall clock time
+        {
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::simulated_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            tftpd::receiver session(transport, timer);
+            (void)sim.run();
+            assert(sim.now().time_since_epoch() == seconds(tftpd::maxtimeout));
+            assert(session.get_filename().empty());
+        }
+
+        // lossless: every DATA is answered after one round trip
+        auto r = upload("sim_test_100k.dat", 100000, 1428, {});
+        assert(r.success);
+        assert(r.retransmits == 0);
+        assert(r.report.status == tftpd::transfer_status::success);
+        assert(r.report.bytes == 100000);
+        assert(r.report.blocks == 100000 / 1428 + 1);
+        assert(r.report.rtt == 2 * latency);
+        assert(r.elapsed == (r.report.blocks + 1) * 2 * latency);
+
+        // a receiver with other policies: no logger, its own progress sink
+        {
+            using quiet_receiver = tftpd::basic_receiver<tftpd::sink_storage, counting_progress, tftpd::null_logger>;
+
+            tftpd::g_report = nullptr;
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::simulated_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            quiet_receiver session(transport, timer);
+            tftpd::simulated_upload client(network, server, "sim_test_quiet.dat", 10000, {});
+            client.start();
+            (void)sim.run();
+            assert(client.success());
+            assert(session.done() && !session.error());
+            assert(counting_progress::calls == 10000 / 512 + 1);
+            assert(counting_progress::last == 10000);
+        }
+
+        // uploads to the storage selected by the path: in memory or to a callback
+        {
+            tftpd::memory_sink::chunks chunks;
+            bool ended = true;
+            size_t accepted = 0;
+            tftpd::set_storage([&](const std::string &path) -> std::unique_ptr<tftpd::storage_sink> {
+                if (path == std::string(rootdir) + "/sim_test_memory.cfg") {
+                    return std::make_unique<tftpd::memory_sink>(
+                        [&chunks](tftpd::memory_sink::chunks data) { chunks = std::move(data); }, 4096);
+                }
+                if (path == std::string(rootdir) + "/sim_test_large.cfg") {
+                    return std::make_unique<tftpd::memory_sink>([&chunks](tftpd::memory_sink::chunks data) {
+                        chunks = std::move(data);
+                    });
+                }
+                if (path == std::string(rootdir) + "/sim_test_refused.log") {
+                    return std::make_unique<tftpd::callback_sink>(
+                        [&accepted](const char * /*data*/, size_t length) {
+                            accepted += length;
+                            return accepted < 2000;
+                        },
+                        [&ended](bool ok) { ended = ok; });
+                }
+                return nullptr;
+            });
+
+            (void)remove((std::string(rootdir) + "/sim_test_memory.cfg").c_str());
+            {
+                tftpd::simulator sim;
+                tftpd::simulated_network network(sim, latency);
+                tftpd::simulated_transport transport(network, server);
+                tftpd::simulated_timer timer(sim);
+                tftpd::receiver session(transport, timer);
+                tftpd::simulated_upload client(network, server, "sim_test_memory.cfg", 10000, {});
+                client.start();
+                (void)sim.run();
+                assert(client.success());
+                assert(session.done() && !session.error());
+            }
+            struct stat st = {};
+            assert(stat((std::string(rootdir) + "/sim_test_memory.cfg").c_str(), &st) != 0); // NOTE: no file
+            assert(chunks.size() == 3 && chunks[0].size() == 4096 && chunks[2].size() == 10000 - 2 * 4096);
+            for (size_t i = 0; i < 10000; ++i) {
+                assert(chunks[i / 4096][i % 4096] == tftpd::simulated_upload::pattern(i));
+            }
+
+            r = upload("sim_test_refused.log", 10000, 512, {});
+            assert(!r.success);
+            assert(r.report.status == tftpd::transfer_status::error_sent);
+            assert(r.report.error == ENOSPACE);
+            assert(accepted == 4 * 512 && !ended);
+
+            // NOTE: the tsize claimed bounds the upload, it reserves no memory
+            {
+                tftpd::memory_sink sink(nullptr);
+                sink.expect(1UL << 30);
+                assert(sink.memory() == 16UL << 20);
+                sink.expect(1000);
+                assert(sink.memory() == 1000);
+                std::vector<char> const block(600);
+                assert(sink.write(block.data(), block.size()) == 0);
+                assert(sink.write(block.data(), block.size()) == ENOSPACE);
+            }
+
+            // NOTE: the limit of a memory_sink is reserved from the admission budget
+            tftpd::set_admission_limit({64, 1UL << 20, 16});
+            chunks.clear();
+            r = upload("sim_test_large.cfg", 10000, 512, {});
+            tftpd::set_admission_limit({});
+            assert(!r.success);
+            assert(r.report.status == tftpd::transfer_status::error_sent);
+            assert(r.report.error == ENOSPACE && r.report.blocks == 0);
+            assert(chunks.empty());
+            assert(tftpd::get_request_counters().sessions == 0);
+
+            tftpd::set_storage(nullptr);
+        }
+
+        // hashed while received: the digest in the report and the sidecar file
+        {
+            tftpd::checksum expected(tftpd::checksum_type::sha256);
+            for (size_t i = 0; i < 10000; ++i) {
+                char const c = tftpd::simulated_upload::pattern(i);
+                expected.update(&c, 1);
+            }
+            tftpd::set_checksum(tftpd::checksum_type::sha256);
+            r = upload("sim_test_digest.dat", 10000, 1428, {});
+            tftpd::set_checksum(tftpd::checksum_type::none);
+            assert(r.success);
+            assert(r.report.checksum == "sha256:" + expected.hex());
+
+            std::ifstream is(std::string(rootdir) + "/sim_test_digest.dat.sha256");
+            std::string line;
+            assert(std::getline(is, line));
+            assert(line == expected.hex() + "  sim_test_digest.dat");
+
+            r = upload("sim_test_100k.dat", 10000, 1428, {});
+            assert(r.success && r.report.checksum.empty());
+        }
+
+        // stored once by content: the filenames are links to the same object
+        {
+            tftpd::dedup_store store;
+            store.enabled = true;
+            store.spill = 4096;
+            tftpd::set_dedup_store(store);
+
+            tftpd::checksum digest(tftpd::checksum_type::sha256);
+            for (size_t i = 0; i < 10000; ++i) {
+                char const c = tftpd::simulated_upload::pattern(i);
+                digest.update(&c, 1);
+            }
+            auto const hex = digest.hex();
+            std::string const object = std::string(rootdir) + "/.objects/" + hex.substr(0, 2) + "/" + hex.substr(2);
+
+            r = upload("sim_test_dedup1.dat", 10000, 512, {}); // NOTE: spilled to a file
+            assert(r.success);
+            r = upload("sim_test_dedup2.dat", 10000, 1428, {});
+            assert(r.success);
+            r = upload("sim_test_dedup3.dat", 1000, 512, {}); // NOTE: held in memory
+            assert(r.success);
+
+            struct stat first = {};
+            struct stat second = {};
+            struct stat third = {};
+            struct stat stored = {};
+            assert(stat((std::string(rootdir) + "/sim_test_dedup1.dat").c_str(), &first) == 0);
+            assert(stat((std::string(rootdir) + "/sim_test_dedup2.dat").c_str(), &second) == 0);
+            assert(stat((std::string(rootdir) + "/sim_test_dedup3.dat").c_str(), &third) == 0);
+            assert(stat(object.c_str(), &stored) == 0);
+            assert(first.st_ino == stored.st_ino && second.st_ino == stored.st_ino && stored.st_nlink == 3);
+            assert(third.st_ino != stored.st_ino && third.st_size == 1000);
+
+            // uploaded again, the file is replaced by the link
+            r = upload("sim_test_dedup3.dat", 10000, 512, {});
+            assert(r.success);
+            assert(stat((std::string(rootdir) + "/sim_test_dedup3.dat").c_str(), &third) == 0);
+            assert(third.st_ino == stored.st_ino);
+
+            // the objects can't be uploaded to
+            r = upload("./.objects/" + hex.substr(0, 2) + "/" + hex.substr(2), 10, 512, {});
+            assert(!r.success);
+            assert(stat(object.c_str(), &stored) == 0 && stored.st_size == 10000);
+
+            tftpd::set_dedup_store({});
+        }
+
+        // more than 65535 blocks, the block number wraps to 0 or 1
+        constexpr size_t many{70000};
+        r = upload("sim_test_wrap0.dat", many * 8 + 3, 8, {});
+        assert(r.success);
+        assert(r.report.blocks == many + 1);
+        assert(r.report.bytes == many * 8 + 3);
+        r = upload("sim_test_wrap1.dat", many * 8 + 3, 8, {}, 1);
+        assert(r.success);
+        assert(r.report.blocks == many + 1);
+        assert(r.report.bytes == many * 8 + 3);
+
+        // lossy: recovers and is reproducible by the seed
+        tftpd::impairment lossy;
+        lossy.loss = 0.1;
+        lossy.seed = 42;
+        r = upload("sim_test_lossy.dat", 100000, 1428, lossy);
+        std::cout << "lossy: elapsed " << std::chrono::duration_cast<milliseconds>(r.elapsed).count()
+                  << "ms retransmits " << r.retransmits << " duplicates " << r.report.duplicates << '\n';
+        assert(r.success);
+        assert(r.retransmits > 0);
+        auto const again = upload("sim_test_lossy.dat", 100000, 1428, lossy);
+        assert(again.success);
+        assert(again.elapsed == r.elapsed);
+        assert(again.retransmits == r.retransmits);
+        assert(again.report.duplicates == r.report.duplicates);
+
+        // blocks ahead of sequence are held back and written after the gap
+        {
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::simulated_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            tftpd::transfer_report report;
+            tftpd::g_report = [&report](const tftpd::transfer_report &sent) { report = sent; };
+            tftpd::receiver session(transport, timer);
+
+            tftpd::simulated_transport peer(network, network.ephemeral(server));
+            std::vector<char> rxbuf(PKTSIZE);
+            tftpd::datagram_transport::endpoint tid;
+            std::vector<u_short> acks;
+            std::function<void()> receive = [&] {
+                peer.async_receive_from(boost::asio::buffer(rxbuf), tid,
+                                        [&](const boost::system::error_code &ec, std::size_t /*n*/) {
+                                            if (!ec) {
+                                                auto const *tp = reinterpret_cast<struct tftphdr *>(rxbuf.data());
+                                                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+                                                acks.push_back(ntohs(tp->th_block));
+                                                receive();
+                                            }
+                                        });
+            };
+            receive();
+
+            const char wrq[] = "\0\2sim_test_reorder.dat\0octet"; // NOTE: ends with '\0' too
+            peer.send_to(boost::asio::buffer(wrq, sizeof(wrq)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert(acks == std::vector<u_short>{0});
+
+            for (u_short b : {2, 4, 3, 1}) {
+                size_t const size = (b == 4) ? 100 : SEGSIZE;
+                auto const pkt = packet(DATA, b, size, (b - 1) * SEGSIZE);
+                peer.send_to(boost::asio::buffer(pkt), tid);
+            }
+            (void)sim.run();
+            assert((acks == std::vector<u_short>{0, 4}));
+            assert(report.status == tftpd::transfer_status::success);
+            assert(report.bytes == 3 * SEGSIZE + 100);
+            assert(report.reordered == 3);
+            assert(report.duplicates == 0);
+            assert(report.retransmits == 0);
+
+            std::ifstream is(std::string(rootdir) + "/sim_test_reorder.dat", std::ios::binary);
+            std::vector<char> const received((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+            assert(received.size() == report.bytes);
+            for (size_t i = 0; i < received.size(); ++i) {
+                assert(received[i] == tftpd::simulated_upload::pattern(i));
+            }
+        }
+
+        // a retransmitted request is answered by its session, not a second one
+        {
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::transfer_report report;
+            tftpd::g_report = [&report](const tftpd::transfer_report &sent) { report = sent; };
+            tftpd::simulated_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            tftpd::receiver session(transport, timer);
+
+            tftpd::simulated_transport peer(network, network.ephemeral(server));
+            std::vector<char> rxbuf(PKTSIZE);
+            tftpd::datagram_transport::endpoint tid;
+            std::vector<u_short> acks;
+            std::function<void()> receive = [&] {
+                peer.async_receive_from(boost::asio::buffer(rxbuf), tid,
+                                        [&](const boost::system::error_code &ec, std::size_t /*n*/) {
+                                            if (!ec) {
+                                                auto const *tp = reinterpret_cast<struct tftphdr *>(rxbuf.data());
+                                                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+                                                acks.push_back(ntohs(tp->th_block));
+                                                receive();
+                                            }
+                                        });
+            };
+            receive();
+
+            const char wrq[] = "\0\2sim_test_duplicate.dat\0octet"; // NOTE: ends with '\0' too
+            peer.send_to(boost::asio::buffer(wrq, sizeof(wrq)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert(acks == std::vector<u_short>{0});
+            assert(tftpd::g_requests.size() == 1);
+
+            // the next listener on the request port gets the retransmission
+            tftpd::simulated_transport listen(network, server);
+            tftpd::simulated_timer listen_timer(sim);
+            tftpd::receiver listener(listen, listen_timer);
+            auto const duplicates = tftpd::get_request_counters().duplicates;
+            peer.send_to(boost::asio::buffer(wrq, sizeof(wrq)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert((acks == std::vector<u_short>{0, 0}));
+            assert(tftpd::get_request_counters().duplicates == duplicates + 1);
+
+            auto const pkt = packet(DATA, 1, 10);
+            peer.send_to(boost::asio::buffer(pkt), tid);
+            (void)sim.run();
+            assert((acks == std::vector<u_short>{0, 0, 1}));
+            assert(report.status == tftpd::transfer_status::success);
+            assert(report.retransmits == 1);
+            assert(report.bytes == 10);
+            assert(listener.get_filename().empty());
+        }
+        assert(tftpd::g_requests.size() == 0);
+
+        // a session timing out ends alone, a concurrent transfer completes
+        {
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            std::vector<tftpd::transfer_status> statuses;
+            tftpd::g_report = [&statuses](const tftpd::transfer_report &sent) { statuses.push_back(sent.status); };
+            tftpd::simulated_transport first(network, server);
+            tftpd::simulated_timer first_timer(sim);
+            tftpd::receiver silent_session(first, first_timer);
+
+            // NOTE: this peer never sends the DATA block
+            tftpd::simulated_transport silent(network, network.ephemeral(server));
+            const char wrq[] = "\0\2sim_test_silent.dat\0octet"; // NOTE: ends with '\0' too
+            silent.send_to(boost::asio::buffer(wrq, sizeof(wrq)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+
+            // the next listener on the request port
+            tftpd::simulated_transport second(network, server);
+            tftpd::simulated_timer second_timer(sim);
+            tftpd::receiver session(second, second_timer);
+            tftpd::simulated_upload::options options;
+            options.rexmt = milliseconds(200);
+            tftpd::simulated_upload client(network, server, "sim_test_concurrent.dat", 10000, options);
+            client.start();
+            (void)sim.run();
+            assert(client.success());
+            assert(session.done() && !session.error());
+            assert(silent_session.done() && silent_session.error() == std::errc::timed_out);
+            using status = tftpd::transfer_status;
+            assert((statuses == std::vector<status>{status::success, status::timeout}));
+            tftpd::g_report = nullptr;
+        }
+
+        // the blksize is clamped to the memory budget left
+        {
+            tftpd::set_admission_limit({1, sizeof(tftpd::receiver) + BUFSIZ + 8 * 1000, 0});
+            auto const clamped = tftpd::get_request_counters().clamped;
+            r = upload("sim_test_clamped.dat", 10000, 1428, {});
+            assert(r.success);
+            assert(r.report.blksize >= SEGSIZE && r.report.blksize < 1428);
+            assert(tftpd::get_request_counters().clamped == clamped + 1);
+            assert(tftpd::get_request_counters().sessions == 0);
+        }
+
+        // no port left for the TID of the session: only it ends, with an ERROR from the request port
+        {
+            struct exhausted_transport : tftpd::simulated_transport
+            {
+                using simulated_transport::simulated_transport;
+                void rebind(boost::system::error_code &ec) override
+                {
+                    ec = make_error_code(boost::system::errc::too_many_files_open);
+                }
+            };
+
+            tftpd::transfer_report report;
+            tftpd::g_report = [&report](const tftpd::transfer_report &rep) { report = rep; };
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            exhausted_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            tftpd::receiver session(transport, timer);
+            tftpd::simulated_upload client(network, server, "sim_test_rebind.dat", 1000, {});
+            client.start();
+            (void)sim.run();
+            tftpd::g_report = nullptr;
+            assert(!client.success());
+            assert(session.done() && session.error());
+            assert(report.status == tftpd::transfer_status::error_sent);
+            assert(report.error == EMFILE + ERRNO_OFFSET);
+        }
+
+        // beyond max_sessions a request waits in the queue, then it is refused
+        {
+            tftpd::set_admission_limit({1, 64UL << 20, 1});
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::g_report = nullptr;
+
+            // the first opcode and block or error code received by a peer
+            struct peer
+            {
+                tftpd::simulated_transport transport;
+                std::vector<char> rxbuf = std::vector<char>(PKTSIZE);
+                tftpd::datagram_transport::endpoint tid;
+                std::vector<std::pair<u_short, u_short>> answers;
+
+                explicit peer(tftpd::simulated_network &net) : transport(net, net.ephemeral(server))
+                {
+                    transport.async_receive_from(boost::asio::buffer(rxbuf), tid,
+                                                 [this](const boost::system::error_code &ec, std::size_t /*n*/) {
+                                                     if (!ec) {
+                                                         auto const *tp =
+                                                             reinterpret_cast<struct tftphdr *>(rxbuf.data());
+                                                         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+                                                         answers.emplace_back(ntohs(tp->th_opcode), ntohs(tp->th_block));
+                                                     }
+                                                 });
+                }
+            };
+
+            const char wrq1[] = "\0\2sim_test_queue1.dat\0octet"; // NOTE: ends with '\0' too
+            const char wrq2[] = "\0\2sim_test_queue2.dat\0octet";
+            const char wrq3[] = "\0\2sim_test_queue3.dat\0octet";
+
+            auto first = std::make_unique<tftpd::simulated_transport>(network, server);
+            tftpd::simulated_timer first_timer(sim);
+            auto running = std::make_unique<tftpd::receiver>(*first, first_timer);
+            peer p1(network);
+            p1.transport.send_to(boost::asio::buffer(wrq1, sizeof(wrq1)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert((p1.answers == std::vector<std::pair<u_short, u_short>>{{ACK, 0}}));
+
+            tftpd::simulated_transport second(network, server);
+            tftpd::simulated_timer second_timer(sim);
+            tftpd::receiver waiting(second, second_timer);
+            bool released = false;
+            waiting.on_port_released([&released] { released = true; });
+            peer p2(network);
+            p2.transport.send_to(boost::asio::buffer(wrq2, sizeof(wrq2)), server);
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert(p2.answers.empty());
+            assert(tftpd::get_request_counters().sessions == 1);
+            // NOTE: the request waits on its own TID, the next listener gets the port
+            assert(released && second.local_endpoint() != server);
+
+            {
+                tftpd::simulated_transport third(network, server);
+                tftpd::simulated_timer third_timer(sim);
+                tftpd::receiver busy(third, third_timer);
+                peer p3(network);
+                p3.transport.send_to(boost::asio::buffer(wrq3, sizeof(wrq3)), server);
+                (void)sim.run_until(sim.now() + milliseconds(10));
+                assert((p3.answers == std::vector<std::pair<u_short, u_short>>{{ERROR, EUNDEF}}));
+                // NOTE: the session ends after the ERROR sent
+                assert(busy.done() && busy.error() == std::errc::operation_canceled);
+            }
+
+            // the first session ends, the one waiting starts
+            running.reset();
+            first.reset();
+            (void)sim.run_until(sim.now() + milliseconds(10));
+            assert((p2.answers == std::vector<std::pair<u_short, u_short>>{{ACK, 0}}));
+            assert(tftpd::get_request_counters().sessions == 1);
+            assert(tftpd::get_request_counters().queued >= 1);
+            assert(tftpd::get_request_counters().refused >= 1);
+
+            tftpd::set_admission_limit({});
+        }
+
+        // requests over the rate limit are dropped until the bucket refilled
+        {
+            tftpd::set_rate_limit({1, 1});
+            tftpd::g_report = nullptr;
+            auto const before = tftpd::get_request_counters();
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::simulated_transport transport(network, server);
+            tftpd::simulated_timer timer(sim);
+            tftpd::receiver session(transport, timer);
+            assert(tftpd::g_limiter.admit(server.address(), sim.now())); // the client's only token
+
+            tftpd::simulated_upload::options options;
+            options.rexmt = milliseconds(200);
+            options.max_retries = 10;
+            tftpd::simulated_upload client(network, server, "sim_test_limited.dat", 1000, options);
+            client.start();
+            (void)sim.run();
+            assert(client.success());
+            assert(client.retransmits() == 5); // at 0, 200, .. 800 ms dropped
+            auto const counters = tftpd::get_request_counters();
+            assert(counters.dropped - before.dropped == 5);
+            assert(counters.admitted - before.admitted == 2);
+            assert(counters.sources == 1);
+
+            tftpd::set_rate_limit({0});
+            assert(tftpd::get_request_counters().sources == 0);
+        }
+
+        // the sources tracked are swept once per token refilled, not for each new source
+        {
+            tftpd::rate_limiter limiter({4, 1, 2});
+            auto const address = [](const char *a) { return boost::asio::ip::make_address(a); };
+            tftpd::rate_limiter::clock_type::time_point const t0{seconds(1)};
+            assert(limiter.admit(address("10.0.0.1"), t0 - milliseconds(200)));
+            assert(limiter.admit(address("10.0.0.2"), t0 - milliseconds(200)));
+            assert(!limiter.admit(address("10.0.0.3"), t0)); // NOTE: swept, no bucket full yet
+            assert(!limiter.admit(address("10.0.0.4"), t0 + milliseconds(100))); // full meanwhile, not swept
+            assert(limiter.counters().sources == 2);
+            assert(limiter.admit(address("10.0.0.4"), t0 + milliseconds(250)));
+            assert(limiter.counters().sources == 1);
+        }
+
+        // the client gives up after max_retries request retransmissions
+        {
+            tftpd::simulator sim;
+            tftpd::simulated_network network(sim, latency);
+            tftpd::simulated_upload::options options;
+            options.max_retries = 3;
+            tftpd::simulated_upload client(network, server, "none.dat", 10, options);
+            client.start();
+            (void)sim.run();
+            assert(client.done() && !client.success());
+            assert(client.retransmits() == 3);
+            assert(client.elapsed() == 4 * options.rexmt);
+        }
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
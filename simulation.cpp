@@ -0,0 +1,333 @@
+#include "simulation.hpp"
+
+#include "tftp/tftpsubs.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cinttypes> // strtoumax used
+#include <cstring>
+#include <strings.h> // strcasecmp used
+
+namespace tftpd {
+
+//----------------------------------------------------------------------
+// simulator
+//----------------------------------------------------------------------
+simulator::event_id simulator::schedule(clock_type::duration after, std::function<void()> action)
+{
+    event_id const id{now_ + std::max(after, clock_type::duration::zero()), sequence_++};
+    events_.emplace(id, std::move(action));
+    return id;
+}
+
+size_t simulator::run()
+{
+    return run_until(clock_type::time_point::max());
+}
+
+size_t simulator::run_until(clock_type::time_point until)
+{
+    size_t count = 0;
+    while (!events_.empty() && events_.begin()->first.first <= until) {
+        auto it = events_.begin();
+        now_ = it->first.first;
+        auto action = std::move(it->second);
+        events_.erase(it); // NOTE: before the action, it may throw or schedule
+        action();
+        count++;
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// simulated_timer
+//----------------------------------------------------------------------
+simulated_timer::~simulated_timer()
+{
+    for (auto &w : waits_) {
+        (void)sim_.cancel(w.first);
+    }
+}
+
+void simulated_timer::expires_after(clock_type::duration expiry)
+{
+    cancel();
+    expiry_ = sim_.now() + expiry;
+}
+
+void simulated_timer::async_wait(wait_handler handler)
+{
+    auto const id = sim_.schedule(expiry_ - sim_.now(), [this] {
+        // NOTE: all waits pending share the expiry, so the first one is due
+        auto due = std::move(waits_.front().second);
+        waits_.erase(waits_.begin());
+        due({});
+    });
+    waits_.emplace_back(id, std::move(handler));
+}
+
+void simulated_timer::cancel()
+{
+    for (auto &w : waits_) {
+        (void)sim_.cancel(w.first);
+        sim_.post([handler = std::move(w.second)] { handler(boost::asio::error::operation_aborted); });
+    }
+    waits_.clear();
+}
+
+//----------------------------------------------------------------------
+// simulated_network
+//----------------------------------------------------------------------
+void simulated_network::send(const endpoint &from, const endpoint &to, boost::asio::const_buffer buffer)
+{
+    auto const f = model_.next();
+    auto const *p = static_cast<const char *>(buffer.data());
+    for (unsigned i = 0; i < f.copies; ++i) {
+        sim_.schedule(latency_ + f.delay,
+                      [this, from, to, data = std::vector<char>(p, p + buffer.size())] { deliver(from, to, data); });
+    }
+}
+
+void simulated_network::deliver(const endpoint &from, const endpoint &to, const std::vector<char> &data)
+{
+    auto it = transports_.find(to);
+    if (it != transports_.end()) {
+        it->second->deliver(from, data);
+    }
+    // NOTE: else nobody listens, the datagram is lost
+}
+
+//----------------------------------------------------------------------
+// simulated_transport
+//----------------------------------------------------------------------
+simulated_transport::simulated_transport(simulated_network &network, const endpoint &local)
+    : network_(network), local_(local)
+{
+    network_.attach(local_, this);
+}
+
+simulated_transport::~simulated_transport()
+{
+    if (open_) {
+        network_.detach(local_);
+    }
+}
+
+void simulated_transport::async_receive_from(boost::asio::mutable_buffer buffer, endpoint &sender,
+                                             transport_handler handler)
+{
+    if (!open_) {
+        network_.sim().post([handler = std::move(handler)] { handler(boost::asio::error::bad_descriptor, 0); });
+        return;
+    }
+    receives_.push_back({buffer, &sender, std::move(handler)});
+    if (!queue_.empty()) {
+        auto datagram = std::move(queue_.front());
+        queue_.pop_front();
+        deliver(datagram.first, datagram.second);
+    }
+}
+
+void simulated_transport::async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                                        transport_handler handler)
+{
+    send_to(buffer, destination);
+    network_.sim().post([handler = std::move(handler), n = buffer.size()] { handler({}, n); });
+}
+
+void simulated_transport::send_to(boost::asio::const_buffer buffer, const endpoint &destination)
+{
+    if (open_) {
+        network_.send(local_, destination, buffer);
+    }
+}
+
+void simulated_transport::deliver(const endpoint &from, const std::vector<char> &data)
+{
+    if (receives_.empty()) {
+        queue_.emplace_back(from, data);
+        return;
+    }
+
+    auto r = std::move(receives_.front());
+    receives_.pop_front();
+    size_t const n = std::min(data.size(), r.buffer.size());
+    std::memcpy(r.buffer.data(), data.data(), n);
+    *r.sender = from;
+    network_.sim().post([handler = std::move(r.handler), n] { handler({}, n); });
+}
+
+void simulated_transport::cancel()
+{
+    for (auto &r : receives_) {
+        network_.sim().post([handler = std::move(r.handler)] { handler(boost::asio::error::operation_aborted, 0); });
+    }
+    receives_.clear();
+}
+
+void simulated_transport::close()
+{
+    cancel();
+    queue_.clear();
+    if (open_) {
+        network_.detach(local_);
+        open_ = false;
+    }
+}
+
+void simulated_transport::rebind(boost::system::error_code &ec)
+{
+    ec.clear();
+    close();
+    local_ = network_.ephemeral(local_);
+    network_.attach(local_, this);
+    open_ = true;
+}
+
+//----------------------------------------------------------------------
+// simulated_upload
+//----------------------------------------------------------------------
+simulated_upload::simulated_upload(simulated_network &network, const endpoint &server, std::string remote,
+                                   size_t size, const options &opts)
+    : network_(network), transport_(network, network.ephemeral(server)), timer_(network.sim()), server_(server),
+      remote_(std::move(remote)), size_(size), options_(opts), rxbuf_(PKTSIZE)
+{}
+
+void simulated_upload::start()
+{
+    auto append = [this](const std::string &s) { request_.insert(request_.end(), s.c_str(), s.c_str() + s.size() + 1); };
+    request_.assign({0, static_cast<char>(WRQ)});
+    append(remote_);
+    append("octet");
+    if (options_.blksize != 0) {
+        append("blksize");
+        append(std::to_string(options_.blksize));
+    }
+    if (options_.rollover >= 0) {
+        append("rollover");
+        append(std::to_string(options_.rollover));
+    }
+
+    started_ = timer_.now();
+    transport_.send_to(boost::asio::buffer(request_), server_);
+    arm_timer();
+    receive();
+}
+
+void simulated_upload::receive()
+{
+    transport_.async_receive_from(boost::asio::buffer(rxbuf_), sender_,
+                                  [this](const boost::system::error_code &ec, std::size_t length) {
+                                      if (ec || done_) {
+                                          return;
+                                      }
+                                      on_packet(length);
+                                      if (!done_) {
+                                          receive();
+                                      }
+                                  });
+}
+
+void simulated_upload::on_packet(size_t length)
+{
+    if (length < TFTP_HEADER) {
+        return;
+    }
+    if (!tid_) {
+        peer_ = sender_;
+        tid_ = true;
+    } else if (sender_ != peer_) {
+        return; // NOTE: not our TID
+    }
+
+    auto const *tp = reinterpret_cast<const struct tftphdr *>(rxbuf_.data());
+    auto const opcode = ntohs(tp->th_opcode);
+    if (opcode == ERROR) {
+        finish(false);
+        return;
+    }
+
+    if (opcode == OACK && blocks_ == 0) {
+        // NOTE: options are NUL terminated name value pairs
+        const char *cp = rxbuf_.data() + 2;
+        const char *const end = rxbuf_.data() + length;
+        while (cp < end) {
+            const char *const name = cp;
+            const char *const value = name + strnlen(name, static_cast<size_t>(end - name)) + 1;
+            if (value >= end) {
+                break;
+            }
+            if (strcasecmp(name, "blksize") == 0) {
+                blksize_ = static_cast<size_t>(std::strtoumax(value, nullptr, 10));
+            } else if (strcasecmp(name, "rollover") == 0) {
+                rollover_ = static_cast<uint16_t>(std::strtoumax(value, nullptr, 10));
+            }
+            cp = value + strnlen(value, static_cast<size_t>(end - value)) + 1;
+        }
+    } else if (opcode != ACK || ntohs(tp->th_block) != block_) {
+        return; // NOTE: a duplicate or stale ACK
+    }
+
+    retries_ = 0;
+    if (last_) {
+        finish(true);
+        return;
+    }
+    send_block();
+}
+
+void simulated_upload::send_block()
+{
+    size_t const n = std::min(blksize_, size_ - offset_);
+    txbuf_.resize(TFTP_HEADER + n);
+    auto *tp = reinterpret_cast<struct tftphdr *>(txbuf_.data());
+    tp->th_opcode = htons(static_cast<u_short>(DATA));
+    block_ = (block_ == UINT16_MAX) ? rollover_ : static_cast<uint16_t>(block_ + 1);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    tp->th_block = htons(block_);
+    for (size_t i = 0; i < n; ++i) {
+        txbuf_[TFTP_HEADER + i] = pattern(offset_ + i);
+    }
+    offset_ += n;
+    last_ = n < blksize_;
+    blocks_++;
+
+    transport_.send_to(boost::asio::buffer(txbuf_), peer_);
+    arm_timer();
+}
+
+void simulated_upload::resend()
+{
+    if (++retries_ > options_.max_retries) {
+        finish(false);
+        return;
+    }
+    retransmits_++;
+    if (blocks_ == 0) {
+        transport_.send_to(boost::asio::buffer(request_), server_);
+    } else {
+        transport_.send_to(boost::asio::buffer(txbuf_), peer_);
+    }
+    arm_timer();
+}
+
+void simulated_upload::arm_timer()
+{
+    timer_.expires_after(options_.rexmt);
+    timer_.async_wait([this](const boost::system::error_code &ec) {
+        if (!ec && !done_) {
+            resend();
+        }
+    });
+}
+
+void simulated_upload::finish(bool success)
+{
+    done_ = true;
+    success_ = success;
+    finished_ = timer_.now();
+    timer_.cancel();
+    transport_.close();
+}
+
+} // namespace tftpd
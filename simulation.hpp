@@ -0,0 +1,218 @@
+#pragma once
+
+/*
+ * Discrete event simulation of tftpd sessions with virtual time.
+ *
+ * A simulator runs scheduled actions in time order and advances a virtual
+ * clock from one event to the next, so a timeout of seconds costs no wall
+ * clock time.  simulated_timer and simulated_transport implement the
+ * session_timer and datagram_transport interfaces of transport.hpp on top
+ * of it, a simulated_network delivers the datagrams between them with a
+ * latency and an optional seeded impairment.  The server sessions run
+ * unchanged, simulated_upload is a lock step WRQ client as their peer.
+ *
+ * Everything runs on the thread calling simulator::run(), exceptions
+ * thrown by a handler propagate out of it.
+ */
+#include "transport.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tftpd {
+
+class simulator
+{
+public:
+    using clock_type = session_timer::clock_type;
+    using event_id = std::pair<clock_type::time_point, uint64_t>;
+
+    clock_type::time_point now() const { return now_; }
+
+    event_id schedule(clock_type::duration after, std::function<void()> action);
+    event_id post(std::function<void()> action) { return schedule(clock_type::duration::zero(), std::move(action)); }
+
+    /// returns false if the event already ran or was canceled
+    bool cancel(const event_id &id) { return events_.erase(id) != 0; }
+
+    /// run the events until there are none left, returns how many ran
+    size_t run();
+
+    /// run the events due until the given virtual time
+    size_t run_until(clock_type::time_point until);
+
+    bool empty() const { return events_.empty(); }
+
+private:
+    clock_type::time_point now_{};
+    uint64_t sequence_{0}; // NOTE: events at the same time run in order of scheduling
+    std::map<event_id, std::function<void()>> events_;
+};
+
+class simulated_timer : public session_timer
+{
+public:
+    explicit simulated_timer(simulator &sim) : sim_(sim) {}
+    ~simulated_timer() override;
+
+    simulated_timer(const simulated_timer &) = delete;
+    simulated_timer &operator=(const simulated_timer &) = delete;
+
+    clock_type::time_point now() const override { return sim_.now(); }
+    void expires_after(clock_type::duration expiry) override;
+    void async_wait(wait_handler handler) override;
+    void cancel() override;
+
+private:
+    simulator &sim_;
+    clock_type::time_point expiry_{};
+    std::vector<std::pair<simulator::event_id, wait_handler>> waits_;
+};
+
+class simulated_transport;
+
+/// delivers datagrams between the simulated transports
+class simulated_network
+{
+public:
+    using endpoint = datagram_transport::endpoint;
+
+    simulated_network(simulator &sim, std::chrono::microseconds latency, const impairment &profile = {})
+        : sim_(sim), latency_(latency), model_(profile)
+    {}
+
+    simulator &sim() { return sim_; }
+
+    void send(const endpoint &from, const endpoint &to, boost::asio::const_buffer buffer);
+
+    void attach(const endpoint &local, simulated_transport *transport) { transports_[local] = transport; }
+    void detach(const endpoint &local) { transports_.erase(local); }
+
+    /// a new port on the same address
+    endpoint ephemeral(const endpoint &local) { return {local.address(), next_port_++}; }
+
+    const impairment_stats &stats() const { return model_.stats(); }
+
+private:
+    void deliver(const endpoint &from, const endpoint &to, const std::vector<char> &data);
+
+    simulator &sim_;
+    std::chrono::microseconds latency_;
+    impairment_model model_;
+    std::map<endpoint, simulated_transport *> transports_;
+    uint16_t next_port_{49152};
+};
+
+class simulated_transport : public datagram_transport
+{
+public:
+    simulated_transport(simulated_network &network, const endpoint &local);
+    ~simulated_transport() override;
+
+    simulated_transport(const simulated_transport &) = delete;
+    simulated_transport &operator=(const simulated_transport &) = delete;
+
+    void async_receive_from(boost::asio::mutable_buffer buffer, endpoint &sender, transport_handler handler) override;
+    void async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                       transport_handler handler) override;
+    void send_to(boost::asio::const_buffer buffer, const endpoint &destination) override;
+    void cancel() override;
+    void close() override;
+    bool is_open() const override { return open_; }
+    void rebind(boost::system::error_code &ec) override;
+
+    const endpoint &local_endpoint() const { return local_; }
+
+private:
+    friend class simulated_network;
+
+    /// a datagram arrived from the network
+    void deliver(const endpoint &from, const std::vector<char> &data);
+
+    struct pending_receive
+    {
+        boost::asio::mutable_buffer buffer;
+        endpoint *sender;
+        transport_handler handler;
+    };
+
+    simulated_network &network_;
+    endpoint local_;
+    bool open_{true};
+    std::deque<std::pair<endpoint, std::vector<char>>> queue_;
+    std::deque<pending_receive> receives_;
+};
+
+/// a lock step WRQ client (RFC1350, RFC2348 blksize, rollover) as peer of
+/// a simulated server session, it sends a synthetic file of the given size
+class simulated_upload
+{
+public:
+    using endpoint = datagram_transport::endpoint;
+
+    struct options
+    {
+        size_t blksize{0}; ///< 0 to not ask
+        int rollover{-1};  ///< block number after 65535, -1 to not ask
+        std::chrono::milliseconds rexmt{1000};
+        unsigned max_retries{5};
+    };
+
+    simulated_upload(simulated_network &network, const endpoint &server, std::string remote, size_t size,
+                     const options &opts);
+
+    void start();
+
+    bool done() const { return done_; }
+    bool success() const { return success_; }
+
+    /// from the request to the last ACK
+    session_timer::clock_type::duration elapsed() const { return finished_ - started_; }
+    uint64_t retransmits() const { return retransmits_; }
+    uint64_t blocks() const { return blocks_; }
+
+    /// the byte at the offset of the synthetic file
+    static char pattern(size_t offset) { return static_cast<char>(offset * 7); }
+
+private:
+    void receive();
+    void on_packet(size_t length);
+    void send_block();
+    void resend();
+    void arm_timer();
+    void finish(bool success);
+
+    simulated_network &network_;
+    simulated_transport transport_;
+    simulated_timer timer_;
+    endpoint server_;
+    endpoint peer_;
+    endpoint sender_;
+    std::string remote_;
+    size_t size_;
+    options options_;
+
+    std::vector<char> request_;
+    std::vector<char> txbuf_;
+    std::vector<char> rxbuf_;
+    size_t blksize_{512};
+    uint16_t block_{0};    // the last block sent
+    uint16_t rollover_{0}; // the block after 65535
+    size_t offset_{0};     // of the next block
+    bool tid_{false};
+    bool last_{false};
+    bool done_{false};
+    bool success_{false};
+    unsigned retries_{0};
+    uint64_t retransmits_{0};
+    uint64_t blocks_{0};
+    session_timer::clock_type::time_point started_{};
+    session_timer::clock_type::time_point finished_{};
+};
+
+} // namespace tftpd
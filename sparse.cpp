@@ -0,0 +1,175 @@
+#include "sparse.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#elif defined(__aarch64__)
+#    include <arm_neon.h>
+#endif
+
+namespace tftpd {
+
+namespace {
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2"))) bool all_zero_avx2(const char *data, size_t length)
+{
+    for (; length >= 128; data += 128, length -= 128) {
+        __m256i const a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        __m256i const b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+        __m256i const c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 64));
+        __m256i const d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 96));
+        __m256i const any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (_mm256_testz_si256(any, any) == 0) {
+            return false;
+        }
+    }
+    for (; length >= 32; data += 32, length -= 32) {
+        __m256i const a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        if (_mm256_testz_si256(a, a) == 0) {
+            return false;
+        }
+    }
+    return detail::all_zero_portable(data, length);
+}
+
+#endif
+
+using zero_function = bool (*)(const char *, size_t);
+
+zero_function all_zero_check()
+{
+    static zero_function const function =
+        detail::has_simd_instructions() ? detail::all_zero_accelerated : detail::all_zero_portable;
+    return function;
+}
+
+/// the data written at once
+bool put(FILE *file, const char *data, size_t length) { return length == 0 || fwrite(data, 1, length, file) == length; }
+
+} // namespace
+
+bool all_zero(const char *data, size_t length) { return all_zero_check()(data, length); }
+
+bool sparse_writer::write(FILE *file, const char *data, size_t length)
+{
+    const char *run = data; // NOTE: the blocks with data in sequence
+    size_t run_length = 0;
+    while (length > 0) {
+        size_t const n = std::min<uint64_t>(length, sparse_block - offset_ % sparse_block);
+        if (dirty_) {
+            run_length += n;
+        } else if (all_zero(data, n)) {
+            zeros_ += n;
+        } else {
+            if (!put(file, run, run_length) || !fill(file)) {
+                return false;
+            }
+            run = data;
+            run_length = n;
+            dirty_ = true;
+        }
+        offset_ += n;
+        data += n;
+        length -= n;
+
+        if (offset_ % sparse_block == 0) {
+            hole_ += zeros_;
+            skipped_ += zeros_;
+            zeros_ = 0;
+            dirty_ = false;
+        }
+    }
+    return put(file, run, run_length);
+}
+
+bool sparse_writer::finish(FILE *file)
+{
+    if (hole_ == 0 && zeros_ == 0) {
+        return true;
+    }
+    skipped_ += zeros_;
+    hole_ = 0;
+    zeros_ = 0;
+    return fflush(file) == 0 && ftruncate(fileno(file), static_cast<off_t>(offset_)) == 0;
+}
+
+/*
+ * Seek over the zero blocks and write the zeros of the current block, it
+ * has data.
+ */
+bool sparse_writer::fill(FILE *file)
+{
+    if (hole_ > 0) {
+        if (fseeko(file, static_cast<off_t>(hole_), SEEK_CUR) != 0) {
+            return false;
+        }
+        hole_ = 0;
+    }
+    static const std::array<char, sparse_block> zeros{};
+    if (!put(file, zeros.data(), zeros_)) {
+        return false;
+    }
+    zeros_ = 0;
+    return true;
+}
+
+bool detail::has_simd_instructions()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2") != 0;
+#elif defined(__aarch64__)
+    return true; // NOTE: NEON is part of ARMv8
+#else
+    return false;
+#endif
+}
+
+bool detail::all_zero_portable(const char *data, size_t length)
+{
+    for (; length >= 64; data += 64, length -= 64) {
+        uint64_t any = 0;
+        for (size_t i = 0; i < 64; i += 8) {
+            uint64_t word = 0;
+            memcpy(&word, data + i, sizeof(word));
+            any |= word;
+        }
+        if (any != 0) {
+            return false;
+        }
+    }
+    for (; length > 0; ++data, --length) {
+        if (*data != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool detail::all_zero_accelerated(const char *data, size_t length)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return all_zero_avx2(data, length);
+#elif defined(__aarch64__)
+    for (; length >= 64; data += 64, length -= 64) {
+        uint8x16_t const a = vld1q_u8(reinterpret_cast<const uint8_t *>(data));
+        uint8x16_t const b = vld1q_u8(reinterpret_cast<const uint8_t *>(data + 16));
+        uint8x16_t const c = vld1q_u8(reinterpret_cast<const uint8_t *>(data + 32));
+        uint8x16_t const d = vld1q_u8(reinterpret_cast<const uint8_t *>(data + 48));
+        if (vmaxvq_u8(vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d))) != 0) {
+            return false;
+        }
+    }
+    return all_zero_portable(data, length);
+#else
+    return all_zero_portable(data, length);
+#endif
+}
+
+} // namespace tftpd
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * Uploads written as sparse files.
+ *
+ * Disk images are mostly zeros.  The sparse_writer looks at each block of
+ * the filesystem an upload covers: a block of zeros only is not written
+ * but seeked over, so it is a hole of the file.  The size of the file is
+ * set at the end, a trailing run of zeros is a hole too.
+ *
+ * The check for zeros uses AVX2 or NEON if the CPU has them, the CPU is
+ * asked once at run time.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace tftpd {
+
+/// the blocks of the filesystem which may be holes, at offsets of its multiple
+constexpr size_t sparse_block{4096};
+
+/// true if the data are zeros only
+bool all_zero(const char *data, size_t length);
+
+class sparse_writer
+{
+public:
+    /// append to the file, false with errno set if it failed
+    bool write(FILE *file, const char *data, size_t length);
+
+    /// the size of the file set after the last write, before it is closed
+    bool finish(FILE *file);
+
+    uint64_t size() const { return offset_; }
+    uint64_t holes() const { return skipped_; } ///< bytes not written
+
+private:
+    bool fill(FILE *file);
+
+    uint64_t offset_{0};  // written or skipped
+    uint64_t hole_{0};    // whole zero blocks not written yet
+    size_t zeros_{0};     // NOTE: the zeros at the start of the current block
+    bool dirty_{false};   // the current block has data
+    uint64_t skipped_{0}; // of the holes seeked over
+};
+
+namespace detail {
+bool has_simd_instructions();
+
+bool all_zero_portable(const char *data, size_t length);
+bool all_zero_accelerated(const char *data, size_t length);
+} // namespace detail
+
+} // namespace tftpd
@@ -0,0 +1,103 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the holes of the uploads written by the sparse_writer, and the SIMD versus the portable zero check! CK
+
+#include "sparse.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const char *const path{"/tmp/sparse_test.img"};
+
+/// the data written in pieces of the blksize, as the blocks of an upload
+tftpd::sparse_writer write_file(const std::vector<char> &data, size_t blksize)
+{
+    FILE *file = fopen(path, "w");
+    assert(file != nullptr);
+    tftpd::sparse_writer writer;
+    for (size_t done = 0; done < data.size(); done += blksize) {
+        assert(writer.write(file, data.data() + done, std::min(blksize, data.size() - done)));
+    }
+    assert(writer.finish(file));
+    assert(fclose(file) == 0);
+    assert(writer.size() == data.size());
+
+    std::ifstream is(path, std::ios::binary);
+    std::vector<char> const written((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    assert(written == data);
+    return writer;
+}
+
+} // namespace
+
+int main()
+{
+    try {
+        std::cout << "simd instructions: " << tftpd::detail::has_simd_instructions() << std::endl;
+
+        // the SIMD check finds a byte set at any position, length and alignment
+        std::mt19937 random(1); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+        std::vector<char> zeros(8192);
+        for (size_t i = 0; i < 2000; ++i) {
+            size_t const offset = random() % 64;
+            size_t const length = random() % (zeros.size() - offset);
+            const char *p = zeros.data() + offset;
+            assert(tftpd::detail::all_zero_accelerated(p, length));
+            assert(tftpd::detail::all_zero_portable(p, length));
+            if (length > 0) {
+                size_t const set = random() % length;
+                zeros[offset + set] = static_cast<char>(1U << (random() % 8));
+                assert(!tftpd::detail::all_zero_accelerated(p, length));
+                assert(!tftpd::detail::all_zero_portable(p, length));
+                zeros[offset + set] = 0;
+            }
+        }
+
+        // an image of mostly zeros: data at the start, in the middle across blocks and at the end
+        std::vector<char> image(4UL << 20);
+        for (size_t i = 0; i < 10000; ++i) {
+            image[i] = static_cast<char>(i * 7 + 1);
+            image[(1UL << 20) + 3000 + i] = static_cast<char>(i * 13 + 1);
+        }
+        image[image.size() - 1] = 1;
+        for (size_t blksize : {512, 1428, 65464}) {
+            auto const writer = write_file(image, blksize);
+            struct stat st = {};
+            assert(stat(path, &st) == 0);
+            std::cout << "blksize " << blksize << ": holes " << writer.holes() << " allocated "
+                      << st.st_blocks * 512 << std::endl;
+            assert(static_cast<size_t>(st.st_size) == image.size());
+            assert(writer.holes() >= image.size() - 8 * tftpd::sparse_block);
+            assert(static_cast<size_t>(st.st_blocks) * 512 < image.size() / 8); // NOTE: depends on the filesystem
+        }
+
+        // trailing zeros are a hole too, the size is still right
+        image.resize(image.size() + 12345);
+        (void)write_file(image, 1428);
+
+        // zeros only, or none
+        (void)write_file(std::vector<char>(100000), 512);
+        (void)write_file(std::vector<char>(), 512);
+        (void)write_file(std::vector<char>(100000, 'x'), 512);
+
+        (void)remove(path);
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,550 @@
+#include "storage.hpp"
+
+#include "root_index.hpp"
+#include "tftp/tftpsubs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#    include <linux/fs.h>
+#    include <sys/ioctl.h>
+#endif
+
+namespace tftpd {
+
+namespace {
+
+/// the TFTP error of a failed write
+int write_error() { return (errno != 0) ? errno + ERRNO_OFFSET : ENOSPACE; }
+
+/// the digest next to the file as <path>.<checksum name>, in the format of sha256sum(1)
+void write_sidecar(const std::string &path, const checksum &digest)
+{
+    std::string const sidecar = path + "." + checksum_name(digest.type());
+    FILE *file = fopen(sidecar.c_str(), "w");
+    if (file == nullptr) {
+        syslog(LOG_ERR, "tftpd: fopen(%s) failed! %s\n", sidecar.c_str(), strerror(errno));
+        return; // NOTE: the upload itself succeeded
+    }
+    auto const slash = path.rfind('/');
+    std::string const name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    int const written = fprintf(file, "%s  %s\n", digest.hex().c_str(), name.c_str());
+    if (fclose(file) != 0 || written < 0) {
+        syslog(LOG_ERR, "tftpd: writing %s failed! %s\n", sidecar.c_str(), strerror(errno));
+    }
+}
+
+/// a directory which may exist already
+int make_directory(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+        syslog(LOG_ERR, "tftpd: mkdir(%s) failed! %s\n", path.c_str(), strerror(errno));
+        return errno + ERRNO_OFFSET;
+    }
+    return 0; // OK
+}
+
+/// a copy on write clone of the file, false if the filesystem has none
+bool clone_file(const std::string &from, const std::string &to)
+{
+#if defined(FICLONE)
+    int const source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
+        return false;
+    }
+    int const target = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (target < 0) {
+        (void)close(source);
+        return false;
+    }
+    bool cloned = ioctl(target, FICLONE, source) == 0;
+    (void)close(source);
+    cloned = (close(target) == 0) && cloned;
+    if (!cloned) {
+        (void)unlink(to.c_str());
+    }
+    return cloned;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+} // namespace
+
+void wait_ready(storage_sink &sink, bool drained)
+{
+    std::promise<void> ready;
+    auto resumed = ready.get_future();
+    if (!sink.ready(drained, [&ready] { ready.set_value(); })) {
+        resumed.wait();
+    }
+}
+
+file_sink::file_sink(FILE *file, std::string path, std::string temp_path)
+    : file_(file), path_(std::move(path)), temp_path_(std::move(temp_path))
+{}
+
+file_sink::~file_sink()
+{
+    if (file_ != nullptr) {
+        (void)fclose(file_); // NOTE: the temporary file of a failed upload is left
+    }
+}
+
+int file_sink::write(const char *data, size_t length)
+{
+    errno = 0;
+    if (!sparse_.write(file_, data, length)) {
+        syslog(LOG_ERR, "tftpd: fwrite() failed! %s\n", strerror(errno));
+        return write_error();
+    }
+    return 0; // OK
+}
+
+int file_sink::commit()
+{
+    errno = 0;
+    bool const finished = sparse_.finish(file_);
+    int const error = fclose(file_);
+    file_ = nullptr;
+    if (!finished || error != 0) {
+        syslog(LOG_ERR, "tftpd: fclose() failed! %s\n", strerror(errno));
+        return write_error();
+    }
+    if (sparse_.holes() > 0) {
+        syslog(LOG_NOTICE, "tftpd: %s has %lu bytes of holes\n", path_.c_str(), sparse_.holes());
+    }
+    if (temp_path_ != path_ && rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        syslog(LOG_ERR, "tftpd: rename() failed! %s\n", strerror(errno));
+        return errno + ERRNO_OFFSET;
+    }
+    g_index.refresh(path_); // NOTE: a download may follow before the inotify event
+    return 0; // OK
+}
+
+void file_sink::sidecar(const checksum &digest) { write_sidecar(path_, digest); }
+
+memory_sink::memory_sink(std::function<void(chunks data)> handler, size_t chunk_size, size_t limit)
+    : handler_(std::move(handler)), chunk_size_(chunk_size), limit_(limit)
+{}
+
+int memory_sink::write(const char *data, size_t length)
+{
+    size_t const limit = bound();
+    if (length > limit - size_) {
+        syslog(LOG_ERR, "tftpd: upload exceeds the memory limit of %lu\n", limit);
+        return ENOSPACE;
+    }
+    if (data_.empty()) {
+        data_.emplace_back();
+        data_.back().reserve(chunk_size_);
+    }
+    size_ += length;
+
+    while (length > 0) {
+        auto *chunk = &data_.back();
+        if (chunk_size_ != 0 && chunk->size() == chunk_size_) {
+            data_.emplace_back();
+            chunk = &data_.back();
+            chunk->reserve(chunk_size_);
+        }
+        size_t const n = (chunk_size_ != 0) ? std::min(length, chunk_size_ - chunk->size()) : length;
+        if (chunk_size_ == 0 && chunk->size() + n > chunk->capacity()) {
+            // NOTE: grown by the blocks received, but never beyond the memory reserved
+            chunk->reserve(std::min(std::max(chunk->size() + n, 2 * chunk->capacity()), limit));
+        }
+        chunk->insert(chunk->end(), data, data + n);
+        data += n;
+        length -= n;
+    }
+    return 0; // OK
+}
+
+size_t memory_sink::memory() const
+{
+    // NOTE: the chunks are allocated whole
+    return (chunk_size_ != 0) ? (bound() + chunk_size_ - 1) / chunk_size_ * chunk_size_ : bound();
+}
+
+int memory_sink::commit()
+{
+    if (handler_ != nullptr) {
+        handler_(std::move(data_));
+    }
+    return 0; // OK
+}
+
+pipe_sink::~pipe_sink()
+{
+    if (fd_ >= 0) {
+        (void)close(fd_);
+    }
+}
+
+int pipe_sink::write(const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t const written = ::write(fd_, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_ERR, "tftpd: write() to pipe failed! %s\n", strerror(errno));
+            return write_error();
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return 0; // OK
+}
+
+int pipe_sink::commit()
+{
+    int const error = close(fd_);
+    fd_ = -1;
+    return (error != 0) ? errno + ERRNO_OFFSET : 0;
+}
+
+dedup_sink::dedup_sink(std::string objects, std::string path, dedup_link link, size_t spill)
+    : objects_(std::move(objects)), path_(std::move(path)), link_(link), spill_(spill)
+{}
+
+dedup_sink::~dedup_sink()
+{
+    if (file_ != nullptr) {
+        (void)fclose(file_);
+    }
+    if (!temp_path_.empty()) {
+        (void)unlink(temp_path_.c_str()); // NOTE: nothing of a failed upload is left
+    }
+}
+
+int dedup_sink::write(const char *data, size_t length)
+{
+    digest_.update(data, length);
+    if (file_ == nullptr) {
+        // NOTE: the size is known if the client sent a tsize
+        if (buffer_.size() + length <= spill_ && expected_ <= spill_) {
+            if (buffer_.empty()) {
+                buffer_.reserve(std::min<uint64_t>(expected_, spill_));
+            }
+            buffer_.insert(buffer_.end(), data, data + length);
+            return 0; // OK
+        }
+        int const error = spill();
+        if (error != 0) {
+            return error;
+        }
+    }
+    errno = 0;
+    if (!sparse_.write(file_, data, length)) {
+        syslog(LOG_ERR, "tftpd: fwrite() failed! %s\n", strerror(errno));
+        return write_error();
+    }
+    return 0; // OK
+}
+
+int dedup_sink::commit()
+{
+    int error = store();
+    if (error == 0) {
+        error = place();
+    }
+    if (!temp_path_.empty()) {
+        (void)unlink(temp_path_.c_str());
+        temp_path_.clear();
+    }
+    return error;
+}
+
+void dedup_sink::sidecar(const checksum &digest) { write_sidecar(path_, digest); }
+
+/*
+ * Write the data held in memory to a temporary file in the objects
+ * directory, the following blocks go there too.
+ */
+int dedup_sink::spill()
+{
+    static std::atomic<uint64_t> uploads{0};
+    temp_path_ = objects_ + "/upload-" + std::to_string(getpid()) + "-" + std::to_string(uploads++);
+    int const fd = open(temp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        syslog(LOG_ERR, "tftpd: open(%s) failed! %s\n", temp_path_.c_str(), strerror(errno));
+        temp_path_.clear();
+        return errno + ERRNO_OFFSET;
+    }
+    file_ = fdopen(fd, "w");
+    if (file_ == nullptr) {
+        int const error = errno + ERRNO_OFFSET;
+        (void)close(fd);
+        return error;
+    }
+    errno = 0;
+    if (!sparse_.write(file_, buffer_.data(), buffer_.size())) {
+        syslog(LOG_ERR, "tftpd: fwrite() failed! %s\n", strerror(errno));
+        return write_error();
+    }
+    std::vector<char>().swap(buffer_);
+    return 0; // OK
+}
+
+/*
+ * The object of the digest, written unless it exists already.
+ */
+int dedup_sink::store()
+{
+    auto const hex = digest_.hex();
+    std::string const directory = objects_ + "/" + hex.substr(0, 2);
+    object_ = directory + "/" + hex.substr(2);
+    int error = make_directory(directory);
+    if (error != 0) {
+        return error;
+    }
+
+    struct stat st = {};
+    if (stat(object_.c_str(), &st) == 0) {
+        syslog(LOG_NOTICE, "tftpd: %s is stored already as %s\n", path_.c_str(), object_.c_str());
+        return 0; // OK, the temporary file is removed by commit()
+    }
+    if (file_ == nullptr) {
+        error = spill();
+        if (error != 0) {
+            return error;
+        }
+    }
+    errno = 0;
+    bool const finished = sparse_.finish(file_);
+    error = fclose(file_);
+    file_ = nullptr;
+    if (!finished || error != 0) {
+        syslog(LOG_ERR, "tftpd: fclose() failed! %s\n", strerror(errno));
+        return write_error();
+    }
+    // NOTE: EEXIST if a concurrent upload of the same content was first, as good
+    if (link(temp_path_.c_str(), object_.c_str()) != 0 && errno != EEXIST) {
+        syslog(LOG_ERR, "tftpd: link(%s) failed! %s\n", object_.c_str(), strerror(errno));
+        return errno + ERRNO_OFFSET;
+    }
+    return 0; // OK
+}
+
+/*
+ * The path as a link to the object, replacing the file of an earlier
+ * upload at once.
+ */
+int dedup_sink::place() const
+{
+    std::string const temp_path = path_ + ".upload";
+    (void)unlink(temp_path.c_str());
+    if (link_ == dedup_link::reflink && clone_file(object_, temp_path)) {
+        syslog(LOG_NOTICE, "tftpd: %s cloned from %s\n", path_.c_str(), object_.c_str());
+    } else if (link(object_.c_str(), temp_path.c_str()) != 0) {
+        syslog(LOG_ERR, "tftpd: link(%s) failed! %s\n", temp_path.c_str(), strerror(errno));
+        return errno + ERRNO_OFFSET;
+    }
+    int error = 0;
+    if (rename(temp_path.c_str(), path_.c_str()) != 0) {
+        error = errno + ERRNO_OFFSET;
+        syslog(LOG_ERR, "tftpd: rename() failed! %s\n", strerror(errno));
+    }
+    // NOTE: rename(2) does nothing if the path is a link to the object already
+    (void)unlink(temp_path.c_str());
+    g_index.refresh(path_);
+    return error;
+}
+
+std::unique_ptr<compressed_sink> compressed_sink::open(const std::string &path, compression codec, int level)
+{
+    auto coder = make_encoder(codec, level);
+    if (!coder) {
+        syslog(LOG_ERR, "tftpd: compression %s not available!\n", compression_suffix(codec));
+        return nullptr;
+    }
+    std::string const target = path + compression_suffix(codec);
+    std::string const temp_path = target + ".upload";
+    FILE *file = fopen(temp_path.c_str(), "w");
+    if (file == nullptr) {
+        syslog(LOG_ERR, "tftpd: fopen(%s) failed! %s\n", temp_path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<compressed_sink>(new compressed_sink(file, target, temp_path, std::move(coder)));
+}
+
+compressed_sink::compressed_sink(FILE *file, std::string path, std::string temp_path, std::unique_ptr<encoder> codec)
+    : file_(file), path_(std::move(path)), temp_path_(std::move(temp_path)), encoder_(std::move(codec)),
+      worker_([this] { run(); })
+{}
+
+compressed_sink::~compressed_sink()
+{
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> const lock(mutex_);
+            abort_ = true;
+        }
+        ready_.notify_one();
+        worker_.join();
+    }
+    if (file_ != nullptr) {
+        (void)fclose(file_);
+        (void)unlink(temp_path_.c_str()); // NOTE: nothing of a failed upload is left
+    }
+}
+
+int compressed_sink::write(const char *data, size_t length)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (error_ != 0) {
+        return error_;
+    }
+    std::vector<char> block;
+    if (!free_.empty()) {
+        block = std::move(free_.back());
+        free_.pop_back();
+    }
+    block.assign(data, data + length);
+    queue_.push_back(std::move(block));
+    queued_ += length;
+    size_ += length;
+    bool const full = queued_ >= queue_limit;
+    lock.unlock();
+    ready_.notify_one();
+    return full ? would_block : 0;
+}
+
+bool compressed_sink::ready(bool drained, const std::function<void()> &resume)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    drained_ = drained;
+    if (is_ready()) {
+        return true;
+    }
+    resume_ = resume;
+    return false;
+}
+
+bool compressed_sink::is_ready() const
+{
+    // NOTE: on an error the session is resumed too, to fail with it
+    return error_ != 0 || (drained_ ? queued_ == 0 : queued_ < queue_limit);
+}
+
+int compressed_sink::commit()
+{
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        end_ = true;
+    }
+    ready_.notify_one();
+    worker_.join();
+    if (error_ != 0) {
+        return error_;
+    }
+
+    errno = 0;
+    auto const written = ftello(file_);
+    int const error = fclose(file_);
+    file_ = nullptr;
+    if (error != 0) {
+        syslog(LOG_ERR, "tftpd: fclose() failed! %s\n", strerror(errno));
+        (void)unlink(temp_path_.c_str());
+        return write_error();
+    }
+    compressed_size_ = (written > 0) ? static_cast<uint64_t>(written) : 0;
+    if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        syslog(LOG_ERR, "tftpd: rename() failed! %s\n", strerror(errno));
+        return errno + ERRNO_OFFSET;
+    }
+    g_index.refresh(path_);
+    syslog(LOG_NOTICE, "tftpd: %s compressed from %lu to %lu bytes\n", path_.c_str(), size_, compressed_size_);
+    return 0; // OK
+}
+
+void compressed_sink::sidecar(const checksum &digest)
+{
+    write_sidecar(path_.substr(0, path_.rfind('.')), digest); // NOTE: of the data uncompressed
+}
+
+/*
+ * The worker: compress the blocks queued until the end of the upload or
+ * its abort.
+ */
+void compressed_sink::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        ready_.wait(lock, [this] { return !queue_.empty() || end_ || abort_; });
+        if (abort_) {
+            return;
+        }
+        if (queue_.empty()) {
+            break; // NOTE: the end, all blocks are compressed
+        }
+        auto block = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        errno = 0;
+        bool const ok = encoder_->write(file_, block.data(), block.size());
+        int const error = ok ? 0 : write_error();
+        lock.lock();
+
+        queued_ -= block.size();
+        free_.push_back(std::move(block));
+        if (!ok) {
+            syslog(LOG_ERR, "tftpd: compressing %s failed! %s\n", path_.c_str(), strerror(errno));
+            error_ = error;
+        }
+        if (resume_ != nullptr && is_ready()) {
+            auto resume = std::move(resume_);
+            resume_ = nullptr;
+            lock.unlock();
+            resume(); // NOTE: the session posts it to its own thread
+            lock.lock();
+        }
+        if (!ok) {
+            return;
+        }
+    }
+    lock.unlock();
+
+    errno = 0;
+    if (!encoder_->finish(file_)) {
+        syslog(LOG_ERR, "tftpd: compressing %s failed! %s\n", path_.c_str(), strerror(errno));
+        error_ = write_error(); // NOTE: read by commit() after join()
+    }
+}
+
+callback_sink::~callback_sink()
+{
+    if (on_end_ != nullptr) {
+        on_end_(false);
+    }
+}
+
+int callback_sink::write(const char *data, size_t length)
+{
+    return on_data_(data, length) ? 0 : ENOSPACE;
+}
+
+int callback_sink::commit()
+{
+    auto on_end = std::move(on_end_);
+    on_end_ = nullptr;
+    if (on_end != nullptr) {
+        on_end(true);
+    }
+    return 0; // OK
+}
+
+} // namespace tftpd
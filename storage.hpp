@@ -0,0 +1,283 @@
+#pragma once
+
+/*
+ * Where the blocks of an upload go.
+ *
+ * tftp() opens a storage_sink for each upload request: the one returned by
+ * the storage_selector set with set_storage() for the path of the file, or
+ * the file itself.  The session writes the payload of each block to it in
+ * sequence and commits it after the last block.  A sink destroyed without
+ * commit() belongs to an upload that failed, i.e. it timed out or was
+ * aborted.
+ *
+ * The sinks are called on the thread of the session, a pipe_sink or a
+ * callback_sink which blocks stalls the other sessions of the io_context.
+ * A sink which can't keep up without blocking, i.e. the compressed_sink,
+ * returns would_block from write() instead; the session holds back the
+ * ACK of the block until ready() resumes it.
+ */
+#include "checksum.hpp"
+#include "compression.hpp"
+#include "sparse.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tftpd {
+
+class storage_sink
+{
+public:
+    virtual ~storage_sink() = default;
+
+    /// returned by write() if the block is taken, but the sink is full for now
+    static constexpr int would_block{-1};
+
+    /// the size of the upload, if the client sent a tsize, before the first block
+    virtual void expect(uint64_t /*size*/) {}
+
+    /// the payload of the next block, returns 0, would_block or the TFTP error code (or errno + 100)
+    virtual int write(const char *data, size_t length) = 0;
+
+    /// true if the sink takes blocks now, with drained if it has written all of them too, i.e. commit()
+    /// does not wait for them; else false and resume is called once later, on any thread
+    virtual bool ready(bool /*drained*/, const std::function<void()> & /*resume*/) { return true; }
+
+    /// the last block was written, returns 0 or the TFTP error code (or errno + 100)
+    virtual int commit() = 0;
+
+    /// the digest of the upload after commit() if set_checksum() selected one
+    virtual void sidecar(const checksum & /*digest*/) {}
+
+    /// the bytes the sink may buffer at most, after expect(), reserved from the admission budget
+    virtual size_t memory() const { return BUFSIZ; }
+};
+
+/// block the caller until the sink is ready(), not on the thread of a session!
+void wait_ready(storage_sink &sink, bool drained);
+
+/// the sink for the upload to the path given, nullptr to write the file
+using storage_selector = std::function<std::unique_ptr<storage_sink>(const std::string &path)>;
+
+/// the file opened by tftp(), renamed from its temporary name on commit
+///
+/// The blocks of zeros only are holes of the file, see sparse_writer.  The
+/// digest is written next to it as <path>.crc32c or <path>.sha256 in the
+/// format of sha256sum(1), i.e. for `sha256sum -c`.
+class file_sink : public storage_sink
+{
+public:
+    file_sink(FILE *file, std::string path, std::string temp_path);
+    ~file_sink() override;
+
+    file_sink(const file_sink &) = delete;
+    file_sink &operator=(const file_sink &) = delete;
+
+    int write(const char *data, size_t length) override;
+    int commit() override;
+    void sidecar(const checksum &digest) override;
+
+private:
+    FILE *file_;
+    sparse_writer sparse_;
+    std::string path_;
+    std::string temp_path_;
+};
+
+/// the upload in memory, handed to the caller on commit
+///
+/// The memory grows with the blocks received, not with the tsize the client
+/// claims.  The session reserves the limit, or the tsize if smaller, from
+/// the admission budget, an upload beyond that fails with ENOSPACE.
+class memory_sink : public storage_sink
+{
+public:
+    using chunks = std::vector<std::vector<char>>;
+
+    /// @param handler gets the data, 1 chunk if contiguous
+    /// @param chunk_size of the chunks, 0 for contiguous data
+    /// @param limit the size accepted, a larger upload fails with ENOSPACE
+    explicit memory_sink(std::function<void(chunks data)> handler, size_t chunk_size = 0, size_t limit = 16UL << 20);
+
+    void expect(uint64_t size) override { expected_ = size; }
+    int write(const char *data, size_t length) override;
+    int commit() override;
+    size_t memory() const override;
+
+private:
+    size_t bound() const { return (expected_ != 0) ? std::min<uint64_t>(expected_, limit_) : limit_; }
+
+    std::function<void(chunks)> handler_;
+    size_t chunk_size_;
+    size_t limit_;
+    uint64_t expected_{0}; // NOTE: claimed by the client, nothing is reserved for it! CK
+    size_t size_{0};
+    chunks data_;
+};
+
+/// written to a file descriptor, i.e. a pipe to a consumer
+class pipe_sink : public storage_sink
+{
+public:
+    /// @param fd closed with the sink
+    explicit pipe_sink(int fd) : fd_(fd) {}
+    ~pipe_sink() override;
+
+    pipe_sink(const pipe_sink &) = delete;
+    pipe_sink &operator=(const pipe_sink &) = delete;
+
+    int write(const char *data, size_t length) override;
+    int commit() override;
+
+private:
+    int fd_;
+};
+
+/// how the filename of an upload refers to its object in the dedup store
+enum class dedup_link
+{
+    hardlink, ///< the same inode, changes to the file change the object too!
+    reflink,  ///< a copy on write clone, a hardlink where the filesystem has none
+};
+
+/// the upload stored once by its SHA-256 in a content addressed directory
+///
+/// The object of the digest is objects/<2 hex digits>/<62 hex digits>.  An
+/// upload up to the spill size is held in memory until its digest is known,
+/// so a duplicate costs no write at all.  A larger one goes to a temporary
+/// file in the objects directory, removed if the object exists already.
+/// On commit the path becomes a link to the object, see set_dedup_store().
+class dedup_sink : public storage_sink
+{
+public:
+    dedup_sink(std::string objects, std::string path, dedup_link link, size_t spill);
+    ~dedup_sink() override;
+
+    dedup_sink(const dedup_sink &) = delete;
+    dedup_sink &operator=(const dedup_sink &) = delete;
+
+    void expect(uint64_t size) override { expected_ = size; }
+    int write(const char *data, size_t length) override;
+    int commit() override;
+    void sidecar(const checksum &digest) override;
+    size_t memory() const override { return spill_ + BUFSIZ; }
+
+    /// the object of the upload after commit()
+    const std::string &object() const { return object_; }
+
+private:
+    int spill();
+    int store();
+    int place() const;
+
+    std::string objects_;
+    std::string path_;
+    dedup_link link_;
+    size_t spill_;
+    uint64_t expected_{0};
+    checksum digest_{checksum_type::sha256};
+    std::vector<char> buffer_;
+    FILE *file_{nullptr};
+    sparse_writer sparse_;
+    std::string temp_path_; // of the spilled upload
+    std::string object_;
+};
+
+/// compressed on a worker thread to <path>.zst or <path>.gz
+///
+/// The session queues the blocks to the worker, which compresses them to
+/// <path>.zst.upload; commit() finishes the file and renames it.  A block
+/// which fills the queue is taken with would_block, the session answers it
+/// once the worker caught up.  Before commit() the session waits for the
+/// queue drained, so only the end of the compressed frame is written on its
+/// thread.  The digest is written as for a file_sink, of the uncompressed data.
+/// Not for a simulated session, it has no thread the worker could resume it on.
+///
+/// i.e. per directory:
+///     set_storage([](const std::string &path) -> std::unique_ptr<storage_sink> {
+///         if (path.rfind("/srv/tftp/logs/", 0) == 0) {
+///             return compressed_sink::open(path, compression::zstd);
+///         }
+///         return nullptr;
+///     });
+class compressed_sink : public storage_sink
+{
+public:
+    /// @param level of the codec, 0 for its default
+    /// @return nullptr if the codec is not available or the file can't be created
+    static std::unique_ptr<compressed_sink> open(const std::string &path, compression codec, int level = 0);
+    ~compressed_sink() override;
+
+    compressed_sink(const compressed_sink &) = delete;
+    compressed_sink &operator=(const compressed_sink &) = delete;
+
+    int write(const char *data, size_t length) override;
+    bool ready(bool drained, const std::function<void()> &resume) override;
+    int commit() override;
+    void sidecar(const checksum &digest) override;
+    size_t memory() const override { return queue_limit + BUFSIZ; }
+
+    /// the bytes of the upload and of the file written, after commit()
+    uint64_t size() const { return size_; }
+    uint64_t compressed_size() const { return compressed_size_; }
+
+private:
+    compressed_sink(FILE *file, std::string path, std::string temp_path, std::unique_ptr<encoder> codec);
+    void run();
+    bool is_ready() const; // NOTE: with the mutex locked
+
+    static constexpr size_t queue_limit{1UL << 20}; // bytes
+
+    FILE *file_;
+    std::string path_; // with the suffix
+    std::string temp_path_;
+    std::unique_ptr<encoder> encoder_;
+    std::mutex mutex_;
+    std::condition_variable ready_; // for the worker
+    std::function<void()> resume_;  // of the session, called by the worker
+    bool drained_{false};           // waited for by resume_
+    std::deque<std::vector<char>> queue_;
+    std::vector<std::vector<char>> free_; // NOTE: the buffers of the blocks are reused
+    size_t queued_{0};
+    bool end_{false};
+    bool abort_{false};
+    int error_{0}; // of the worker
+    uint64_t size_{0};
+    uint64_t compressed_size_{0};
+    std::thread worker_;
+};
+
+/// handed to a function block by block
+class callback_sink : public storage_sink
+{
+public:
+    /// @param on_data false to abort the upload with ENOSPACE
+    /// @param on_end true after the last block, false if the upload failed
+    callback_sink(std::function<bool(const char *data, size_t length)> on_data, std::function<void(bool)> on_end)
+        : on_data_(std::move(on_data)), on_end_(std::move(on_end))
+    {}
+    ~callback_sink() override;
+
+    callback_sink(const callback_sink &) = delete;
+    callback_sink &operator=(const callback_sink &) = delete;
+
+    int write(const char *data, size_t length) override;
+    int commit() override;
+
+private:
+    std::function<bool(const char *, size_t)> on_data_;
+    std::function<void(bool)> on_end_;
+};
+
+} // namespace tftpd
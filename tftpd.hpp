@@ -16,16 +16,30 @@
  *
  * See copyright notice at: @(#)tftpd/tftpd.c	5.13 (Berkeley) 2/26/91
  */
+#include "admission.hpp"
+#include "async_tftpd_server.hpp"
+#include "file_cache.hpp"
+#include "packet_pool.hpp"
+#include "policies.hpp"
+#include "rate_limiter.hpp"
+#include "request_table.hpp"
+#include "root_index.hpp"
 #include "tftp/tftpsubs.h"
+#include "tftpd_options.hpp"
+#include "timer_wheel.hpp"
+#include "transport.hpp"
+#include "virtual_files.hpp"
 
+#include <boost/asio/post.hpp>
 #include <boost/asio/ts/buffer.hpp>
 #include <boost/asio/ts/internet.hpp>
 #include <boost/current_function.hpp>
 
-#include <atomic>
+#include <array>
 #include <chrono>
 #include <cstdlib>
 #include <cstring> // strncpy still used! CK
+#include <system_error>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -36,14 +50,25 @@
 #include <vector>
 
 namespace tftpd {
-extern off_t g_tsize;
-extern uintmax_t g_segsize;
-extern uintmax_t g_timeout;   // NOTE: 1 s as ms! CK
-extern const char *g_rootdir; // the only tftp root dir used!
+extern const char *g_rootdir; // of the sessions not given their own by serve_from()
 extern std::function<void(size_t)> g_callback;
-
-int validate_access(std::string &filename, int mode, FILE *&file);
-int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path, std::vector<char> &optack);
+extern report_sink g_report; // of the sessions not given their own by serve_from()
+extern impairment g_impairment; // NOTE: for tests and benchmarks only! CK
+extern rate_limiter g_limiter;   // of all requests received
+extern request_table g_requests; // in flight
+extern admission g_admission;    // of the sessions
+extern packet_pool g_packets;
+extern storage_selector g_storage; // of the uploads, nullptr for files
+extern checksum_type g_checksum;   // of the uploads
+extern dedup_store g_dedup;
+extern file_cache g_files; // of the downloads
+extern virtual_files g_providers;
+
+int validate_access(std::string &filename, int mode, const std::string &rootdir, std::unique_ptr<storage_sink> &sink,
+                    content_ptr *source);
+int tftp(const std::vector<char> &rxbuffer, std::unique_ptr<storage_sink> &sink, std::string &file_path,
+         std::vector<char> &optack, session_options &negotiated, const std::string &rootdir,
+         content_ptr *source = nullptr);
 
 constexpr int TIMEOUT{1};
 constexpr int rexmtval{TIMEOUT};
@@ -70,34 +95,128 @@ static const errmsg errmsgs[] = {{EUNDEF, "Undefined error code"},
 using boost::asio::ip::udp;
 //----------------------------------------------------------------------
 
-class server
+/*
+ * The request handling and timeouts of a session, the Session derived
+ * from it answers the request with the transfer (CRTP).
+ */
+template <typename Session, typename Logger> class basic_server
 {
 public:
-    server(boost::asio::io_context &io_context, uint16_t port)
-        : socket_(io_context, udp::endpoint(udp::v4(), port)), timer_(io_context), timeout_(rexmtval)
+    basic_server(boost::asio::io_context &io_context, uint16_t port)
+        : udp_(std::make_unique<udp_transport>(io_context, udp::endpoint(udp::v4(), port))),
+          impaired_(g_impairment.enabled() ? std::make_unique<impaired_transport>(io_context, *udp_, g_impairment)
+                                           : nullptr),
+          wheel_timer_(std::make_unique<wheel_session_timer>(io_context)),
+          socket_(impaired_ ? *impaired_ : static_cast<datagram_transport &>(*udp_)), timer_(*wheel_timer_),
+          io_context_(&io_context), timeout_(rexmtval)
+    {
+        start_timeout(maxtimeout); // max idle wait ...
+        do_receive();
+    }
+
+    /// listen on the given transport and run the timeouts on the given
+    /// timer, i.e. in a simulation with virtual time
+    basic_server(datagram_transport &transport, session_timer &timer)
+        : socket_(transport), timer_(timer), timeout_(rexmtval)
     {
         start_timeout(maxtimeout); // max idle wait ...
         do_receive();
     }
 
-    virtual ~server() = default;
+    ~basic_server()
+    {
+        g_admission.release(ticket_);
+        if (claimed_) {
+            g_requests.release(peer_, request_);
+        }
+    }
 
-    server(const server &) = delete;
-    void operator=(const server &) = delete;
+    basic_server(const basic_server &) = delete;
+    void operator=(const basic_server &) = delete;
 
-    server(server &&) = delete;
-    server &operator=(server &&) = delete;
+    basic_server(basic_server &&) = delete;
+    basic_server &operator=(basic_server &&) = delete;
 
     std::string get_filename() { return file_path_; }
 
+    /// the session ended, no handler of it is pending any more
+    bool done() const { return done_; }
+
+    /// how the session ended: timed_out, operation_canceled after an ERROR
+    /// sent or connection_aborted by an ERROR received, empty on success
+    std::error_code error() const { return error_; }
+
+    /// wait for a request without the idle timeout, as a daemon does
+    void listen_forever() { timer_.cancel(); }
+
+    /// answer a download (RRQ) too, else it is refused with EBADOP
+    void serve_downloads(bool enabled) { downloads_ = enabled; }
+
+    /// serve the files of the rootdir and hand the transfer_report to the report sink,
+    /// else those of g_rootdir and g_report are used
+    void serve_from(std::string rootdir, report_sink report)
+    {
+        rootdir_ = std::move(rootdir);
+        report_sink_ = std::move(report);
+    }
+
+    /// end the session with operation_canceled
+    void stop() { complete(std::make_error_code(std::errc::operation_canceled)); }
+
+    /// called once the request port is free for the next listener, i.e.
+    /// the session moved to its own TID or ended
+    void on_port_released(std::function<void()> handler) { port_released_ = std::move(handler); }
+
+    /// called once the session ended, with error()
+    /// @note posted to the io_context, a simulated session calls it inline
+    void on_complete(std::function<void(std::error_code)> handler) { completion_ = std::move(handler); }
+
 protected:
-    void cancel_timeout() { timer_.cancel(); }
+    session_timer::clock_type::time_point now() const { return timer_.now(); }
+
+    /*
+     * End the session in place with the error given: the timer and the
+     * socket are canceled, so the handlers pending run out.  Other sessions
+     * on the same io_context are not affected.
+     */
+    void complete(std::error_code error = {})
+    {
+        if (done_) {
+            return;
+        }
+        Logger::log(LOG_NOTICE, "%s(%s)\n", BOOST_CURRENT_FUNCTION, error.message().c_str());
+
+        done_ = true;
+        error_ = error;
+        timer_.cancel();
+        if (socket_.is_open()) {
+            socket_.close();
+        }
+        release_port();
+
+        // NOTE: after the handlers canceled, the session may be destroyed by it
+        if (completion_ != nullptr) {
+            dispatch([completion = std::move(completion_), error] { completion(error); });
+            completion_ = nullptr;
+        }
+    }
+
+    void release_port()
+    {
+        if (port_released_ != nullptr) {
+            dispatch(std::move(port_released_));
+            port_released_ = nullptr;
+        }
+    }
 
     void restart_timeout() { start_timeout(rexmtval); }
 
+    /// NOTE: maxtimeout counts the timeouts in a row, not those of the whole transfer
+    void reset_timeout() { timeout_ = rexmtval; }
+
     void start_last_timeout()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         start_timeout(rexmtval);
         timeout_ = maxtimeout; // NOTE: Normally times out and quits
@@ -106,52 +225,206 @@ protected:
 
     void start_timeout(size_t seconds)
     {
-        syslog(LOG_NOTICE, "%s(%lu)\n", BOOST_CURRENT_FUNCTION, seconds);
+        Logger::log(LOG_NOTICE, "%s(%lu)\n", BOOST_CURRENT_FUNCTION, seconds);
 
         timer_.cancel();
         timer_.expires_after(std::chrono::seconds(seconds));
-        timer_.async_wait([this](const std::error_code &error) {
-            // Cancel all asynchronous operations associated with the socket.
-            if (!error) {
-                timeout_ += rexmtval;
-                if (!last_timeout_) {
-                    syslog(LOG_WARNING, "tftpd: timeout\n");
-                }
-                if (socket_.is_open()) {
-                    socket_.cancel();
-                    if (timeout_ >= maxtimeout) {
-                        socket_.close();
-                        if (!last_timeout_) {
-                            syslog(LOG_ERR, "tftpd: maxtimeout!\n");
-                            throw std::system_error(std::make_error_code(std::errc::timed_out));
-                        }
-                    }
+        timer_.async_wait([this](const boost::system::error_code &error) {
+            if (error || done_) {
+                return;
+            }
+            if (!claimed_) {
+                complete(); // NOTE: idle, no request received
+                return;
+            }
+            if (waiting_ && g_admission.dequeue(ticket_)) {
+                Logger::log(LOG_WARNING, "tftpd: no session for the request in time\n");
+                start_report();
+                send_error(EUNDEF, "Server busy");
+                return;
+            }
+            timeout_ += rexmtval;
+            if (!last_timeout_) {
+                Logger::log(LOG_WARNING, "tftpd: timeout\n");
+            }
+            if (timeout_ >= maxtimeout) {
+                if (last_timeout_) {
+                    complete(); // NOTE: Normally the final ack was not lost
+                } else {
+                    Logger::log(LOG_ERR, "tftpd: maxtimeout!\n");
+                    finish_report(transfer_status::timeout);
+                    complete(std::make_error_code(std::errc::timed_out));
                 }
+            } else if (socket_.is_open()) {
+                // Cancel all asynchronous operations associated with the socket.
+                socket_.cancel();
             }
         });
     }
 
-    virtual std::shared_ptr<FILE> start_recvfile(const udp::endpoint &senderEndpoint_, FILE *&file,
-                                                 const std::vector<char> &optack) = 0;
+    /*
+     * The Session provides:
+     *   void start_recvfile(const udp::endpoint &, std::unique_ptr<storage_sink>, const std::vector<char> &optack)
+     *   void start_sendfile(const udp::endpoint &, content_ptr, const std::vector<char> &optack)
+     *   void answer_again()                        the peer sent its request again
+     *   size_t session_memory(size_t blksize, const storage_sink *sink) const
+     *                                              the buffer memory, linear in the blksize, with that of the
+     *                                              sink of an upload, of a file if nullptr
+     */
+    Session &session() { return static_cast<Session &>(*this); }
+    const Session &session() const { return static_cast<const Session &>(*this); }
+
+    /// run a function on the thread of this session
+    void dispatch(std::function<void()> function)
+    {
+        if (io_context_ != nullptr) {
+            boost::asio::post(*io_context_, std::move(function));
+        } else {
+            function(); // NOTE: all sessions run on the caller's thread
+        }
+    }
+
+    /// the function to call from any thread, run on the thread of this session if it is still there
+    std::function<void()> later(std::function<void()> function)
+    {
+        return [this, alive = std::weak_ptr<bool>(alive_), function = std::move(function)] {
+            dispatch([alive, function] {
+                if (!alive.expired()) {
+                    function();
+                }
+            });
+        };
+    }
+
+    /*
+     * Claim the request received, false if a session started by it is
+     * running already; that one is asked to answer again, on its own thread.
+     */
+    bool claim_request()
+    {
+        peer_ = senderEndpoint_;
+        request_ = rxdata_;
+        claimed_ = g_requests.claim(peer_, request_, [this, alive = std::weak_ptr<bool>(alive_)] {
+            dispatch([this, alive] {
+                if (!alive.expired()) {
+                    session().answer_again();
+                }
+            });
+        });
+        return claimed_;
+    }
+
+    /*
+     * Reserve the memory of the session, false if the request has to wait
+     * for another session to end or is refused.
+     */
+    bool admit_request()
+    {
+        switch (g_admission.acquire(ticket_, session().session_memory(SEGSIZE, nullptr),
+                                    session().session_memory(max_segsize, nullptr),
+                                    [this, alive = std::weak_ptr<bool>(alive_)] {
+                                        dispatch([this, alive] {
+                                            if (!alive.expired()) {
+                                                start_request();
+                                            }
+                                        });
+                                    })) {
+        case admission::verdict::admitted:
+            return true;
+        case admission::verdict::queued:
+            Logger::log(LOG_WARNING, "tftpd: busy, request queued\n");
+            // NOTE: the request port is free for the next listener while waiting
+            if (!rebind()) {
+                (void)g_admission.dequeue(ticket_);
+                return false;
+            }
+            waiting_ = true;
+            start_timeout(maxtimeout); // max wait for a session ...
+            return false;
+        case admission::verdict::refused:
+            break;
+        }
+        Logger::log(LOG_WARNING, "tftpd: busy, request refused\n");
+        start_report();
+        send_error(EUNDEF, "Server busy");
+        return false;
+    }
+
+    /*
+     * Move the session to its own TID and free the request port for the next
+     * listener.  If no port is left, only this session ends with an ERROR,
+     * sent from the request port still bound.
+     */
+    bool rebind()
+    {
+        boost::system::error_code ec;
+        socket_.rebind(ec);
+        if (ec) {
+            Logger::log(LOG_ERR, "tftpd: rebind: %s\n", ec.message().c_str());
+            if (!reporting_) {
+                start_report();
+            }
+            send_error(ec.value() + ERRNO_OFFSET);
+            return false;
+        }
+        release_port();
+        return true;
+    }
+
+    void start_request()
+    {
+        bool const queued = waiting_;
+        waiting_ = false;
+
+        // NOTE: the blksize is negotiated down to what the memory reserved allows
+        size_t const fixed = session().session_memory(0, nullptr);
+        options_.max_segsize = std::min<uintmax_t>(
+            max_segsize, (ticket_.memory - fixed) / (session().session_memory(1, nullptr) - fixed));
+        std::unique_ptr<storage_sink> sink;
+        content_ptr source;
+        int const error = tftp(rxdata_, sink, file_path_, optack_, options_, rootdir_.empty() ? g_rootdir : rootdir_,
+                               downloads_ ? &source : nullptr);
+
+        start_report();
+        if (error != 0) {
+            send_error(error);
+        } else if (!sink && !source) {
+            complete(); // NOTE: access denied silently
+        } else if (!g_admission.resize(ticket_, session().session_memory(options_.segsize, sink.get()))) {
+            // NOTE: the memory of the sink is known once it is opened, i.e. a memory_sink
+            Logger::log(LOG_WARNING, "tftpd: the memory of the upload exceeds the budget left\n");
+            send_error(ENOSPACE);
+        } else {
+            if (!queued && !rebind()) { // NOTE: a request queued has its own TID already
+                return;
+            }
+            if (source) {
+                session().start_sendfile(senderEndpoint_, std::move(source), optack_);
+            } else {
+                session().start_recvfile(senderEndpoint_, std::move(sink), optack_);
+            }
+        }
+    }
 
     void do_receive()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         rxdata_.resize(PKTSIZE);
         socket_.async_receive_from(boost::asio::buffer(rxdata_, PKTSIZE), senderEndpoint_,
                                    [this](std::error_code ec, std::size_t bytes_recvd) {
-                                       if (!ec && bytes_recvd > 0) {
+                                       if (!ec && bytes_recvd > 0 && !done_) {
+                                           if (!g_limiter.admit(senderEndpoint_.address(), now())) {
+                                               do_receive(); // NOTE: dropped unparsed, the idle timer runs on
+                                               return;
+                                           }
                                            rxdata_.resize(bytes_recvd);
-                                           FILE *file = nullptr;
-                                           int const error = tftp(rxdata_, file, file_path_, optack_);
-                                           if (error != 0) {
-                                               send_error(error);
-                                           } else {
-                                               socket_.close();
-                                               socket_.open(udp::v4());
-                                               socket_.bind(udp::endpoint(udp::v4(), 0));
-                                               file_guard_ = start_recvfile(senderEndpoint_, file, optack_);
+                                           if (!claim_request()) {
+                                               do_receive(); // NOTE: a retransmitted request
+                                               return;
+                                           }
+                                           if (admit_request()) {
+                                               start_request();
                                            }
                                        }
                                    });
@@ -163,28 +436,30 @@ protected:
      * Send a nak packet (error message).  Error code passed in is one of the
      * standard TFTP codes, or a UNIX errno offset by ERRNO_OFFSET(100).
      */
-    void send_error(int error)
+    void send_error(int error, const char *message = nullptr)
     {
         const struct errmsg *pe = nullptr;
-        std::vector<char> txbuf;
-        txbuf.resize(PKTSIZE);
+        txbuf_ = g_packets.get(SEGSIZE);
+        txbuf_.resize(PKTSIZE);
         std::string err_msg;
 
-        auto *tp = reinterpret_cast<struct tftphdr *>(txbuf.data());
+        auto *tp = reinterpret_cast<struct tftphdr *>(txbuf_.data());
         tp->th_opcode = htons(static_cast<u_short>(ERROR));
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
         tp->th_code = htons(static_cast<u_short>(error));
         for (pe = errmsgs; pe->e_code >= 0; pe++) {
             if (pe->e_code == error) {
                 err_msg = pe->e_msg;
-                syslog(LOG_ERR, "tftpd: send_error(%d): %s\n", error, err_msg.c_str());
+                Logger::log(LOG_ERR, "tftpd: send_error(%d): %s\n", error, err_msg.c_str());
                 break;
             }
         }
 
-        if (pe->e_code < 0) {
+        if (message != nullptr) {
+            err_msg = message;
+        } else if (pe->e_code < 0) {
             err_msg = strerror(error - ERRNO_OFFSET);
-            syslog(LOG_ERR, "tftpd: send_error(%d): %s\n", (error - ERRNO_OFFSET), err_msg.c_str());
+            Logger::log(LOG_ERR, "tftpd: send_error(%d): %s\n", (error - ERRNO_OFFSET), err_msg.c_str());
             // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
             tp->th_code = htons(static_cast<u_short>(EUNDEF)); /* set 'eundef(0)' errorcode */
         }
@@ -196,85 +471,212 @@ protected:
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
         (void)strncpy(tp->th_msg, err_msg.c_str(), length);
 
-        txbuf.resize(std::min(length, static_cast<size_t>(PKTSIZE)));
+        txbuf_.resize(std::min(length, static_cast<size_t>(PKTSIZE)));
 
-        do_send_error(txbuf);
+        finish_report(transfer_status::error_sent, error, err_msg);
+        do_send_error();
     }
 
-    void do_send_error(const std::vector<char> &txdata)
+    void do_send_error()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
-        socket_.async_send_to(boost::asio::buffer(txdata), senderEndpoint_,
+        socket_.async_send_to(boost::asio::buffer(txbuf_.data(), txbuf_.size()), senderEndpoint_,
                               [this](std::error_code /*ec*/, std::size_t /*bytes_sent*/) {
-                                  // XXX if (ec) { syslog(LOG_ERR, "do_send_error: %s\n", ec.message().c_str()); }
-                                  // TODO: now we have no timer running, the run loop terminates
-                                  timer_.cancel();
-                                  throw std::system_error(std::make_error_code(std::errc::operation_canceled));
+                                  // XXX if (ec) { Logger::log(LOG_ERR, "do_send_error: %s\n", ec.message().c_str()); }
+                                  complete(std::make_error_code(std::errc::operation_canceled));
                               });
     }
 
-    udp::socket socket_;               // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
+    /*
+     * Begin the summary record of a transfer, called when a request arrived.
+     */
+    void start_report()
+    {
+        started_ = now();
+        report_ = transfer_report{};
+        report_.peer_address = senderEndpoint_.address().to_string();
+        report_.peer_port = senderEndpoint_.port();
+        report_.filename = file_path_;
+        report_.blksize = options_.segsize;
+        report_.timeout_ms = options_.timeout;
+        reporting_ = true;
+    }
+
+    /*
+     * Complete the summary record and hand it to the report sink (only once).
+     */
+    void finish_report(transfer_status status, int error = 0, const std::string &message = {})
+    {
+        if (!reporting_) {
+            return;
+        }
+        reporting_ = false;
+
+        report_.duration = std::chrono::duration_cast<std::chrono::microseconds>(now() - started_);
+        if (report_.duration.count() > 0) {
+            std::chrono::duration<double> const seconds = report_.duration;
+            report_.throughput = static_cast<double>(report_.bytes) / seconds.count();
+        }
+        report_.status = status;
+        report_.error = error;
+        report_.error_message = message;
+
+        report_sink const &sink = report_sink_ ? report_sink_ : g_report;
+        if (sink != nullptr) {
+            sink(report_);
+        }
+    }
+
+private:
+    // NOTE: only used if no transport and timer are given to the constructor
+    std::unique_ptr<udp_transport> udp_;
+    std::unique_ptr<impaired_transport> impaired_;
+    std::unique_ptr<wheel_session_timer> wheel_timer_;
+
+protected:
+    datagram_transport &socket_;       // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
     udp::endpoint senderEndpoint_;     // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
-    std::shared_ptr<FILE> file_guard_; // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
     std::string file_path_;            // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
     std::vector<char> optack_;         // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
+    session_options options_;          // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
+    transfer_report report_;           // NOLINT(cppcoreguidelines-non-private-member-variables-in-classes)
 
 private:
-    boost::asio::steady_timer timer_;
+    session_timer &timer_;
+    boost::asio::io_context *io_context_{nullptr}; // of the transport, if owned
     std::vector<char> rxdata_;
+    packet_buffer txbuf_; // of the ERROR sent
+    udp::endpoint peer_;        // of the request claimed
+    std::vector<char> request_; // claimed
+    bool claimed_{false};
+    admission::ticket ticket_;
+    bool waiting_{false}; // for admission
+    bool downloads_{false};
+    std::string rootdir_;     // empty for g_rootdir
+    report_sink report_sink_; // nullptr for g_report
     int timeout_;
     bool last_timeout_{false};
+    bool reporting_{false};
+    session_timer::clock_type::time_point started_;
+    bool done_{false};
+    std::error_code error_;
+    std::function<void()> port_released_;
+    std::function<void(std::error_code)> completion_;
+    // NOTE: the handlers posted from other threads hold it weak, the session may be gone when they run
+    std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
 };
 
-class receiver : public server
+/*
+ * The session of a transfer, with the storage of the blocks uploaded, the
+ * progress sink and the logger as compile time policies, see policies.hpp.
+ * A download is sent lock step (RFC1350) from the file_cache.
+ */
+template <typename Storage, typename Progress, typename Logger>
+class basic_receiver final : public basic_server<basic_receiver<Storage, Progress, Logger>, Logger>
 {
+    using base = basic_server<basic_receiver<Storage, Progress, Logger>, Logger>;
+
 public:
-    receiver(boost::asio::io_context &io_context, uint16_t port) : server(io_context, port) {}
+    basic_receiver(boost::asio::io_context &io_context, uint16_t port) : base(io_context, port) {}
+    basic_receiver(datagram_transport &transport, session_timer &timer) : base(transport, timer) {}
+
+    using base::done;
 
-    std::shared_ptr<FILE> start_recvfile(const udp::endpoint &senderEndpoint, FILE *&file,
-                                         const std::vector<char> &optack) override
+    void start_recvfile(const udp::endpoint &senderEndpoint, std::unique_ptr<storage_sink> sink,
+                        const std::vector<char> &optack)
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         clientEndpoint_ = senderEndpoint;
-        std::shared_ptr<FILE> file_guard(file, std::fclose);
         block = 0;
-        dp_ = w_init(); // get first data buffer ptr
+        storage_.open(std::move(sink));
+        digest_ = checksum(g_checksum);
+        progress_.start(static_cast<uint64_t>(options_.tsize));
+        rxpkt_ = g_packets.get(options_.segsize);
+        rxpkt_.resize(TFTP_HEADER + options_.segsize);
+        dp_ = reinterpret_cast<struct tftphdr *>(rxpkt_.data());
         if (optack.empty()) {
+            answer_length_ = TFTP_HEADER;
             send_ack();
         } else {
             memcpy(ackbuf_, optack.data(), optack.size());
+            answer_length_ = optack.size();
             block++;
             send_ackbuf(optack.size());
         }
+    }
+
+    void start_sendfile(const udp::endpoint &receiverEndpoint, content_ptr source, const std::vector<char> &optack)
+    {
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+
+        clientEndpoint_ = receiverEndpoint;
+        source_ = std::move(source);
+        report_.download = true;
+        progress_.start(static_cast<uint64_t>(options_.tsize));
+        txpkt_ = g_packets.get(options_.segsize);
+        if (optack.empty()) {
+            answer_length_ = 0; // NOTE: DATA 1 is the answer, sent again on timeout
+            block = 1;
+        } else {
+            memcpy(ackbuf_, optack.data(), optack.size());
+            answer_length_ = optack.size();
+            block = 0;
+        }
+        send_block();
+    }
+
+    /*
+     * The OACK or ACK 0 in ackbuf_ may be lost, send it again as long as
+     * no DATA block was written (or acknowledged).
+     */
+    void answer_again()
+    {
+        if (answer_length_ == 0 || report_.blocks > 0 || !socket_.is_open()) {
+            return;
+        }
+        Logger::log(LOG_WARNING, "tftpd: request retransmitted, answer again\n");
+        report_.retransmits++;
+        socket_.send_to(boost::asio::buffer(ackbuf_, answer_length_), clientEndpoint_);
+    }
 
-        return file_guard;
+    size_t session_memory(size_t blksize, const storage_sink *sink) const
+    {
+        // NOTE: the buffers of the storage, the block received and the blocks held back
+        return sizeof(*this) + storage_.memory(sink) + (1 + reorder_slots) * blksize;
     }
 
     void send_ack()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         auto *ap = reinterpret_cast<struct tftphdr *>(ackbuf_); /* ptr to ack buffer */
         ap->th_opcode = htons(static_cast<u_short>(ACK));
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-        ap->th_block = htons(static_cast<u_short>(block));
+        ap->th_block = htons(wire(block));
         block++;
         send_ackbuf();
     }
 
-    void send_ackbuf(size_t length = TFTP_HEADER)
+    void send_ackbuf(size_t length = TFTP_HEADER, bool rexmit = false)
     {
-        syslog(LOG_NOTICE, "%s(%lu)\n", BOOST_CURRENT_FUNCTION, length);
+        Logger::log(LOG_NOTICE, "%s(%lu)\n", BOOST_CURRENT_FUNCTION, length);
 
-        // output the current buffer if needed
-        (void)write_behind(file_guard_.get(), false);
+        // NOTE: only a fresh ack gives a valid rtt sample (Karn's algorithm)
+        ack_sent_ = now();
+        rtt_sample_ = !rexmit;
+        if (rexmit) {
+            report_.retransmits++;
+        }
 
         socket_.async_send_to(boost::asio::buffer(ackbuf_, length), clientEndpoint_,
                               [this](std::error_code ec, std::size_t /*bytes_sent*/) {
+                                  if (done()) {
+                                      return;
+                                  }
                                   if (ec) {
-                                      syslog(LOG_ERR, "tftpd: send_ackbuf: %s\n", ec.message().c_str());
+                                      Logger::log(LOG_ERR, "tftpd: send_ackbuf: %s\n", ec.message().c_str());
                                   } else {
                                       receive_block();
                                   }
@@ -283,14 +685,17 @@ public:
 
     void receive_block()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         // Run an asynchronous read operation with a timeout.
         restart_timeout();
-        socket_.async_receive_from(boost::asio::buffer(dp_, MAXPKTSIZE), clientEndpoint_,
+        socket_.async_receive_from(boost::asio::buffer(rxpkt_.data(), rxpkt_.size()), clientEndpoint_,
                                    [this](std::error_code ec, std::size_t bytes_recvd) {
+                                       if (done()) {
+                                           return;
+                                       }
                                        if (ec) {
-                                           syslog(LOG_ERR, "tftpd: read data: %s\n", ec.message().c_str());
+                                           Logger::log(LOG_ERR, "tftpd: read data: %s\n", ec.message().c_str());
                                            receive_block();
                                        } else {
                                            int const err = check_and_write_block(bytes_recvd);
@@ -303,12 +708,11 @@ public:
 
     int check_and_write_block(size_t rxlen)
     {
-        const uint16_t tmp = block;
-        syslog(LOG_NOTICE, "%s(%u, len=%lu)\n", BOOST_CURRENT_FUNCTION, tmp, rxlen);
+        Logger::log(LOG_NOTICE, "%s(%u, len=%lu)\n", BOOST_CURRENT_FUNCTION, wire(block), rxlen);
 
 #if 0
         if (senderEndpoint_ != clientEndpoint_) {
-            syslog(LOG_WARNING, "tftpd: Invalid endpoint ID!\n");
+            Logger::log(LOG_WARNING, "tftpd: Invalid endpoint ID!\n");
             return (EBADID);    // FIXME: this aborts running tftp Operation! CK
         }
 #endif
@@ -320,39 +724,36 @@ public:
             // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
             dp_->th_block = ntohs(dp_->th_block);
             if (dp_->th_opcode == ERROR) {
-                syslog(LOG_ERR, "tftpd: ERROR received, abort Operation!\n");
+                Logger::log(LOG_ERR, "tftpd: ERROR received, abort Operation!\n");
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+                std::string const msg(dp_->th_msg, strnlen(dp_->th_msg, rxlen - TFTP_HEADER));
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+                finish_report(transfer_status::error_received, dp_->th_code, msg);
+                complete(std::make_error_code(std::errc::connection_aborted));
                 return 0; // OK
             }
 
             if (dp_->th_opcode == DATA) {
                 // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-                if (dp_->th_block == block) {
-                    if (g_tsize != 0) { // NOTE: prevent division by zero! CK
-                        size_t const percent = 100UL * (block * g_segsize) / g_tsize;
-                        if (percent != percent_) {
-                            syslog(LOG_NOTICE, "tftpd: Progress: %lu%% received\n", percent);
-                            percent_ = percent;
-                            if (g_callback != nullptr) {
-                                if ((percent % 10) == 0) {
-                                    g_callback(percent);
-                                }
-                            }
-                        }
-                    }
+                if (dp_->th_block == wire(block)) {
+                    reset_timeout();
+                    update_rtt();
                     break; /* normal */
                 }
 
-                // ==============================================
-                synchnet(); // Re-synchronize with the other side
-                // ==============================================
-
                 // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-                if (dp_->th_block == (block - 1)) {
-                    send_ackbuf(); /* rexmit => send last ack buf again */
-                    return 0;      // OK
+                if (block > 0 && dp_->th_block == wire(block - 1)) {
+                    report_.duplicates++;
+                    send_ackbuf(TFTP_HEADER, true); /* rexmit => send last ack buf again */
+                    return 0;                       // OK
                 }
+
+                // NOTE: keep a block ahead of sequence, drop any other one
+                hold_block(rxlen - TFTP_HEADER);
+                receive_block();
+                return 0; // OK
             } else {
-                syslog(LOG_ERR, "tftpd: Invalid opcode, DATA expected!\n");
+                Logger::log(LOG_ERR, "tftpd: Invalid opcode, DATA expected!\n");
                 return (EBADID);
             }
         } while (false);
@@ -360,49 +761,93 @@ public:
         // ===============================
         // write the current data segment
         // ===============================
-        size_t const seg_length = rxlen - TFTP_HEADER;
-        ssize_t written = writeit(file_guard_.get(), &dp_, seg_length, false);
-        if (written != static_cast<ssize_t>(seg_length)) { /* ahem */
-            int error = ENOSPACE;
-            if (written < 0) {
-                syslog(LOG_ERR, "tftpd: writeit() failed! %s\n", strerror(errno));
-                error = (errno + ERRNO_OFFSET);
-            }
+        storage_full_ = false;
+        size_t seg_length = rxlen - TFTP_HEADER;
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        int error = write_segment(dp_->th_data, seg_length);
+        if (error != 0) {
             return (error);
         }
 
-        if (seg_length == g_segsize) {
-            send_ack();
+        // then the blocks held back which follow without a gap
+        reorder_[block % reorder_slots].valid = false;
+        while (seg_length == options_.segsize) {
+            auto &held = reorder_[(block + 1) % reorder_slots];
+            if (!held.valid || held.block != block + 1) {
+                break;
+            }
+            block++;
+            held.valid = false;
+            seg_length = held.data.size();
+            error = write_segment(held.data.data(), seg_length);
+            if (error != 0) {
+                return (error);
+            }
+        }
+
+        if (seg_length == options_.segsize) {
+            if (!storage_full_ || storage_.ready(false, resume_storage(false))) {
+                send_ack();
+            }
             return 0; // OK
         }
+        if (storage_.ready(true, resume_storage(true))) {
+            return commit_upload();
+        }
+        return 0; // OK
+    }
+
+    /*
+     * Answer the blocks written once the storage took them, see storage.hpp:
+     * the ACK, or the final one after the upload is committed.
+     */
+    std::function<void()> resume_storage(bool last)
+    {
+        return later([this, last] {
+            if (done()) {
+                return;
+            }
+            if (!last) {
+                send_ack();
+                return;
+            }
+            int const error = commit_upload();
+            if (error != 0) {
+                send_error(error);
+            }
+        });
+    }
 
+    int commit_upload()
+    {
         // =======================================================
         // write the final data segment
-        written = write_behind(file_guard_.get(), false);
-        if (written >= 0) {
-            std::string const old_path(file_path_ + ".upload");
-            (void)rename(old_path.c_str(), file_path_.c_str());
-            syslog(LOG_NOTICE, "tftpd: successfully received file: %s\n", file_path_.c_str());
-        } else {
-            syslog(LOG_ERR, "tftpd: write_behind() failed! %s\n", strerror(errno));
-            return (ENOSPACE);
+        int const error = storage_.commit();
+        if (error != 0) {
+            return (error);
+        }
+        if (digest_.type() != checksum_type::none) {
+            report_.checksum = std::string(checksum_name(digest_.type())) + ":" + digest_.hex();
+            storage_.sidecar(digest_);
         }
+        Logger::log(LOG_NOTICE, "tftpd: successfully received file: %s\n", file_path_.c_str());
         // =======================================================
 
         send_last_ack();
+        finish_report(transfer_status::success);
 
         return 0; // OK
     }
 
     void send_last_ack()
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
 
         auto *ap = reinterpret_cast<struct tftphdr *>(ackbuf_); /* ptr to ack buffer */
         ap->th_opcode = htons(static_cast<u_short>(ACK));       /* send the "final" ack */
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-        ap->th_block = htons(static_cast<u_short>(block));
-        (void)socket_.send_to(boost::asio::buffer(ackbuf_, TFTP_HEADER), clientEndpoint_);
+        ap->th_block = htons(wire(block));
+        socket_.send_to(boost::asio::buffer(ackbuf_, TFTP_HEADER), clientEndpoint_);
         start_last_timeout();
 
         // Run an asynchronous read operation with a timeout.
@@ -410,61 +855,280 @@ public:
                                    [this](std::error_code ec, std::size_t bytes_recvd) {
                                        if (!ec) {
                                            auto *dp = reinterpret_cast<struct tftphdr *>(rxbuf_);
-                                           if ((bytes_recvd >= TFTP_HEADER) && /* if read some data */
-                                               (dp->th_opcode == DATA) &&      /* and got a data block */
+                                           if ((bytes_recvd >= TFTP_HEADER) &&   /* if read some data */
+                                               (ntohs(dp->th_opcode) == DATA) && /* and got a data block */
                                                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
-                                               (block == dp->th_block)) {
+                                               (wire(block) == ntohs(dp->th_block))) {
                                                /* then my last ack was lost, resend final ack */
                                                // NOTE: do not call! send_ackbuf(); CK
-                                               syslog(LOG_WARNING, "tftpd: Resend the final ack!");
-                                               (void)socket_.send_to(boost::asio::buffer(ackbuf_, TFTP_HEADER),
-                                                                     clientEndpoint_);
+                                               Logger::log(LOG_WARNING, "tftpd: Resend the final ack!");
+                                               report_.retransmits++;
+                                               socket_.send_to(boost::asio::buffer(ackbuf_, TFTP_HEADER),
+                                                               clientEndpoint_);
                                            }
                                        }
-                                       cancel_timeout();
+                                       complete();
                                    });
     }
 
-    /* When an error has occurred, it is possible that the two sides
-     * are out of synch.  Ie: that what I think is the other side's
-     * response to packet N is really their response to packet N-1.
-     *
-     * So, to try to prevent that, we flush all the input queued up
-     * for us on the network connection on our host.
-     *
-     * We return the number of packets we flushed (mostly for reporting
-     * when trace is active).
+    /*
+     * Write the data segment of the current block, hash it and report the
+     * progress.
      */
-    void synchnet()
+    int write_segment(const char *data, size_t seg_length)
     {
-        syslog(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+        int const error = storage_.write(data, seg_length);
+        if (error == storage_sink::would_block) {
+            storage_full_ = true; // NOTE: taken, but answered after the storage is ready
+        } else if (error != 0) {
+            return (error);
+        }
+        digest_.update(data, seg_length);
+        report_.bytes += seg_length;
+        report_.blocks++;
+        progress_.update(report_.bytes);
+        return 0; // OK
+    }
 
-        int j = 0;
-        struct sockaddr_storage from = {};
-        socklen_t fromlen = 0;
-        int const s = socket_.native_handle();
+    /*
+     * A block ahead of sequence, i.e. reordered by the network or pipelined
+     * by the client, is held back until the gap before it is filled.  Older
+     * blocks are true duplicates and dropped, as any block too far ahead.
+     * Instead of flushing the socket (synchnet) the good data is kept and
+     * the client need not to resend it.
+     */
+    void hold_block(size_t seg_length)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        u_int16_t const number = dp_->th_block;
+        uint64_t ahead = 1;
+        while (ahead < reorder_slots && wire(block + ahead) != number) {
+            ahead++;
+        }
+        if (ahead >= reorder_slots || seg_length > options_.segsize) {
+            Logger::log(LOG_WARNING, "tftpd: Discarded block %u\n", number);
+            report_.duplicates++;
+            return;
+        }
 
-        while (true) {
-            std::size_t const i = socket_.available();
-            if (i != 0) {
-                j++;
-                fromlen = sizeof(from);
-                (void)recvfrom(s, rxbuf_, sizeof(rxbuf_), 0, reinterpret_cast<struct sockaddr *>(&from), &fromlen);
-            } else {
-                if (j != 0) {
-                    syslog(LOG_WARNING, "tftpd: Discarded %d packets\n", j);
-                }
+        uint64_t const absolute = block + ahead;
+        auto &held = reorder_[absolute % reorder_slots];
+        if (held.valid && held.block == absolute) {
+            report_.duplicates++;
+            return;
+        }
+        held.valid = true;
+        held.block = absolute;
+        if (held.data.capacity() < TFTP_HEADER + options_.segsize) {
+            held.data = g_packets.get(options_.segsize);
+        }
+        held.data.resize(seg_length);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        memcpy(held.data.data(), dp_->th_data, seg_length);
+        report_.reordered++;
+    }
+
+    /*
+     * Send the current DATA block of a download, or its OACK as block 0,
+     * and wait for the ACK.  A block sent again is the one in txpkt_.
+     */
+    void send_block(bool rexmit = false)
+    {
+        Logger::log(LOG_NOTICE, "%s(%u)\n", BOOST_CURRENT_FUNCTION, wire(block));
+
+        if (block > 0 && !rexmit) {
+            txpkt_.resize(TFTP_HEADER + options_.segsize);
+            auto *tp = reinterpret_cast<struct tftphdr *>(txpkt_.data());
+            tp->th_opcode = htons(static_cast<u_short>(DATA));
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            tp->th_block = htons(wire(block));
+            ssize_t const length =
+                source_->read((block - 1) * options_.segsize, txpkt_.data() + TFTP_HEADER, options_.segsize);
+            if (length < 0) {
+                Logger::log(LOG_ERR, "tftpd: read() failed! %s\n", strerror(errno));
+                send_error(errno + ERRNO_OFFSET);
                 return;
             }
+            seg_length_ = static_cast<size_t>(length);
+            txpkt_.resize(TFTP_HEADER + seg_length_);
+        }
+
+        // NOTE: only a fresh block gives a valid rtt sample (Karn's algorithm)
+        ack_sent_ = now();
+        rtt_sample_ = !rexmit;
+        if (rexmit) {
+            report_.retransmits++;
+        }
+
+        auto const packet = (block > 0) ? boost::asio::buffer(txpkt_.data(), txpkt_.size())
+                                        : boost::asio::buffer(ackbuf_, answer_length_);
+        socket_.async_send_to(packet, clientEndpoint_, [this](std::error_code ec, std::size_t /*bytes_sent*/) {
+            if (done()) {
+                return;
+            }
+            if (ec) {
+                Logger::log(LOG_ERR, "tftpd: send_block: %s\n", ec.message().c_str());
+            } else {
+                receive_ack();
+            }
+        });
+    }
+
+    void receive_ack(bool restart = true)
+    {
+        Logger::log(LOG_NOTICE, "%s\n", BOOST_CURRENT_FUNCTION);
+
+        // Run an asynchronous read operation with a timeout.
+        if (restart) {
+            restart_timeout();
+        }
+        socket_.async_receive_from(boost::asio::buffer(rxbuf_, sizeof(rxbuf_)), clientEndpoint_,
+                                   [this](const boost::system::error_code &ec, std::size_t bytes_recvd) {
+                                       if (done()) {
+                                           return;
+                                       }
+                                       if (ec == boost::asio::error::operation_aborted) {
+                                           send_block(true); // NOTE: timeout, the block or its ACK was lost
+                                       } else if (ec) {
+                                           Logger::log(LOG_ERR, "tftpd: read ack: %s\n", ec.message().c_str());
+                                           receive_ack();
+                                       } else {
+                                           int const err = check_ack(bytes_recvd);
+                                           if (err != 0) {
+                                               send_error(err);
+                                           }
+                                       }
+                                   });
+    }
+
+    int check_ack(size_t rxlen)
+    {
+        Logger::log(LOG_NOTICE, "%s(%u, len=%lu)\n", BOOST_CURRENT_FUNCTION, wire(block), rxlen);
+
+        if (rxlen < TFTP_HEADER) {
+            receive_ack();
+            return 0; // OK
+        }
+
+        auto *ap = reinterpret_cast<struct tftphdr *>(rxbuf_);
+        u_short const opcode = ntohs(ap->th_opcode);
+        if (opcode == ERROR) {
+            Logger::log(LOG_ERR, "tftpd: ERROR received, abort Operation!\n");
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            std::string const msg(ap->th_msg, strnlen(ap->th_msg, rxlen - TFTP_HEADER));
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+            finish_report(transfer_status::error_received, ntohs(ap->th_code), msg);
+            complete(std::make_error_code(std::errc::connection_aborted));
+            return 0; // OK
+        }
+        if (opcode != ACK) {
+            Logger::log(LOG_ERR, "tftpd: Invalid opcode, ACK expected!\n");
+            return (EBADID);
+        }
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+        if (ntohs(ap->th_block) != wire(block)) {
+            // NOTE: never answer an old ACK, that is the Sorcerer's Apprentice Syndrome! CK
+            // nor restart the timeout with it, or a lost block is never sent again
+            report_.duplicates++;
+            receive_ack(false);
+            return 0; // OK
+        }
+        reset_timeout();
+        update_rtt();
+
+        if (block > 0) {
+            report_.bytes += seg_length_;
+            report_.blocks++;
+            progress_.update(report_.bytes);
+            if (seg_length_ < options_.segsize) {
+                Logger::log(LOG_NOTICE, "tftpd: successfully sent file: %s\n", file_path_.c_str());
+                finish_report(transfer_status::success);
+                complete();
+                return 0; // OK
+            }
+        }
+        block++;
+        send_block();
+        return 0; // OK
+    }
+
+    /*
+     * The 16 bit block number on the wire of an absolute block number, after
+     * 65535 it continues with the rollover value given.
+     */
+    static u_int16_t wire(uint64_t absolute, uint16_t rollover)
+    {
+        constexpr uint64_t numbers{UINT16_MAX + 1UL};
+        if (absolute < numbers) {
+            return static_cast<u_int16_t>(absolute);
+        }
+        return static_cast<u_int16_t>(rollover + (absolute - numbers) % (numbers - rollover));
+    }
+
+    /// with the rollover value negotiated by the session
+    u_int16_t wire(uint64_t absolute) const { return wire(absolute, options_.rollover); }
+
+    /*
+     * Smoothed round trip time after RFC6298: SRTT = 7/8 SRTT + 1/8 R
+     */
+    void update_rtt()
+    {
+        if (!rtt_sample_) {
+            return;
+        }
+        rtt_sample_ = false;
+
+        auto const sample = std::chrono::duration_cast<std::chrono::microseconds>(now() - ack_sent_);
+        if (report_.rtt.count() == 0) {
+            report_.rtt = sample;
+        } else {
+            report_.rtt = (7 * report_.rtt + sample) / 8;
         }
     }
 
 private:
-    struct tftphdr *dp_{nullptr};
+    using base::complete;
+    using base::file_path_;
+    using base::finish_report;
+    using base::later;
+    using base::now;
+    using base::options_;
+    using base::report_;
+    using base::reset_timeout;
+    using base::restart_timeout;
+    using base::send_error;
+    using base::socket_;
+    using base::start_last_timeout;
+
+    static constexpr size_t reorder_slots{8};
+
+    struct held_block
+    {
+        bool valid{false};
+        uint64_t block{0}; // absolute
+        packet_buffer data;
+    };
+
+    Storage storage_;
+    bool storage_full_{false}; // after a block written
+    Progress progress_;
+    checksum digest_; // of the blocks written
+    content_ptr source_;  // of a download
+    packet_buffer txpkt_; // the DATA block sent
+    size_t seg_length_{0}; // of the DATA block sent
+    packet_buffer rxpkt_;         // of the DATA received
+    struct tftphdr *dp_{nullptr}; // in rxpkt_
     udp::endpoint clientEndpoint_;
     char ackbuf_[PKTSIZE]{};
-    char rxbuf_[MAXPKTSIZE]{};
-    std::atomic<u_int16_t> block{0};
-    size_t percent_{0};
+    size_t answer_length_{0}; // of the OACK or ACK 0 in ackbuf_
+    char rxbuf_[PKTSIZE]{}; // NOTE: of an ACK, or only the header of a DATA block is checked
+    uint64_t block{0}; // absolute, i.e. without rollover
+    std::array<held_block, reorder_slots> reorder_;
+    session_timer::clock_type::time_point ack_sent_;
+    bool rtt_sample_{false};
 };
+
+/// the session of receive_file()
+using receiver = basic_receiver<sink_storage, callback_progress, syslog_logger>;
 } // namespace tftpd
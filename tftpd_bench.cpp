@@ -0,0 +1,272 @@
+// NOTE: in-process loopback benchmark of the tftpd receiver! CK
+//
+// The server runs receive_file() on a worker thread, the tftpd::client
+// uploads synthetic files over 127.0.0.1 for every combination of
+// blksize, windowsize, file size and loss rate.  Results go to stderr as a
+// table and optional as JSON (--json=FILE, - for stdout) to track
+// regressions.  With --loss the datagrams of both sides are dropped by a
+// seeded impairment, so the goodput versus loss rate is reproducible.
+// With --checksum the uploads are hashed while they are received.
+#include "async_tftp_client.hpp"
+#include "bench_utils.hpp"
+#include "tftp/tftpsubs.h"
+#include "tftpd.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct bench_case
+{
+    size_t blksize;
+    size_t windowsize;
+    size_t filesize;
+    double loss;
+};
+
+struct bench_result
+{
+    bench_case param{};
+    size_t blksize{0};    // negotiated
+    size_t windowsize{1}; // negotiated
+    bool ok{false};
+    double seconds{0};     // data phase only, from first answer to last ACK
+    double cpu_seconds{0}; // process wide, so server and client
+    double mbytes_per_sec{0};
+    double packets_per_sec{0};
+    double cpu_sec_per_gib{0};
+    double p50_us{0};
+    double p99_us{0};
+    uint64_t data_packets{0};
+    uint64_t client_rexmits{0};
+    tftpd::transfer_report report;
+};
+
+double cpu_seconds()
+{
+    struct rusage ru = {};
+    (void)getrusage(RUSAGE_SELF, &ru);
+    return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+double percentile(std::vector<double> &v, double p)
+{
+    if (v.empty()) {
+        return 0;
+    }
+    auto const n = static_cast<size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(n), v.end());
+    return v[n];
+}
+
+bench_result run_case(const bench_case &param, const std::string &rootdir, uint16_t port, uint32_t seed)
+{
+    bench_result res;
+    res.param = param;
+
+    auto data = std::make_shared<std::vector<char>>(param.filesize);
+    for (size_t i = 0; i < data->size(); ++i) {
+        (*data)[i] = static_cast<char>((i * 131) >> 7);
+    }
+
+    std::string const name("bench_" + std::to_string(param.blksize) + "_" + std::to_string(param.windowsize) + "_" +
+                           std::to_string(param.filesize) + ".dat");
+
+    tftpd::g_impairment.loss = param.loss;
+    tftpd::g_impairment.seed = seed;
+
+    std::thread server([&] {
+        try {
+            (void)tftpd::receive_file(rootdir.c_str(), port, nullptr,
+                                      [&res](const tftpd::transfer_report &r) { res.report = r; });
+        } catch (std::exception &e) {
+            std::cerr << "tftpd_bench: server: " << e.what() << '\n';
+        }
+    });
+
+    std::vector<double> lat;
+    lat.reserve(param.filesize / std::max<size_t>(param.blksize, 1) + 1);
+
+    tftpd::client_options options;
+    options.blksize = param.blksize;
+    options.windowsize = param.windowsize;
+    options.rexmt = std::chrono::milliseconds(200);
+    options.max_retries = 25; // NOTE: the server may not listen yet
+    options.network.loss = param.loss;
+    options.network.seed = seed + 1;
+    options.block_latency = [&lat](std::chrono::microseconds us) { lat.push_back(static_cast<double>(us.count())); };
+
+    tftpd::transfer_report client_report;
+    boost::asio::io_context io_context;
+    tftpd::client client(io_context);
+    client.async_put(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), port), name, data,
+                     options, [&client_report](const tftpd::transfer_report &r) { client_report = r; });
+    double const cpu0 = cpu_seconds();
+    io_context.run();
+    res.cpu_seconds = cpu_seconds() - cpu0;
+
+    server.join(); // NOTE: waits for the dally after the final ack
+
+    std::string const path(rootdir + "/" + name);
+    struct stat st = {};
+    res.ok = client_report.status == tftpd::transfer_status::success && stat(path.c_str(), &st) == 0 &&
+             static_cast<size_t>(st.st_size) == param.filesize && res.report.status == tftpd::transfer_status::success;
+    (void)unlink(path.c_str());
+
+    // NOTE: data phase only, without the request retried while the server binds
+    res.seconds = std::chrono::duration<double>(client_report.duration - client_report.setup).count();
+    res.blksize = client_report.blksize;
+    res.windowsize = client_report.windowsize;
+    res.data_packets = client_report.blocks + client_report.retransmits;
+    res.client_rexmits = client_report.retransmits;
+    if (res.seconds > 0) {
+        res.mbytes_per_sec = static_cast<double>(param.filesize) / res.seconds / 1e6;
+        res.packets_per_sec = static_cast<double>(res.data_packets) / res.seconds;
+    }
+    double const gib = static_cast<double>(param.filesize) / static_cast<double>(1UL << 30);
+    if (gib > 0) {
+        res.cpu_sec_per_gib = res.cpu_seconds / gib;
+    }
+    res.p50_us = percentile(lat, 0.50);
+    res.p99_us = percentile(lat, 0.99);
+    return res;
+}
+
+void write_json(std::ostream &os, tftpd::checksum_type checksum, const std::vector<bench_result> &results)
+{
+    os << "{\n  \"benchmark\": \"tftpd_bench\",\n  \"checksum\": \"" << tftpd::checksum_name(checksum)
+       << "\",\n  \"results\": [";
+    const char *sep = "\n";
+    for (const auto &r : results) {
+        os << sep << "    {\"blksize\": " << r.param.blksize << ", \"windowsize\": " << r.param.windowsize
+           << ", \"filesize\": " << r.param.filesize << ", \"loss\": " << r.param.loss
+           << ", \"negotiated_blksize\": " << r.blksize
+           << ", \"negotiated_windowsize\": " << r.windowsize << ", \"ok\": " << (r.ok ? "true" : "false")
+           << ", \"seconds\": " << r.seconds << ", \"mbytes_per_sec\": " << r.mbytes_per_sec
+           << ", \"packets_per_sec\": " << r.packets_per_sec << ", \"cpu_sec_per_gib\": " << r.cpu_sec_per_gib
+           << ", \"latency_p50_us\": " << r.p50_us << ", \"latency_p99_us\": " << r.p99_us
+           << ", \"data_packets\": " << r.data_packets << ", \"client_rexmits\": " << r.client_rexmits
+           << ", \"server_retransmits\": " << r.report.retransmits
+           << ", \"server_duplicates\": " << r.report.duplicates << ", \"server_rtt_us\": " << r.report.rtt.count()
+           << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cerr << "Usage: tftpd_bench [--port=N] [--rootdir=DIR] [--blksize=LIST] [--windowsize=LIST]\n"
+                 "                   [--size=LIST] [--loss=LIST] [--seed=N] [--quick] [--json=FILE|-]\n"
+                 "                   [--checksum=none|crc32c|sha256]\n"
+                 "       LIST is comma separated, sizes may use k or m suffix,\n"
+                 "       loss rates are probabilities, i.e. 0,0.01,0.05\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 6969;
+    std::string rootdir("/tmp/tftpboot-bench");
+    std::string json;
+    std::vector<size_t> blksizes{SEGSIZE, 1428, 8192, 32768, MAXSEGSIZE};
+    std::vector<size_t> windowsizes{1}; // NOTE: the server does not negotiate RFC7440 yet
+    std::vector<size_t> sizes{64UL << 10, 1UL << 20, 16UL << 20};
+    std::vector<double> losses{0};
+    uint32_t seed = 1;
+    auto checksum = tftpd::checksum_type::none;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        auto value = [&arg]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.rfind("--port=", 0) == 0) {
+            port = static_cast<uint16_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else if (arg.rfind("--rootdir=", 0) == 0) {
+            rootdir = value();
+        } else if (arg.rfind("--blksize=", 0) == 0) {
+            blksizes = tftpd::bench::parse_list(value());
+        } else if (arg.rfind("--windowsize=", 0) == 0) {
+            windowsizes = tftpd::bench::parse_list(value());
+        } else if (arg.rfind("--size=", 0) == 0) {
+            sizes = tftpd::bench::parse_list(value());
+        } else if (arg.rfind("--loss=", 0) == 0) {
+            losses.clear();
+            std::stringstream ss(value());
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                losses.push_back(std::strtod(item.c_str(), nullptr));
+            }
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            seed = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value();
+        } else if (arg.rfind("--checksum=", 0) == 0) {
+            auto const name = value();
+            if (name == "crc32c") {
+                checksum = tftpd::checksum_type::crc32c;
+            } else if (name == "sha256") {
+                checksum = tftpd::checksum_type::sha256;
+            } else if (name != "none") {
+                usage();
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--quick") {
+            blksizes = {SEGSIZE, MAXSEGSIZE};
+            windowsizes = {1};
+            sizes = {256UL << 10};
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_WARNING));
+    tftpd::set_rate_limit({0}); // NOTE: all requests come from the loopback address
+    tftpd::set_checksum(checksum);
+
+    std::vector<bench_result> results;
+    bool all_ok = true;
+    fprintf(stderr, "%8s %6s %10s %6s %6s %10s %10s %10s %10s %10s %4s\n", "blksize", "window", "size", "loss",
+            "nwin", "MB/s", "pkts/s", "cpu s/GiB", "p50 us", "p99 us", "ok");
+    for (auto loss : losses) {
+        for (auto sz : sizes) {
+            for (auto blk : blksizes) {
+                for (auto win : windowsizes) {
+                    auto const r = run_case({blk, win, sz, loss}, rootdir, port, seed);
+                    fprintf(stderr, "%8zu %6zu %10zu %6.3f %6zu %10.2f %10.0f %10.2f %10.1f %10.1f %4s\n", blk, win,
+                            sz, loss, r.windowsize, r.mbytes_per_sec, r.packets_per_sec, r.cpu_sec_per_gib, r.p50_us,
+                            r.p99_us, r.ok ? "yes" : "NO");
+                    all_ok = all_ok && r.ok;
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (json == "-") {
+        write_json(std::cout, checksum, results);
+    } else if (!json.empty()) {
+        std::ofstream os(json);
+        write_json(os, checksum, results);
+    }
+
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
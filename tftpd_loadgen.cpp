@@ -0,0 +1,292 @@
+// NOTE: multi client load generator, i.e. to reproduce a PXE boot storm! CK
+//
+// Simulates N virtual TFTP clients from one process.  Every client is a
+// tftpd::client transfer with its own socket, so each one has a distinct
+// source port (TID).  Clients arrive as a burst, a linear ramp or a
+// poisson process over --duration seconds, optional limited to
+// --concurrency transfers in flight.  The summary reports the success
+// rate, the aggregate throughput and percentiles of the time from request
+// to the first answer (OACK) and of the whole transfer.
+#include "async_tftp_client.hpp"
+#include "bench_utils.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using boost::asio::ip::udp;
+
+struct load_config
+{
+    udp::endpoint server{boost::asio::ip::address_v4::loopback(), 69};
+    bool put{false};
+    std::string file{"pxelinux.0"}; // RRQ name or WRQ name prefix
+    std::vector<size_t> sizes{1UL << 20};
+    size_t clients{100};
+    size_t concurrency{0}; // 0: unlimited
+    std::string profile{"burst"};
+    double duration{1.0}; // seconds for ramp and poisson arrivals
+    unsigned seed{1};
+    tftpd::client_options options;
+};
+
+double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) {
+        return 0;
+    }
+    auto const n = static_cast<size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(n), v.end());
+    return v[n];
+}
+
+class load_generator
+{
+public:
+    load_generator(boost::asio::io_context &io_context, const load_config &config)
+        : timer_(io_context), client_(io_context), config_(config), rng_(config.seed)
+    {
+        for (auto size : config_.sizes) {
+            payloads_[size] = std::make_shared<std::vector<char>>(size, '\x5a');
+        }
+        arrivals_ = arrival_times();
+        reports_.reserve(config_.clients);
+    }
+
+    void start()
+    {
+        started_ = clock_type::now();
+        schedule();
+    }
+
+    const std::vector<tftpd::transfer_report> &reports() const { return reports_; }
+
+    double wall_seconds() const { return std::chrono::duration<double>(finished_ - started_).count(); }
+
+private:
+    /// offsets from the start when the clients arrive
+    std::vector<clock_type::duration> arrival_times()
+    {
+        std::vector<clock_type::duration> t(config_.clients);
+        std::chrono::duration<double> const span(config_.duration);
+        std::exponential_distribution<double> exp(static_cast<double>(config_.clients) / config_.duration);
+        std::chrono::duration<double> at(0);
+        for (size_t i = 0; i < t.size(); ++i) {
+            if (config_.profile == "ramp") {
+                at = span * static_cast<double>(i) / static_cast<double>(config_.clients);
+            } else if (config_.profile == "poisson") {
+                at += std::chrono::duration<double>(exp(rng_));
+            }
+            t[i] = std::chrono::duration_cast<clock_type::duration>(at);
+        }
+        return t;
+    }
+
+    /// launch every client due, then wait for the next one
+    void schedule()
+    {
+        auto const now = clock_type::now();
+        while (next_ < arrivals_.size() && started_ + arrivals_[next_] <= now) {
+            pending_.push_back(next_++);
+        }
+        launch_pending();
+
+        if (next_ < arrivals_.size()) {
+            timer_.expires_at(started_ + arrivals_[next_]);
+            timer_.async_wait([this](boost::system::error_code ec) {
+                if (!ec) {
+                    schedule();
+                }
+            });
+        }
+    }
+
+    void launch_pending()
+    {
+        while (!pending_.empty() && (config_.concurrency == 0 || in_flight_ < config_.concurrency)) {
+            size_t const i = pending_.front();
+            pending_.pop_front();
+            launch(i);
+        }
+    }
+
+    void launch(size_t i)
+    {
+        in_flight_++;
+        auto done = [this](const tftpd::transfer_report &r) {
+            reports_.push_back(r);
+            finished_ = clock_type::now();
+            in_flight_--;
+            launch_pending();
+        };
+
+        if (config_.put) {
+            std::uniform_int_distribution<size_t> pick(0, config_.sizes.size() - 1);
+            auto const &data = payloads_[config_.sizes[pick(rng_)]];
+            char name[32];
+            (void)snprintf(name, sizeof(name), "_%06zu.dat", i);
+            client_.async_put(config_.server, config_.file + name, data, config_.options, done);
+        } else {
+            client_.async_get(config_.server, config_.file, "/dev/null", config_.options, done);
+        }
+    }
+
+    boost::asio::steady_timer timer_;
+    tftpd::client client_;
+    load_config config_;
+    std::mt19937 rng_;
+    std::map<size_t, std::shared_ptr<const std::vector<char>>> payloads_;
+    std::vector<clock_type::duration> arrivals_;
+    std::deque<size_t> pending_;
+    size_t next_{0};
+    size_t in_flight_{0};
+    clock_type::time_point started_;
+    clock_type::time_point finished_;
+    std::vector<tftpd::transfer_report> reports_;
+};
+
+/// every client needs its own socket
+void raise_fd_limit()
+{
+    struct rlimit rl = {};
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+void usage()
+{
+    std::cerr << "Usage: tftpd_loadgen [--host=ADDR] [--port=N] [--get=FILE | --put=PREFIX] [--size=LIST]\n"
+                 "                     [--clients=N] [--concurrency=N] [--profile=burst|ramp|poisson]\n"
+                 "                     [--duration=SEC] [--blksize=N] [--windowsize=N] [--timeout=SEC]\n"
+                 "                     [--seed=N] [--json=FILE|-]\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    load_config config;
+    config.options.rexmt = std::chrono::seconds(1);
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        std::string const value(arg.substr(arg.find('=') + 1));
+        auto number = [&value]() { return std::strtoul(value.c_str(), nullptr, 10); };
+        if (arg.rfind("--host=", 0) == 0) {
+            config.server.address(boost::asio::ip::make_address(value));
+        } else if (arg.rfind("--port=", 0) == 0) {
+            config.server.port(static_cast<uint16_t>(number()));
+        } else if (arg.rfind("--get=", 0) == 0) {
+            config.put = false;
+            config.file = value;
+        } else if (arg.rfind("--put=", 0) == 0) {
+            config.put = true;
+            config.file = value;
+        } else if (arg.rfind("--size=", 0) == 0) {
+            config.sizes = tftpd::bench::parse_list(value);
+        } else if (arg.rfind("--clients=", 0) == 0) {
+            config.clients = number();
+        } else if (arg.rfind("--concurrency=", 0) == 0) {
+            config.concurrency = number();
+        } else if (arg.rfind("--profile=", 0) == 0 &&
+                   (value == "burst" || value == "ramp" || value == "poisson")) {
+            config.profile = value;
+        } else if (arg.rfind("--duration=", 0) == 0) {
+            config.duration = std::max(std::strtod(value.c_str(), nullptr), 1e-3);
+        } else if (arg.rfind("--blksize=", 0) == 0) {
+            config.options.blksize = number();
+        } else if (arg.rfind("--windowsize=", 0) == 0) {
+            config.options.windowsize = number();
+        } else if (arg.rfind("--timeout=", 0) == 0) {
+            config.options.timeout = number();
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            config.seed = static_cast<unsigned>(number());
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.clients == 0 || config.sizes.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    raise_fd_limit();
+
+    boost::asio::io_context io_context;
+    load_generator load(io_context, config);
+    load.start();
+    io_context.run();
+
+    // summary
+    std::map<tftpd::transfer_status, size_t> status;
+    std::vector<double> setup;
+    std::vector<double> duration;
+    uint64_t bytes = 0;
+    uint64_t retransmits = 0;
+    for (const auto &r : load.reports()) {
+        status[r.status]++;
+        retransmits += r.retransmits;
+        if (r.setup.count() > 0) {
+            setup.push_back(static_cast<double>(r.setup.count()) / 1e3);
+        }
+        if (r.status == tftpd::transfer_status::success) {
+            bytes += r.bytes;
+            duration.push_back(static_cast<double>(r.duration.count()) / 1e3);
+        }
+    }
+    size_t const ok = status[tftpd::transfer_status::success];
+    double const wall = load.wall_seconds();
+    double const success_rate = 100.0 * static_cast<double>(ok) / static_cast<double>(config.clients);
+    double const mbytes_per_sec = wall > 0 ? static_cast<double>(bytes) / wall / 1e6 : 0;
+
+    fprintf(stderr, "clients: %zu ok: %zu (%.1f%%) timeout: %zu error sent: %zu error received: %zu\n",
+            config.clients, ok, success_rate, status[tftpd::transfer_status::timeout],
+            status[tftpd::transfer_status::error_sent], status[tftpd::transfer_status::error_received]);
+    fprintf(stderr, "wall: %.3f s  bytes: %llu  throughput: %.2f MB/s  retransmits: %llu\n", wall,
+            static_cast<unsigned long long>(bytes), mbytes_per_sec, static_cast<unsigned long long>(retransmits));
+    fprintf(stderr, "setup ms:    p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(setup, 0.5),
+            percentile(setup, 0.9), percentile(setup, 0.99), percentile(setup, 1.0));
+    fprintf(stderr, "transfer ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(duration, 0.5),
+            percentile(duration, 0.9), percentile(duration, 0.99), percentile(duration, 1.0));
+
+    if (!json.empty()) {
+        std::ofstream file;
+        if (json != "-") {
+            file.open(json);
+        }
+        std::ostream &os = (json == "-") ? std::cout : file;
+        os << "{\"benchmark\": \"tftpd_loadgen\", \"profile\": \"" << config.profile
+           << "\", \"clients\": " << config.clients << ", \"concurrency\": " << config.concurrency
+           << ", \"success\": " << ok << ", \"success_rate\": " << success_rate << ", \"wall_seconds\": " << wall
+           << ", \"bytes\": " << bytes << ", \"mbytes_per_sec\": " << mbytes_per_sec
+           << ", \"retransmits\": " << retransmits << ", \"setup_ms\": {\"p50\": " << percentile(setup, 0.5)
+           << ", \"p90\": " << percentile(setup, 0.9) << ", \"p99\": " << percentile(setup, 0.99)
+           << ", \"max\": " << percentile(setup, 1.0) << "}, \"transfer_ms\": {\"p50\": " << percentile(duration, 0.5)
+           << ", \"p90\": " << percentile(duration, 0.9) << ", \"p99\": " << percentile(duration, 0.99)
+           << ", \"max\": " << percentile(duration, 1.0) << "}}\n";
+    }
+
+    return ok == config.clients ? EXIT_SUCCESS : EXIT_FAILURE;
+}
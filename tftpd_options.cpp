@@ -33,6 +33,8 @@
  * SUCH DAMAGE.
  */
 
+#include "tftpd_options.hpp"
+
 #include "tftp/tftpsubs.h"
 
 #include <arpa/inet.h>
@@ -46,31 +48,25 @@
 namespace tftpd {
 constexpr uintmax_t min_blksize_rfc{8}; // TBD: after RFC2348! CK
 constexpr uintmax_t default_blksize{SEGSIZE};
-constexpr uintmax_t max_blksize{MAXSEGSIZE};
 // unused constexpr uintmax_t max_windowsize{64};
 constexpr uintmax_t max_timeout{255}; // seconds
 constexpr uintmax_t MS_1K{1000};      // default timeout
 
-// XXX static uint16_t rollover_val = 0;
 // XXX static uintmax_t windowsize = 1;
 static constexpr bool tsize_ok{true}; // only octet mode supported!
 
-uintmax_t g_timeout = MS_1K; // NOTE: 1 s as ms! CK
-uintmax_t g_segsize{default_blksize};
-off_t g_tsize{0};
-
-static bool set_blksize(uintmax_t *vp);
-static bool set_blksize2(uintmax_t *vp);
-static bool set_tsize(uintmax_t *vp);
-static bool set_timeout(uintmax_t *vp);
-static bool set_utimeout(uintmax_t *vp);
-// XXX static bool set_rollover(uintmax_t *vp);
-// XXX static bool set_windowsize(uintmax_t *vp);
+static bool set_blksize(uintmax_t *vp, session_options &so);
+static bool set_blksize2(uintmax_t *vp, session_options &so);
+static bool set_tsize(uintmax_t *vp, session_options &so);
+static bool set_timeout(uintmax_t *vp, session_options &so);
+static bool set_utimeout(uintmax_t *vp, session_options &so);
+static bool set_rollover(uintmax_t *vp, session_options &so);
+// XXX static bool set_windowsize(uintmax_t *vp, session_options &so);
 
 struct option
 {
     const char *o_opt;
-    bool (*o_fnc)(uintmax_t *);
+    bool (*o_fnc)(uintmax_t *, session_options &);
 };
 
 static const struct option options[] = {{"blksize", set_blksize},
@@ -78,20 +74,18 @@ static const struct option options[] = {{"blksize", set_blksize},
                                         {"tsize", set_tsize},
                                         {"timeout", set_timeout},
                                         {"utimeout", set_utimeout},
-                                        // TBD: {"rollover", set_rollover},
+                                        {"rollover", set_rollover},
                                         // TBD: not yet! CK {"windowsize", set_windowsize},
                                         {nullptr, nullptr}};
 
-static bool blksize_set{false};
-
 /*
  * Set a non-standard block size (c.f. RFC2348)
  */
-static bool set_blksize(uintmax_t *vp)
+static bool set_blksize(uintmax_t *vp, session_options &so)
 {
     uintmax_t sz = *vp;
 
-    if (blksize_set) {
+    if (so.blksize_set) {
         return false;
     }
 
@@ -99,23 +93,23 @@ static bool set_blksize(uintmax_t *vp)
         return false;
     }
 
-    if (sz > max_blksize) {
-        sz = max_blksize;
+    if (sz > so.max_segsize) {
+        sz = so.max_segsize;
     }
 
-    *vp = g_segsize = sz;
-    blksize_set = true;
+    *vp = so.segsize = sz;
+    so.blksize_set = true;
     return true;
 }
 
 /*
  * Set a power-of-two block size (nonstandard)
  */
-static bool set_blksize2(uintmax_t *vp)
+static bool set_blksize2(uintmax_t *vp, session_options &so)
 {
     uintmax_t sz = *vp;
 
-    if (blksize_set) {
+    if (so.blksize_set) {
         return false;
     }
 
@@ -123,8 +117,8 @@ static bool set_blksize2(uintmax_t *vp)
         return false;
     }
 
-    if (sz > max_blksize) {
-        sz = max_blksize;
+    if (sz > so.max_segsize) {
+        sz = so.max_segsize;
     } else {
         /* Convert to a power of two */
         if ((sz & (sz - 1)) != 0) {
@@ -137,32 +131,34 @@ static bool set_blksize2(uintmax_t *vp)
         }
     }
 
-    *vp = g_segsize = sz;
-    blksize_set = true;
+    *vp = so.segsize = sz;
+    so.blksize_set = true;
     return true;
 }
 
-/***
- * Set the block number rollover value
-static bool set_rollover(uintmax_t *vp)
+/*
+ * Set the block number rollover value, i.e. the block number following
+ * 65535.  Only 0 and 1 are accepted, with a larger value the block numbers
+ * after 65535 would repeat too soon to tell a new block from a duplicate.
+ */
+static bool set_rollover(uintmax_t *vp, session_options &so)
 {
-    uintmax_t ro = *vp;
+    uintmax_t const ro = *vp;
 
-    if (ro > UINT16_MAX) {
+    if (ro > 1) {
         return false;
     }
 
-    rollover_val = (uint16_t)ro;
+    so.rollover = static_cast<uint16_t>(ro);
     return true;
 }
- ***/
 
 /*
  * Return a file size (c.f. RFC2349)
  * For netascii mode, we don't know the size ahead of time;
  * so reject the option.
  */
-static bool set_tsize(uintmax_t *vp)
+static bool set_tsize(uintmax_t *vp, session_options &so)
 {
     uintmax_t sz = *vp;
 
@@ -171,9 +167,9 @@ static bool set_tsize(uintmax_t *vp)
     }
 
     if (sz == 0) {
-        sz = g_tsize; // only useful for RRQ
+        sz = so.tsize; // only useful for RRQ
     } else {
-        g_tsize = sz; // in case of WRQ
+        so.tsize = static_cast<off_t>(sz); // in case of WRQ
     }
 
     *vp = sz;
@@ -185,7 +181,7 @@ static bool set_tsize(uintmax_t *vp)
  * to be the (default) retransmission timeout, but being an
  * integer in seconds it seems a bit limited.
  */
-static bool set_timeout(uintmax_t *vp)
+static bool set_timeout(uintmax_t *vp, session_options &so)
 {
     uintmax_t const to = *vp;
 
@@ -193,7 +189,7 @@ static bool set_timeout(uintmax_t *vp)
         return false;
     }
 
-    g_timeout = to * MS_1K;
+    so.timeout = to * MS_1K;
 
     return true;
 }
@@ -201,7 +197,7 @@ static bool set_timeout(uintmax_t *vp)
 /*
  * Similar, but in microseconds.  We allow down to 10 ms.
  */
-static bool set_utimeout(uintmax_t *vp)
+static bool set_utimeout(uintmax_t *vp, session_options &so)
 {
     uintmax_t const to = *vp;
 
@@ -209,14 +205,14 @@ static bool set_utimeout(uintmax_t *vp)
         return false;
     }
 
-    g_timeout = to / MS_1K;
+    so.timeout = to / MS_1K;
 
     return true;
 }
 
 /***
  * Set window size (c.f. RFC7440)
-static bool set_windowsize(uintmax_t *vp)
+static bool set_windowsize(uintmax_t *vp, session_options &so)
 {
     if (*vp < 1 || *vp > max_windowsize) {
         return false;
@@ -228,20 +224,21 @@ static bool set_windowsize(uintmax_t *vp)
 }
  ***/
 
-/* Global option-parsing variables initialization */
-void init_opt()
+/* Option-parsing variables initialization */
+void init_opt(session_options &negotiated)
 {
-    blksize_set = false;
-    g_segsize = default_blksize;
-    g_timeout = MS_1K;
-    g_tsize = 0;
+    negotiated.blksize_set = false;
+    negotiated.segsize = default_blksize;
+    negotiated.timeout = MS_1K;
+    negotiated.tsize = 0;
+    negotiated.rollover = 0;
 }
 
 /*
  * Parse RFC2347 style options; we limit the arguments to positive
  * integers which matches all our current options.
  */
-void do_opt(const char *opt, const char *val, char **ackbuf_ptr)
+void do_opt(const char *opt, const char *val, char **ackbuf_ptr, session_options &negotiated)
 {
     const struct option *po = nullptr;
     char *p = *ackbuf_ptr;
@@ -267,7 +264,7 @@ void do_opt(const char *opt, const char *val, char **ackbuf_ptr)
 
     for (po = options; po->o_opt != nullptr; po++) {
         if (strcasecmp(po->o_opt, opt) == 0) { // XXX C-style compare
-            if (po->o_fnc(&v)) {               // found and the option is valid
+            if (po->o_fnc(&v, negotiated)) {   // found and the option is valid
                 size_t const optlen = strlen(opt);
                 std::string const ret_value = std::to_string(v);
                 size_t const retlen = ret_value.size();
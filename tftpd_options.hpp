@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * The RFC2347 options of a request, negotiated by tftp().
+ *
+ * Each session keeps the options of its own request, so the sessions
+ * running at once, i.e. of async_serve(), may use different ones.
+ */
+#include "tftp/tftpsubs.h"
+
+#include <cstdint>
+#include <sys/types.h>
+
+namespace tftpd {
+
+struct session_options
+{
+    uintmax_t max_segsize{MAXSEGSIZE}; ///< the largest blksize accepted, set by the caller
+    uintmax_t segsize{SEGSIZE};        ///< blksize (RFC2348)
+    uintmax_t timeout{1000};           ///< NOTE: 1 s as ms! CK
+    off_t tsize{0};        ///< of the upload announced or of the file sent (RFC2349), 0 if unknown
+    uint16_t rollover{0};  ///< block number after 65535
+    bool blksize_set{false}; // NOTE: either blksize or blksize2
+};
+
+/// reset the options negotiated, the max_segsize is kept
+void init_opt(session_options &negotiated);
+
+/// negotiate the option, an option accepted is appended to the OACK
+void do_opt(const char *opt, const char *val, char **ackbuf_ptr, session_options &negotiated);
+
+} // namespace tftpd
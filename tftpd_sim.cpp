@@ -0,0 +1,216 @@
+// NOTE: discrete event simulation of lossy uploads with virtual time! CK
+//
+// Runs --transfers simulated WRQ sessions of the unchanged tftpd receiver
+// against a lock step client for every loss rate, each with its own seed,
+// and reports the success rate, the virtual transfer time percentiles and
+// the recovery latency, i.e. the time lost compared to a lossless
+// transfer.  A timeout of seconds costs no wall clock time, so thousands
+// of transfers per second are simulated to tune the retransmission timers.
+#include "simulation.hpp"
+#include "tftpd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using std::chrono::duration;
+using std::chrono::microseconds;
+
+struct sim_config
+{
+    size_t transfers{1000};
+    size_t size{64UL << 10};
+    size_t blksize{0};
+    microseconds latency{1000}; // one way
+    std::chrono::milliseconds rexmt{1000};
+    unsigned max_retries{5};
+    uint32_t seed{1};
+    std::string rootdir{"/tmp/tftpboot-sim"};
+};
+
+struct sim_result
+{
+    double loss{0};
+    size_t ok{0};
+    double wall_seconds{0};
+    std::vector<double> elapsed_ms; // of the successful transfers
+    uint64_t retransmits{0};
+    uint64_t duplicates{0};
+    uint64_t server_timeouts{0};
+};
+
+double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) {
+        return 0;
+    }
+    auto const n = static_cast<size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(n), v.end());
+    return v[n];
+}
+
+sim_result run_loss(const sim_config &config, double loss)
+{
+    sim_result res;
+    res.loss = loss;
+    res.elapsed_ms.reserve(config.transfers);
+    tftpd::datagram_transport::endpoint const server(boost::asio::ip::address_v4::loopback(), 69);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < config.transfers; ++i) {
+        tftpd::transfer_report report;
+        tftpd::g_report = [&report](const tftpd::transfer_report &r) { report = r; };
+
+        tftpd::impairment profile;
+        profile.loss = loss;
+        profile.seed = config.seed + static_cast<uint32_t>(i);
+
+        tftpd::simulator sim;
+        tftpd::simulated_network network(sim, config.latency, profile);
+        tftpd::simulated_transport transport(network, server);
+        tftpd::simulated_timer timer(sim);
+        tftpd::receiver session(transport, timer);
+
+        tftpd::simulated_upload::options options;
+        options.blksize = config.blksize;
+        options.rexmt = config.rexmt;
+        options.max_retries = config.max_retries;
+        tftpd::simulated_upload client(network, server, "sim.dat", config.size, options);
+        client.start();
+        (void)sim.run();
+        if (session.error() == std::errc::timed_out) {
+            res.server_timeouts++; // NOTE: the session gave up
+        }
+
+        res.retransmits += client.retransmits() + report.retransmits;
+        res.duplicates += report.duplicates;
+        if (client.success() && report.status == tftpd::transfer_status::success) {
+            res.ok++;
+            res.elapsed_ms.push_back(duration<double, std::milli>(client.elapsed()).count());
+        }
+        (void)unlink((config.rootdir + "/sim.dat").c_str());
+    }
+    res.wall_seconds = duration<double>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+void usage()
+{
+    std::cerr << "Usage: tftpd_sim [--transfers=N] [--size=N] [--blksize=N] [--latency=US] [--rexmt=MS]\n"
+                 "                 [--retries=N] [--loss=LIST] [--seed=N] [--rootdir=DIR] [--json=FILE|-]\n"
+                 "       loss rates are probabilities, i.e. 0,0.01,0.05\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    sim_config config;
+    std::vector<double> losses{0, 0.01, 0.05, 0.1};
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        std::string const value(arg.substr(arg.find('=') + 1));
+        auto number = [&value]() { return std::strtoul(value.c_str(), nullptr, 10); };
+        if (arg.rfind("--transfers=", 0) == 0) {
+            config.transfers = number();
+        } else if (arg.rfind("--size=", 0) == 0) {
+            config.size = number();
+        } else if (arg.rfind("--blksize=", 0) == 0) {
+            config.blksize = number();
+        } else if (arg.rfind("--latency=", 0) == 0) {
+            config.latency = microseconds(number());
+        } else if (arg.rfind("--rexmt=", 0) == 0) {
+            config.rexmt = std::chrono::milliseconds(number());
+        } else if (arg.rfind("--retries=", 0) == 0) {
+            config.max_retries = static_cast<unsigned>(number());
+        } else if (arg.rfind("--loss=", 0) == 0) {
+            losses.clear();
+            std::stringstream ss(value);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                losses.push_back(std::strtod(item.c_str(), nullptr));
+            }
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            config.seed = static_cast<uint32_t>(number());
+        } else if (arg.rfind("--rootdir=", 0) == 0) {
+            config.rootdir = value;
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.transfers == 0 || losses.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    // NOTE: the receiver logs every block at LOG_NOTICE
+    (void)setlogmask(LOG_UPTO(LOG_ERR));
+    (void)mkdir(config.rootdir.c_str(), 0777);
+    tftpd::g_rootdir = config.rootdir.c_str();
+    tftpd::set_rate_limit({0}); // NOTE: every simulation starts at the same virtual time
+
+    // the lossless transfer time is the base of the recovery latency
+    auto lossless = config;
+    lossless.transfers = 1;
+    auto const base = run_loss(lossless, 0);
+    double const base_ms = base.elapsed_ms.empty() ? 0 : base.elapsed_ms.front();
+
+    // NOTE: only of the successful transfers
+    auto recovery = [base_ms](const sim_result &r) {
+        return r.elapsed_ms.empty() ? 0.0 : percentile(r.elapsed_ms, 0.5) - base_ms;
+    };
+
+    std::vector<sim_result> results;
+    fprintf(stderr, "%6s %8s %8s %10s %10s %10s %12s %10s %12s\n", "loss", "ok %", "sims/s", "p50 ms", "p99 ms",
+            "max ms", "recovery ms", "rexmits", "srv timeout");
+    for (auto loss : losses) {
+        auto const r = run_loss(config, loss);
+        fprintf(stderr, "%6.3f %8.2f %8.0f %10.1f %10.1f %10.1f %12.1f %10llu %12llu\n", loss,
+                100.0 * static_cast<double>(r.ok) / static_cast<double>(config.transfers),
+                static_cast<double>(config.transfers) / r.wall_seconds, percentile(r.elapsed_ms, 0.5),
+                percentile(r.elapsed_ms, 0.99), percentile(r.elapsed_ms, 1.0), recovery(r),
+                static_cast<unsigned long long>(r.retransmits), static_cast<unsigned long long>(r.server_timeouts));
+        results.push_back(r);
+    }
+
+    if (!json.empty()) {
+        std::ofstream file;
+        if (json != "-") {
+            file.open(json);
+        }
+        std::ostream &os = (json == "-") ? std::cout : file;
+        os << "{\n  \"benchmark\": \"tftpd_sim\",\n  \"transfers\": " << config.transfers
+           << ",\n  \"size\": " << config.size << ",\n  \"latency_us\": " << config.latency.count()
+           << ",\n  \"rexmt_ms\": " << config.rexmt.count() << ",\n  \"lossless_ms\": " << base_ms
+           << ",\n  \"results\": [";
+        const char *sep = "\n";
+        for (const auto &r : results) {
+            os << sep << "    {\"loss\": " << r.loss << ", \"ok\": " << r.ok << ", \"wall_seconds\": " << r.wall_seconds
+               << ", \"p50_ms\": " << percentile(r.elapsed_ms, 0.5) << ", \"p99_ms\": " << percentile(r.elapsed_ms, 0.99)
+               << ", \"max_ms\": " << percentile(r.elapsed_ms, 1.0)
+               << ", \"recovery_ms\": " << recovery(r)
+               << ", \"retransmits\": " << r.retransmits << ", \"duplicates\": " << r.duplicates
+               << ", \"server_timeouts\": " << r.server_timeouts << "}";
+            sep = ",\n";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -9,6 +9,18 @@ struct PrintNum
     void operator()(size_t i) const { std::cout << i << '\n'; }
 };
 
+struct PrintReport
+{
+    void operator()(const tftpd::transfer_report &r) const
+    {
+        std::cout << r.peer_address << ':' << r.peer_port << ' ' << r.filename << " status:" << static_cast<int>(r.status)
+                  << " error:" << r.error << " bytes:" << r.bytes << " blocks:" << r.blocks << " blksize:" << r.blksize
+                  << " duration:" << r.duration.count() << "us throughput:" << r.throughput
+                  << "B/s retransmits:" << r.retransmits << " duplicates:" << r.duplicates << " rtt:" << r.rtt.count()
+                  << "us\n";
+    }
+};
+
 int main(int argc, char *argv[])
 {
     try {
@@ -18,7 +30,7 @@ int main(int argc, char *argv[])
         }
 
         auto port = static_cast<uint16_t>(std::strtoul(argv[1], nullptr, 10));
-        auto filename = tftpd::receive_file("/tmp/tftpboot", port, PrintNum());
+        auto filename = tftpd::receive_file("/tmp/tftpboot", port, PrintNum(), PrintReport());
         if (!filename.empty()) {
             std::cout << "Successfully received: " << filename << "\n\n";
         }
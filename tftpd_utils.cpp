@@ -44,6 +44,11 @@ char copyright[] = "@(#) Copyright (c) 1983 Regents of the University of Califor
  */
 
 #include "async_tftpd_server.hpp"
+#include "file_cache.hpp"
+#include "root_index.hpp"
+#include "storage.hpp"
+#include "tftpd_options.hpp"
+#include "virtual_files.hpp"
 #include "tftp/tftpsubs.h"
 
 #include <boost/algorithm/string/case_conv.hpp>
@@ -70,12 +75,17 @@ char copyright[] = "@(#) Copyright (c) 1983 Regents of the University of Califor
 #endif
 
 namespace tftpd {
-extern const char *g_rootdir; // the only tftp root dir used!
-
-void init_opt();
-void do_opt(const char *opt, const char *val, char **ackbuf_ptr);
-int validate_access(std::string &filename, int mode, FILE *&file);
-int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path, std::vector<char> &optack);
+extern storage_selector g_storage;
+extern dedup_store g_dedup;
+extern file_cache g_files;
+extern virtual_files g_providers;
+extern root_index g_index;
+
+int validate_access(std::string &filename, int mode, const std::string &rootdir, std::unique_ptr<storage_sink> &sink,
+                    content_ptr *source);
+int tftp(const std::vector<char> &rxbuffer, std::unique_ptr<storage_sink> &sink, std::string &file_path,
+         std::vector<char> &optack, session_options &negotiated, const std::string &rootdir,
+         content_ptr *source = nullptr);
 
 /// the only directory used by the tftpd
 ///
@@ -105,9 +115,30 @@ static struct formats formats[] = { // XXX {"netascii", /* validate_access, send
     {nullptr, false}};
 
 /*
- * Handle initial connection protocol.
+ * stat(2) the file, from the root_index if it knows it.
+ */
+static int stat_file(const std::string &filename, struct stat &st)
+{
+    switch (g_index.lookup(filename, st)) {
+    case root_index::lookup_result::found:
+        return 0;
+    case root_index::lookup_result::absent:
+        errno = ENOENT;
+        return -1;
+    case root_index::lookup_result::unknown:
+        break;
+    }
+    return stat(filename.c_str(), &st);
+}
+
+/*
+ * Handle initial connection protocol.  An upload (WRQ) opens the sink, a
+ * download (RRQ) the source of the file, if the caller takes one.  The
+ * options are negotiated for the session of the request only, the file
+ * is one of its rootdir.
  */
-int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path, std::vector<char> &optack)
+int tftp(const std::vector<char> &rxbuffer, std::unique_ptr<storage_sink> &sink, std::string &file_path,
+         std::vector<char> &optack, session_options &negotiated, const std::string &rootdir, content_ptr *source)
 {
     // see too async_tftpd_server.cpp
     boost::filesystem::path const dir(*dirs);
@@ -118,8 +149,11 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
 #endif
 
     syslog(LOG_NOTICE, "%s(%lu)\n", BOOST_CURRENT_FUNCTION, rxbuffer.size());
-    init_opt();
-    file = nullptr;
+    init_opt(negotiated);
+    sink.reset();
+    if (source != nullptr) {
+        source->reset();
+    }
 
     assert(rxbuffer.size() >= TFTP_HEADER);
 
@@ -129,6 +163,11 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
         syslog(LOG_ERR, "tftpd: invalid opcode request!\n");
         return (EBADID);
     }
+    if (th_opcode == RRQ && source == nullptr) {
+        optack.clear();
+        syslog(LOG_WARNING, "tftpd: Only upload supported!\n");
+        return (EBADOP);
+    }
 
     const char *cp = nullptr;
     const char *mode = nullptr;
@@ -174,9 +213,8 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
                 return EBADOP;
             }
 
-            // NOTE: set g_tsize and tsize_ok flag in case of RRQ (unsupported yet)! CK
             file_path = filename;
-            int const ecode = validate_access(file_path, th_opcode, file);
+            int const ecode = validate_access(file_path, th_opcode, rootdir, sink, source);
             if (ecode != 0) {
                 optack.clear();
                 if (suppress_error && *filename != '/' && ecode == ENOTFOUND) {
@@ -185,12 +223,16 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
                 }
                 return (ecode);
             }
+            // NOTE: the size of a RRQ for the tsize option! CK
+            if (source != nullptr && *source) {
+                negotiated.tsize = static_cast<off_t>((*source)->size());
+            }
 
             opt = ++cp;
         } else if ((argn & 1) != 0) {
             val = ++cp; // NOTE: odd arg has to be the value
         } else {
-            do_opt(opt, val, &ap);
+            do_opt(opt, val, &ap, negotiated);
             opt = ++cp;
         }
     }
@@ -201,16 +243,12 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
         syslog(LOG_NOTICE, "tftpd: Request has no options");
     }
 
-    if (th_opcode == RRQ) {
-        optack.clear();
-        // NOTE: NEVER! (*pf->f_send)(pf); // sendfile() CK
-        syslog(LOG_WARNING, "tftpd: Only upload supported!\n");
-        return (EBADOP);
-    }
-
     if (argn > 2) {
         optack.resize(ack_length);
     }
+    if (sink && negotiated.tsize > 0) {
+        sink->expect(static_cast<uint64_t>(negotiated.tsize));
+    }
     return 0; // OK
 }
 
@@ -221,8 +259,12 @@ int tftp(const std::vector<char> &rxbuffer, FILE *&file, std::string &file_path,
  * publicly readable/writable.  If we were invoked with arguments from inetd
  * then the file must also be in one of the given directory prefixes.
  * Note also, full path name must be given as we have no login directory.
+ * An upload goes to the sink of the storage selector, if it returns one,
+ * else to the file.  A download is rendered by the file_provider of its
+ * path, if one has it, else sent from the file_cache.
  */
-int validate_access(std::string &filename, int mode, FILE *&file)
+int validate_access(std::string &filename, int mode, const std::string &rootdir, std::unique_ptr<storage_sink> &sink,
+                    content_ptr *source)
 {
     using boost::algorithm::starts_with;
 
@@ -246,16 +288,26 @@ int validate_access(std::string &filename, int mode, FILE *&file)
     }
 
     if (secure_tftp || filename[0] != '/') {
-        syslog(LOG_NOTICE, "tftpd: Check file access at %s\n", g_rootdir);
-        if (chdir(g_rootdir) < 0) {
-            syslog(LOG_WARNING, "tftpd: chdir: %s\n", strerror(errno));
+        // NOTE: no chdir(), the listeners of a process may serve different rootdirs! CK
+        syslog(LOG_NOTICE, "tftpd: Check file access at %s\n", rootdir.c_str());
+        if (access(rootdir.c_str(), X_OK) < 0) {
+            syslog(LOG_WARNING, "tftpd: access: %s\n", strerror(errno));
             return (EACCESS);
         }
 
         while (filename[0] == '/') {
             filename = filename.substr(1);
         }
-        filename = std::string(g_rootdir) + "/" + filename;
+        if (mode == RRQ) {
+            assert(source != nullptr);
+            *source = g_providers.open(filename);
+            if (*source) {
+                filename = rootdir + "/" + filename;
+                syslog(LOG_NOTICE, "tftpd: %s from its provider\n", filename.c_str());
+                return 0; // OK
+            }
+        }
+        filename = rootdir + "/" + filename;
     } else {
         // NOLINTNEXTLINE
         for (dirp = dirs; *dirp != 0; dirp++) {
@@ -270,7 +322,34 @@ int validate_access(std::string &filename, int mode, FILE *&file)
         syslog(LOG_NOTICE, "tftpd: Check access to file %s\n", filename.c_str());
     }
 
-    if (stat(filename.c_str(), &stbuf) < 0) {
+    std::string objects;
+    if (mode == WRQ && g_dedup.enabled) {
+        objects = boost::filesystem::path(rootdir + "/" + g_dedup.directory).lexically_normal().string();
+        if (starts_with(boost::filesystem::path(filename).lexically_normal().string(), objects + "/")) {
+            syslog(LOG_WARNING, "tftpd: Blocked upload into the object store %s\n", filename.c_str());
+            return (EACCESS);
+        }
+    }
+
+    if (mode == WRQ && g_storage != nullptr) {
+        sink = g_storage(filename);
+        if (sink) {
+            syslog(LOG_NOTICE, "tftpd: upload of %s to the storage selected\n", filename.c_str());
+            return 0; // OK
+        }
+    }
+
+    if (!objects.empty()) {
+        if (mkdir(objects.c_str(), 0777) != 0 && errno != EEXIST) {
+            syslog(LOG_ERR, "tftpd: mkdir(%s) failed! %s\n", objects.c_str(), strerror(errno));
+            return (errno + ERRNO_OFFSET);
+        }
+        sink = std::make_unique<dedup_sink>(objects, filename, g_dedup.link, g_dedup.spill);
+        syslog(LOG_NOTICE, "tftpd: upload of %s to the object store\n", filename.c_str());
+        return 0; // OK
+    }
+
+    if (stat_file(filename, stbuf) < 0) {
         // stat error, no such file or no read access
         if (mode == RRQ && secure_tftp) {
             syslog(LOG_WARNING, "tftpd: File not found %s\n", filename.c_str());
@@ -296,14 +375,28 @@ int validate_access(std::string &filename, int mode, FILE *&file)
     }
 #endif
 
-    std::string tmpname = filename;
     if (mode == RRQ) {
         if ((stbuf.st_mode & S_IROTH) == 0) {
             syslog(LOG_WARNING, "tftpd: File has not S_IROTH set\n");
             return (EACCESS);
         }
+        if (!S_ISREG(stbuf.st_mode)) {
+            syslog(LOG_WARNING, "tftpd: Not a regular file %s\n", filename.c_str());
+            return (EACCESS);
+        }
 
-    } else if (!allow_create) {
+        assert(source != nullptr);
+        int error = 0;
+        *source = g_files.open(filename, stbuf, error);
+        if (!*source) {
+            return error;
+        }
+        syslog(LOG_NOTICE, "tftpd: successfully open file: %s\n", filename.c_str());
+        return 0; // OK
+    }
+
+    std::string tmpname = filename;
+    if (!allow_create) {
         if ((stbuf.st_mode & S_IWOTH) == 0) {
             syslog(LOG_WARNING, "tftpd: File has not S_IWOTH set\n");
             return (EACCESS);
@@ -312,14 +405,17 @@ int validate_access(std::string &filename, int mode, FILE *&file)
         tmpname.append(".upload");
     }
 
-    fd = open(tmpname.c_str(), (mode == RRQ ? O_RDONLY : (O_WRONLY | O_TRUNC | O_CREAT)), 0666);
+    fd = open(tmpname.c_str(), O_WRONLY | O_TRUNC | O_CREAT, 0666);
     if (fd < 0) {
         return (errno + ERRNO_OFFSET);
     }
-    file = fdopen(fd, (mode == RRQ) ? "r" : "w");
+    FILE *file = fdopen(fd, "w");
     if (file == nullptr) {
-        return errno + ERRNO_OFFSET;
+        int const error = errno + ERRNO_OFFSET;
+        (void)close(fd);
+        return error;
     }
+    sink = std::make_unique<file_sink>(file, filename, tmpname);
 
     syslog(LOG_NOTICE, "tftpd: successfully open file: %s\n", tmpname.c_str());
     return 0; // OK
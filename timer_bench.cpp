@@ -0,0 +1,146 @@
+// NOTE: benchmark of the session timeout re-arm, steady_timer versus timer_wheel! CK
+//
+// Every server session re-arms its timeout on each block received: a
+// cancel, expires_after() and async_wait().  For 1k, 10k and 100k armed
+// timeouts of 1 to 5 seconds, the timers are re-armed round robin and the
+// io_context is polled for the canceled handlers after each round.  Results
+// go to stderr as a table and optional as JSON (--json=FILE, - for stdout).
+#include "timer_wheel.hpp"
+#include "transport.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct bench_result
+{
+    std::string timer;
+    size_t timers{0};
+    size_t rearms{0};
+    double ns_per_rearm{0};
+};
+
+template <typename Timer> bench_result run_case(const char *name, size_t count, size_t rearms)
+{
+    boost::asio::io_context io_context;
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<std::chrono::milliseconds> timeouts;
+    std::mt19937 random(1); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    std::uniform_int_distribution<int> timeout(1000, 5000);
+    uint64_t completed = 0;
+    auto handler = [&completed](const boost::system::error_code & /*ec*/) { completed++; };
+    for (size_t i = 0; i < count; ++i) {
+        timers.push_back(std::make_unique<Timer>(io_context));
+        timeouts.emplace_back(timeout(random));
+        timers.back()->expires_after(timeouts.back());
+        timers.back()->async_wait(handler);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    size_t done = 0;
+    while (done < rearms) {
+        for (size_t i = 0; i < count && done < rearms; ++i, ++done) {
+            auto &timer = *timers[i];
+            timer.cancel();
+            timer.expires_after(timeouts[i]);
+            timer.async_wait(handler);
+        }
+        (void)io_context.poll();
+    }
+    auto const elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+    bench_result res;
+    res.timer = name;
+    res.timers = count;
+    res.rearms = rearms;
+    res.ns_per_rearm = elapsed.count() / static_cast<double>(rearms);
+    return res;
+}
+
+std::vector<size_t> parse_list(const std::string &arg)
+{
+    std::vector<size_t> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        char *end = nullptr;
+        size_t v = std::strtoul(item.c_str(), &end, 10);
+        if (*end == 'k' || *end == 'K') {
+            v *= 1000;
+        }
+        list.push_back(v);
+    }
+    return list;
+}
+
+void write_json(std::ostream &os, const std::vector<bench_result> &results)
+{
+    os << "{\n  \"benchmark\": \"timer_bench\",\n  \"results\": [";
+    const char *sep = "\n";
+    for (const auto &r : results) {
+        os << sep << "    {\"timer\": \"" << r.timer << "\", \"timers\": " << r.timers << ", \"rearms\": " << r.rearms
+           << ", \"ns_per_rearm\": " << r.ns_per_rearm << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cerr << "Usage: timer_bench [--timers=LIST] [--rearms=N] [--json=FILE|-]\n"
+                 "       LIST is comma separated, counts may use k suffix\n\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> counts{1000, 10000, 100000};
+    size_t rearms = 1000000;
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg(argv[i]);
+        auto value = [&arg]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.rfind("--timers=", 0) == 0) {
+            counts = parse_list(value());
+        } else if (arg.rfind("--rearms=", 0) == 0) {
+            rearms = std::strtoul(value().c_str(), nullptr, 10);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = value();
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<bench_result> results;
+    fprintf(stderr, "%-8s %8s %10s %12s\n", "timer", "timers", "rearms", "ns/rearm");
+    for (auto count : counts) {
+        for (auto const &r : {run_case<tftpd::steady_session_timer>("steady", count, rearms),
+                              run_case<tftpd::wheel_session_timer>("wheel", count, rearms)}) {
+            fprintf(stderr, "%-8s %8zu %10zu %12.1f\n", r.timer.c_str(), r.timers, r.rearms, r.ns_per_rearm);
+            results.push_back(r);
+        }
+    }
+
+    if (json == "-") {
+        write_json(std::cout, results);
+    } else if (!json.empty()) {
+        std::ofstream os(json);
+        write_json(os, results);
+    }
+
+    return EXIT_SUCCESS;
+}
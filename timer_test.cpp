@@ -0,0 +1,131 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the session timeouts on the timer_wheel, in real time! CK
+
+#include "timer_wheel.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+using namespace std::chrono_literals;
+using clock_type = tftpd::session_timer::clock_type;
+
+constexpr auto slack{50ms}; // NOTE: for a loaded machine
+
+} // namespace
+
+int main()
+{
+    try {
+        boost::asio::io_context io_context;
+        auto const &wheel = boost::asio::use_service<tftpd::timer_wheel>(io_context);
+
+        // a timeout expires not before its time, within a tick
+        {
+            tftpd::wheel_session_timer timer(io_context);
+            auto const start = clock_type::now();
+            clock_type::time_point fired{};
+            timer.expires_after(100ms);
+            timer.async_wait([&fired](const boost::system::error_code &ec) {
+                assert(!ec);
+                fired = clock_type::now();
+            });
+            assert(wheel.armed() == 1);
+            (void)io_context.run();
+            assert(fired >= start + 100ms);
+            assert(fired < start + 100ms + tftpd::timer_wheel::resolution + slack);
+            assert(wheel.armed() == 0);
+        }
+
+        // canceled, the wait completes with operation_aborted and the io_context runs out of work
+        {
+            io_context.restart();
+            tftpd::wheel_session_timer timer(io_context);
+            boost::system::error_code error;
+            timer.expires_after(10s);
+            timer.async_wait([&error](const boost::system::error_code &ec) { error = ec; });
+            boost::asio::post(io_context, [&timer] { timer.cancel(); });
+            auto const start = clock_type::now();
+            (void)io_context.run();
+            assert(error == boost::asio::error::operation_aborted);
+            assert(clock_type::now() < start + 1s);
+        }
+
+        // re-armed, the timeout moves to the new expiry and an earlier one is aborted
+        {
+            io_context.restart();
+            tftpd::wheel_session_timer early(io_context);
+            tftpd::wheel_session_timer timer(io_context);
+            auto const start = clock_type::now();
+            clock_type::time_point fired{};
+            int aborted = 0;
+            timer.expires_after(50ms);
+            timer.async_wait([&aborted](const boost::system::error_code &ec) {
+                assert(ec == boost::asio::error::operation_aborted);
+                aborted++;
+            });
+            timer.expires_after(200ms);
+            timer.async_wait([&fired](const boost::system::error_code &ec) {
+                assert(!ec);
+                fired = clock_type::now();
+            });
+            // NOTE: an earlier timeout armed later wakes the wheel up sooner
+            clock_type::time_point early_fired{};
+            early.expires_after(20ms);
+            early.async_wait([&early_fired](const boost::system::error_code &ec) {
+                assert(!ec);
+                early_fired = clock_type::now();
+            });
+            (void)io_context.run();
+            assert(aborted == 1);
+            assert(early_fired >= start + 20ms && early_fired < start + 20ms + slack);
+            assert(fired >= start + 200ms && fired < start + 200ms + slack);
+        }
+
+        // a timeout beyond one revolution of the wheel waits rounds in its slot
+        {
+            io_context.restart();
+            tftpd::wheel_session_timer timer(io_context);
+            auto const revolution = tftpd::timer_wheel::resolution * tftpd::timer_wheel::slots;
+            auto const start = clock_type::now();
+            clock_type::time_point fired{};
+            timer.expires_after(revolution + 200ms);
+            timer.async_wait([&fired](const boost::system::error_code &ec) {
+                assert(!ec);
+                fired = clock_type::now();
+            });
+            (void)io_context.run();
+            assert(fired >= start + revolution + 200ms);
+            assert(fired < start + revolution + 200ms + slack);
+        }
+
+        // destroyed while armed, the timer is unlinked
+        {
+            io_context.restart();
+            {
+                tftpd::wheel_session_timer timer(io_context);
+                timer.expires_after(1s);
+                timer.async_wait([](const boost::system::error_code & /*ec*/) { assert(false); });
+                assert(wheel.armed() == 1);
+            }
+            assert(wheel.armed() == 0);
+            auto const start = clock_type::now();
+            (void)io_context.run();
+            assert(clock_type::now() < start + 1s);
+        }
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
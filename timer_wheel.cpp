@@ -0,0 +1,197 @@
+#include "timer_wheel.hpp"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+
+namespace tftpd {
+
+boost::asio::io_context::id timer_wheel::id;
+
+//----------------------------------------------------------------------
+// timer_wheel
+//----------------------------------------------------------------------
+timer_wheel::timer_wheel(boost::asio::io_context &io_context)
+    : boost::asio::io_context::service(io_context), timer_(io_context),
+      memory_(std::make_shared<handler_memory>()), origin_(clock_type::now())
+{}
+
+void timer_wheel::shutdown()
+{
+    // NOTE: the handlers are destroyed without being called, as asio does
+    for (auto &head : slots_) {
+        while (head != nullptr) {
+            auto *timer = head;
+            head = timer->next_;
+            timer->linked_ = false;
+            timer->prev_ = timer->next_ = nullptr;
+            timer->waits_.clear();
+        }
+    }
+    armed_ = 0;
+}
+
+uint64_t timer_wheel::tick_of(clock_type::time_point t) const
+{
+    if (t <= origin_) {
+        return 0;
+    }
+    auto const ticks = (t - origin_ + resolution - clock_type::duration(1)) / resolution;
+    return static_cast<uint64_t>(ticks);
+}
+
+timer_wheel::clock_type::time_point timer_wheel::time_of(uint64_t tick) const
+{
+    return origin_ + resolution * static_cast<clock_type::rep>(tick);
+}
+
+void timer_wheel::link(wheel_session_timer &timer)
+{
+    if (!ticking_) {
+        // NOTE: idle, the ticks since are skipped
+        uint64_t const now = tick_of(clock_type::now());
+        current_ = std::max(current_, (now > 0) ? now - 1 : 0);
+    }
+
+    uint64_t const tick = std::max(tick_of(timer.expiry_), current_);
+    timer.slot_ = tick & (slots - 1);
+    timer.rounds_ = (tick - current_) / slots;
+    timer.prev_ = nullptr;
+    timer.next_ = slots_[timer.slot_];
+    if (timer.next_ != nullptr) {
+        timer.next_->prev_ = &timer;
+    }
+    slots_[timer.slot_] = &timer;
+    timer.linked_ = true;
+    armed_++;
+
+    schedule(tick);
+}
+
+void timer_wheel::unlink(wheel_session_timer &timer)
+{
+    if (timer.prev_ != nullptr) {
+        timer.prev_->next_ = timer.next_;
+    } else {
+        slots_[timer.slot_] = timer.next_;
+    }
+    if (timer.next_ != nullptr) {
+        timer.next_->prev_ = timer.prev_;
+    }
+    timer.prev_ = timer.next_ = nullptr;
+    timer.linked_ = false;
+    armed_--;
+
+    if (armed_ == 0 && ticking_ && !idle_check_) {
+        // NOTE: later, a timeout is canceled to be re-armed mostly
+        idle_check_ = true;
+        auto check = [this] {
+            idle_check_ = false;
+            if (armed_ == 0 && ticking_) {
+                ticking_ = false;
+                (void)timer_.cancel(); // NOTE: so the io_context may run out of work
+            }
+        };
+        boost::asio::post(get_io_context(), allocated_handler<decltype(check)>(memory_, check));
+    }
+}
+
+void timer_wheel::schedule(uint64_t tick)
+{
+    if (ticking_ && tick >= scheduled_) {
+        return; // NOTE: the common case, a timeout re-armed to a later tick
+    }
+    ticking_ = true;
+    scheduled_ = tick;
+    (void)timer_.expires_at(time_of(tick)); // NOTE: cancels a wait pending
+    timer_.async_wait(allocated_handler<wait_handler>(memory_, [this](const boost::system::error_code &ec) {
+        if (!ec) {
+            ticking_ = false;
+            advance();
+        }
+    }));
+}
+
+void timer_wheel::advance()
+{
+    auto const now = clock_type::now();
+    while (armed_ > 0 && time_of(current_) <= now) {
+        auto &head = slots_[current_ & (slots - 1)];
+        auto *timer = head;
+        head = nullptr;
+        while (timer != nullptr) {
+            auto *next = timer->next_;
+            if (timer->rounds_ > 0) {
+                timer->rounds_--;
+                timer->prev_ = nullptr;
+                timer->next_ = head;
+                if (head != nullptr) {
+                    head->prev_ = timer;
+                }
+                head = timer;
+            } else {
+                timer->prev_ = timer->next_ = nullptr;
+                timer->linked_ = false;
+                armed_--;
+                timer->complete({}); // NOTE: posted, the handler may destroy timers
+            }
+            timer = next;
+        }
+        current_++;
+    }
+
+    // wake up at the next slot linked to only
+    for (uint64_t tick = current_; armed_ > 0; ++tick) {
+        if (slots_[tick & (slots - 1)] != nullptr) {
+            schedule(tick);
+            break;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// wheel_session_timer
+//----------------------------------------------------------------------
+wheel_session_timer::wheel_session_timer(boost::asio::io_context &io_context)
+    : wheel_(boost::asio::use_service<timer_wheel>(io_context)), memory_(std::make_shared<handler_memory>())
+{}
+
+wheel_session_timer::~wheel_session_timer()
+{
+    if (linked_) {
+        wheel_.unlink(*this);
+    }
+}
+
+void wheel_session_timer::expires_after(clock_type::duration expiry)
+{
+    cancel();
+    expiry_ = now() + expiry;
+}
+
+void wheel_session_timer::async_wait(wait_handler handler)
+{
+    waits_.push_back(std::move(handler));
+    if (!linked_) {
+        wheel_.link(*this);
+    }
+}
+
+void wheel_session_timer::cancel()
+{
+    if (linked_) {
+        wheel_.unlink(*this);
+    }
+    complete(boost::asio::error::operation_aborted);
+}
+
+void wheel_session_timer::complete(const boost::system::error_code &error)
+{
+    for (auto &handler : waits_) {
+        auto call = [handler = std::move(handler), error] { handler(error); };
+        boost::asio::post(wheel_.get_io_context(), allocated_handler<decltype(call)>(memory_, std::move(call)));
+    }
+    waits_.clear();
+}
+
+} // namespace tftpd
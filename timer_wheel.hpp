@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * Hashed timing wheel for the session timeouts.
+ *
+ * Every server session re-arms its timeout on each block received.  With a
+ * steady_timer per session that is a cancel and an insert into the timer
+ * queue of the reactor per packet.  A timer_wheel is an io_context service
+ * with a ring of slots of resolution wide ticks and a single steady_timer,
+ * which only runs while any wheel timer is armed.  Arming links a timer
+ * into the slot of its expiry and canceling unlinks it, both O(1); a
+ * timeout beyond one revolution of the wheel waits some rounds in its
+ * slot.  The expiry is rounded up to the next tick.
+ *
+ * The timers of a wheel are used by the thread running its io_context only.
+ */
+#include "transport.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tftpd {
+
+class wheel_session_timer;
+
+class timer_wheel : public boost::asio::io_context::service
+{
+public:
+    using clock_type = session_timer::clock_type;
+
+    static boost::asio::io_context::id id; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+    static constexpr std::chrono::milliseconds resolution{10};
+    static constexpr size_t slots{128}; ///< a power of 2
+
+    explicit timer_wheel(boost::asio::io_context &io_context);
+    ~timer_wheel() override = default;
+
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel &operator=(const timer_wheel &) = delete;
+
+    size_t armed() const { return armed_; } ///< timers linked into a slot
+
+private:
+    friend class wheel_session_timer;
+
+    void shutdown() override;
+
+    void link(wheel_session_timer &timer);
+    void unlink(wheel_session_timer &timer);
+
+    /// expire the slots due until now, called by the steady_timer
+    void advance();
+
+    /// wake up at the tick, if not earlier already
+    void schedule(uint64_t tick);
+
+    /// the first tick at or after the time
+    uint64_t tick_of(clock_type::time_point t) const;
+    clock_type::time_point time_of(uint64_t tick) const;
+
+    boost::asio::steady_timer timer_;
+    std::shared_ptr<handler_memory> memory_;
+    clock_type::time_point origin_; // of tick 0
+    uint64_t current_{0};           // the next tick to expire
+    uint64_t scheduled_{0};         // the tick the steady_timer waits for
+    size_t armed_{0};
+    bool ticking_{false};
+    bool idle_check_{false};
+    std::array<wheel_session_timer *, slots> slots_{}; // NOTE: heads of doubly linked lists
+};
+
+/// a session_timer on the timer_wheel of an io_context
+class wheel_session_timer : public session_timer
+{
+public:
+    explicit wheel_session_timer(boost::asio::io_context &io_context);
+    ~wheel_session_timer() override;
+
+    wheel_session_timer(const wheel_session_timer &) = delete;
+    wheel_session_timer &operator=(const wheel_session_timer &) = delete;
+
+    clock_type::time_point now() const override { return clock_type::now(); }
+    void expires_after(clock_type::duration expiry) override;
+    void async_wait(wait_handler handler) override;
+    void cancel() override;
+
+private:
+    friend class timer_wheel;
+
+    /// the pending waits complete with the error given
+    void complete(const boost::system::error_code &error);
+
+    timer_wheel &wheel_;
+    std::shared_ptr<handler_memory> memory_;
+    clock_type::time_point expiry_{};
+    std::vector<wait_handler> waits_; // NOTE: reused, no allocation per wait
+
+    // the slot linked to
+    bool linked_{false};
+    size_t slot_{0};
+    uint64_t rounds_{0};
+    wheel_session_timer *prev_{nullptr};
+    wheel_session_timer *next_{nullptr};
+};
+
+} // namespace tftpd
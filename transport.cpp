@@ -0,0 +1,122 @@
+#include "transport.hpp"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <vector>
+
+namespace tftpd {
+
+void *handler_memory::allocate(std::size_t size)
+{
+    if (size <= slot_size) {
+        for (std::size_t i = 0; i < slots; ++i) {
+            if (!used_[i].exchange(true, std::memory_order_acquire)) {
+                return storage_[i].storage;
+            }
+        }
+    }
+    return ::operator new(size); // NOTE: all in use or too large
+}
+
+void handler_memory::deallocate(void *pointer)
+{
+    for (std::size_t i = 0; i < slots; ++i) {
+        if (pointer == storage_[i].storage) {
+            used_[i].store(false, std::memory_order_release);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
+
+void udp_transport::send_to(boost::asio::const_buffer buffer, const endpoint &destination)
+{
+    boost::system::error_code ec;
+    (void)socket_.send_to(buffer, destination, 0, ec);
+}
+
+void udp_transport::rebind(boost::system::error_code &ec)
+{
+    auto const local = socket_.local_endpoint(ec);
+    if (ec) {
+        return;
+    }
+    // NOTE: bound before the old socket is closed, it still reaches the peer on failure
+    boost::asio::ip::udp::socket socket(socket_.get_executor());
+    (void)socket.open(local.protocol(), ec);
+    if (!ec) {
+        (void)socket.bind(endpoint(local.protocol(), 0), ec);
+    }
+    if (!ec) {
+        socket_ = std::move(socket);
+    }
+}
+
+impairment_model::fate impairment_model::next()
+{
+    // NOTE: always draw the same number of values per datagram
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double const u_loss = uniform(rng_);
+    double const u_duplicate = uniform(rng_);
+    double const u_reorder = uniform(rng_);
+    double const u_jitter = uniform(rng_);
+
+    fate f;
+    stats_.datagrams++;
+    if (u_loss < profile_.loss) {
+        stats_.dropped++;
+        f.copies = 0;
+        return f;
+    }
+    if (u_duplicate < profile_.duplicate) {
+        stats_.duplicated++;
+        f.copies = 2;
+    }
+    f.delay = profile_.delay + std::chrono::duration_cast<std::chrono::microseconds>(profile_.jitter * u_jitter);
+    if (u_reorder < profile_.reorder) {
+        stats_.reordered++;
+        f.delay += profile_.reorder_delay;
+    }
+    if (f.delay.count() > 0) {
+        stats_.delayed++;
+    }
+    return f;
+}
+
+void impaired_transport::async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                                       transport_handler handler)
+{
+    send_to(buffer, destination);
+    boost::asio::post(io_context_, [handler = std::move(handler), n = buffer.size()] { handler({}, n); });
+}
+
+void impaired_transport::send_to(boost::asio::const_buffer buffer, const endpoint &destination)
+{
+    auto const f = model_.next();
+    if (f.copies == 0) {
+        return; // lost
+    }
+
+    if (f.delay.count() == 0) {
+        for (unsigned i = 0; i < f.copies; ++i) {
+            next_.send_to(buffer, destination);
+        }
+        return;
+    }
+
+    auto const *p = static_cast<const char *>(buffer.data());
+    auto data = std::make_shared<std::vector<char>>(p, p + buffer.size());
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_context_, f.delay);
+    timer->async_wait([this, alive = std::weak_ptr<int>(alive_), timer, data, destination,
+                       copies = f.copies](boost::system::error_code ec) {
+        if (ec || alive.expired() || !next_.is_open()) {
+            return;
+        }
+        for (unsigned i = 0; i < copies; ++i) {
+            next_.send_to(boost::asio::buffer(*data), destination);
+        }
+    });
+}
+
+} // namespace tftpd
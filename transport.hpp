@@ -0,0 +1,352 @@
+#pragma once
+
+/*
+ * Datagram transport and timer used by the tftpd server sessions and the
+ * client.
+ *
+ * The interfaces cover just what the TFTP state machines need from a UDP
+ * socket and a steady timer.  udp_transport and steady_session_timer are
+ * the real thing, impaired_transport a shim on top of any transport that
+ * drops, duplicates, reorders and delays the datagrams it sends, driven by
+ * a seeded random generator so test runs and benchmarks with network
+ * impairment are reproducible.  See simulation.hpp for virtual time.
+ */
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+namespace tftpd {
+
+using transport_handler = std::function<void(const boost::system::error_code &, std::size_t)>;
+using wait_handler = std::function<void(const boost::system::error_code &)>;
+
+/// a few blocks recycled for the asynchronous operations of one socket or
+/// timer, so the operations in flight per packet need no heap allocation
+class handler_memory
+{
+public:
+    handler_memory() = default;
+    handler_memory(const handler_memory &) = delete;
+    handler_memory &operator=(const handler_memory &) = delete;
+
+    void *allocate(std::size_t size);
+    void deallocate(void *pointer);
+
+private:
+    static constexpr std::size_t slots{4};
+    static constexpr std::size_t slot_size{512};
+
+    struct slot
+    {
+        alignas(std::max_align_t) unsigned char storage[slot_size];
+    };
+
+    std::array<slot, slots> storage_{};
+    std::array<std::atomic<bool>, slots> used_{};
+};
+
+/// the associated allocator of a handler_memory
+template <typename T> class handler_allocator
+{
+public:
+    using value_type = T;
+
+    explicit handler_allocator(std::shared_ptr<handler_memory> memory) : memory_(std::move(memory)) {}
+
+    template <typename U> handler_allocator(const handler_allocator<U> &other) : memory_(other.memory_) {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(memory_->allocate(sizeof(T) * n)); }
+    void deallocate(T *p, std::size_t /*n*/) { memory_->deallocate(p); }
+
+    template <typename U> bool operator==(const handler_allocator<U> &other) const { return memory_ == other.memory_; }
+    template <typename U> bool operator!=(const handler_allocator<U> &other) const { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class handler_allocator;
+
+    // NOTE: shared, an operation canceled may be destroyed after its socket
+    std::shared_ptr<handler_memory> memory_;
+};
+
+/// a completion handler with a handler_allocator
+template <typename Handler> class allocated_handler
+{
+public:
+    using allocator_type = handler_allocator<Handler>;
+
+    allocated_handler(std::shared_ptr<handler_memory> memory, Handler handler)
+        : memory_(std::move(memory)), handler_(std::move(handler))
+    {}
+
+    allocator_type get_allocator() const { return allocator_type(memory_); }
+
+    template <typename... Args> void operator()(Args &&...args) { handler_(std::forward<Args>(args)...); }
+
+    const Handler &handler() const { return handler_; }
+
+private:
+    std::shared_ptr<handler_memory> memory_;
+    Handler handler_;
+};
+
+/// a completion token whose handler allocates from the handler memory, i.e.
+/// with_memory(memory, use_awaitable)
+template <typename CompletionToken> struct memory_token
+{
+    std::shared_ptr<handler_memory> memory_;
+    CompletionToken token_;
+};
+
+template <typename CompletionToken>
+memory_token<std::decay_t<CompletionToken>> with_memory(std::shared_ptr<handler_memory> memory, CompletionToken &&token)
+{
+    return {std::move(memory), std::forward<CompletionToken>(token)};
+}
+
+/// a one shot timer together with the clock it runs on
+class session_timer
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    virtual ~session_timer() = default;
+
+    virtual clock_type::time_point now() const = 0;
+
+    /// set the expiry time, pending waits are canceled
+    virtual void expires_after(clock_type::duration expiry) = 0;
+    virtual void async_wait(wait_handler handler) = 0;
+
+    /// pending waits complete with operation_aborted
+    virtual void cancel() = 0;
+};
+
+/// a boost::asio::steady_timer
+class steady_session_timer : public session_timer
+{
+public:
+    explicit steady_session_timer(boost::asio::io_context &io_context)
+        : memory_(std::make_shared<handler_memory>()), timer_(io_context)
+    {}
+
+    clock_type::time_point now() const override { return clock_type::now(); }
+    void expires_after(clock_type::duration expiry) override { (void)timer_.expires_after(expiry); }
+    void async_wait(wait_handler handler) override
+    {
+        timer_.async_wait(allocated_handler<wait_handler>(memory_, std::move(handler)));
+    }
+    void cancel() override { (void)timer_.cancel(); }
+
+private:
+    std::shared_ptr<handler_memory> memory_;
+    boost::asio::steady_timer timer_;
+};
+
+class datagram_transport
+{
+public:
+    using endpoint = boost::asio::ip::udp::endpoint;
+
+    virtual ~datagram_transport() = default;
+
+    virtual void async_receive_from(boost::asio::mutable_buffer buffer, endpoint &sender,
+                                    transport_handler handler) = 0;
+    virtual void async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                               transport_handler handler) = 0;
+
+    /// send without waiting for completion, a failure is a lost datagram
+    virtual void send_to(boost::asio::const_buffer buffer, const endpoint &destination) = 0;
+
+    /// cancel all asynchronous operations
+    virtual void cancel() = 0;
+    virtual void close() = 0;
+    virtual bool is_open() const = 0;
+
+    /// reopen on a new ephemeral port, i.e. a new TID after a request;
+    /// on failure the transport stays on its port and ec is set
+    virtual void rebind(boost::system::error_code &ec) = 0;
+};
+
+/// a real UDP socket
+class udp_transport : public datagram_transport
+{
+public:
+    /// @throw boost::system::system_error if the endpoint can't be bound
+    udp_transport(boost::asio::io_context &io_context, const endpoint &local)
+        : memory_(std::make_shared<handler_memory>()), socket_(io_context, local)
+    {}
+
+    void async_receive_from(boost::asio::mutable_buffer buffer, endpoint &sender, transport_handler handler) override
+    {
+        socket_.async_receive_from(buffer, sender, allocated_handler<transport_handler>(memory_, std::move(handler)));
+    }
+
+    void async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                       transport_handler handler) override
+    {
+        socket_.async_send_to(buffer, destination, allocated_handler<transport_handler>(memory_, std::move(handler)));
+    }
+
+    void send_to(boost::asio::const_buffer buffer, const endpoint &destination) override;
+
+    void cancel() override
+    {
+        boost::system::error_code ec;
+        (void)socket_.cancel(ec);
+    }
+    void close() override
+    {
+        boost::system::error_code ec;
+        (void)socket_.close(ec);
+    }
+    bool is_open() const override { return socket_.is_open(); }
+    void rebind(boost::system::error_code &ec) override;
+
+    boost::asio::ip::udp::socket &socket() { return socket_; }
+
+private:
+    std::shared_ptr<handler_memory> memory_;
+    boost::asio::ip::udp::socket socket_;
+};
+
+/// network impairment profile, probabilities are in [0, 1]
+struct impairment
+{
+    double loss{0};                                ///< datagram silently dropped
+    double duplicate{0};                           ///< datagram sent twice
+    double reorder{0};                             ///< datagram held back by reorder_delay
+    std::chrono::microseconds delay{0};            ///< added to every datagram
+    std::chrono::microseconds jitter{0};           ///< uniform random extra delay
+    std::chrono::microseconds reorder_delay{1000}; ///< so later datagrams overtake it
+    uint32_t seed{1};                              ///< of the random generator
+
+    bool enabled() const
+    {
+        return loss > 0 || duplicate > 0 || reorder > 0 || delay.count() > 0 || jitter.count() > 0;
+    }
+};
+
+/// counters of what an impairment_model did
+struct impairment_stats
+{
+    uint64_t datagrams{0};
+    uint64_t dropped{0};
+    uint64_t duplicated{0};
+    uint64_t reordered{0};
+    uint64_t delayed{0};
+};
+
+/// decides the fate of each datagram sent, deterministic for a given seed
+class impairment_model
+{
+public:
+    struct fate
+    {
+        unsigned copies{1}; ///< 0 if lost
+        std::chrono::microseconds delay{0};
+    };
+
+    explicit impairment_model(const impairment &profile) : profile_(profile), rng_(profile.seed) {}
+
+    fate next();
+
+    const impairment &profile() const { return profile_; }
+    const impairment_stats &stats() const { return stats_; }
+
+private:
+    impairment profile_;
+    std::mt19937 rng_;
+    impairment_stats stats_;
+};
+
+/// a transport that impairs the datagrams sent through it
+class impaired_transport : public datagram_transport
+{
+public:
+    impaired_transport(boost::asio::io_context &io_context, datagram_transport &next, const impairment &profile)
+        : io_context_(io_context), next_(next), model_(profile)
+    {}
+
+    void async_receive_from(boost::asio::mutable_buffer buffer, endpoint &sender, transport_handler handler) override
+    {
+        next_.async_receive_from(buffer, sender, std::move(handler));
+    }
+
+    /// completes as soon as the datagram is handed to the impairment
+    void async_send_to(boost::asio::const_buffer buffer, const endpoint &destination,
+                       transport_handler handler) override;
+    void send_to(boost::asio::const_buffer buffer, const endpoint &destination) override;
+
+    void cancel() override { next_.cancel(); }
+    void close() override { next_.close(); }
+    bool is_open() const override { return next_.is_open(); }
+    void rebind(boost::system::error_code &ec) override { next_.rebind(ec); }
+
+    const impairment_stats &stats() const { return model_.stats(); }
+
+private:
+    boost::asio::io_context &io_context_;
+    datagram_transport &next_;
+    impairment_model model_;
+    std::shared_ptr<int> alive_{std::make_shared<int>(0)}; // NOTE: guards delayed sends after destruction
+};
+
+} // namespace tftpd
+
+namespace boost::asio {
+
+/// the handler wrapped runs on its own executor
+template <typename Handler, typename Executor>
+struct associated_executor<tftpd::allocated_handler<Handler>, Executor>
+    : detail::associated_executor_forwarding_base<Handler, Executor> // NOTE: no work dispatcher if unspecialised
+{
+    using type = associated_executor_t<Handler, Executor>;
+
+    static type get(const tftpd::allocated_handler<Handler> &h, const Executor &ex = Executor()) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+};
+
+template <typename CompletionToken, typename Signature>
+struct async_result<tftpd::memory_token<CompletionToken>, Signature>
+{
+    using return_type = typename async_result<CompletionToken, Signature>::return_type;
+
+    template <typename Initiation> struct init_wrapper
+    {
+        std::shared_ptr<tftpd::handler_memory> memory_;
+        Initiation initiation_;
+
+        template <typename Handler, typename... Args> void operator()(Handler &&handler, Args &&...args)
+        {
+            std::move(initiation_)(
+                tftpd::allocated_handler<std::decay_t<Handler>>(memory_, std::forward<Handler>(handler)),
+                std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename Initiation, typename RawCompletionToken, typename... Args>
+    static return_type initiate(Initiation &&initiation, RawCompletionToken &&token, Args &&...args)
+    {
+        return async_initiate<CompletionToken, Signature>(
+            init_wrapper<std::decay_t<Initiation>>{token.memory_, std::forward<Initiation>(initiation)},
+            token.token_, std::forward<Args>(args)...);
+    }
+};
+
+} // namespace boost::asio
@@ -0,0 +1,107 @@
+#include "virtual_files.hpp"
+
+#include <fnmatch.h>
+
+#include <mutex>
+
+namespace tftpd {
+
+void virtual_files::add(const std::string &pattern, file_provider provider, const provider_cache &cache)
+{
+    auto p = std::make_unique<registered>();
+    p->pattern = pattern;
+    p->render = std::move(provider);
+    p->cache = cache;
+
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    providers_.push_back(std::move(p));
+    empty_ = false;
+}
+
+void virtual_files::invalidate(const std::string &pattern)
+{
+    std::shared_lock<std::shared_mutex> const lock(mutex_);
+    for (auto &p : providers_) {
+        if (p->pattern == pattern) {
+            std::unique_lock<std::shared_mutex> const files(p->mutex);
+            p->files.clear();
+            p->order.clear();
+        }
+    }
+}
+
+void virtual_files::clear()
+{
+    std::unique_lock<std::shared_mutex> const lock(mutex_);
+    providers_.clear();
+    empty_ = true;
+}
+
+content_ptr virtual_files::open(const std::string &path)
+{
+    if (empty_) {
+        return nullptr;
+    }
+
+    std::shared_lock<std::shared_mutex> const lock(mutex_);
+    for (auto &p : providers_) {
+        if (fnmatch(p->pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0) {
+            auto content = render(*p, path);
+            if (content) {
+                return content;
+            }
+        }
+    }
+    return nullptr;
+}
+
+content_ptr virtual_files::render(registered &p, const std::string &path)
+{
+    auto const now = clock_type::now();
+    if (p.cache.max_age.count() > 0) {
+        std::shared_lock<std::shared_mutex> const lock(p.mutex);
+        auto it = p.files.find(path);
+        if (it != p.files.end() && now - it->second.rendered < p.cache.max_age) {
+            hits_++;
+            return it->second.content;
+        }
+    }
+
+    auto data = p.render(path);
+    if (!data) {
+        return nullptr;
+    }
+    rendered_++;
+    file_stamp stamp;
+    stamp.size = static_cast<off_t>(data->size());
+    auto content = std::make_shared<file_content>(stamp, std::vector<char>(data->begin(), data->end()));
+    if (p.cache.max_age.count() <= 0 || p.cache.max_files == 0) {
+        return content;
+    }
+
+    std::unique_lock<std::shared_mutex> const lock(p.mutex);
+    p.files[path] = {content, now};
+    p.order.emplace_back(path, now);
+    // NOTE: drop the oldest beyond max_files, the ones expired and the records of the ones rendered again since
+    while (!p.order.empty()) {
+        auto const &oldest = p.order.front();
+        auto it = p.files.find(oldest.first);
+        bool const current = it != p.files.end() && it->second.rendered == oldest.second;
+        if (current && p.files.size() <= p.cache.max_files && now - oldest.second < p.cache.max_age) {
+            break;
+        }
+        if (current) {
+            p.files.erase(it);
+        }
+        p.order.pop_front();
+    }
+    return content;
+}
+
+void virtual_files::count(file_cache_counters &counters) const
+{
+    counters.rendered = rendered_;
+    counters.rendered_hits = hits_;
+}
+
+} // namespace tftpd
@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * The downloads rendered in memory by a file_provider.
+ *
+ * A provider answers the RRQs of the paths matching its fnmatch(3) pattern,
+ * i.e. the per MAC config files "pxelinux.cfg/01-*" of a PXE boot, from a
+ * template instead of thousands of files regenerated on disk.  What it
+ * rendered is kept as the immutable content of a file_cache, so the
+ * sessions send it the same way, until provider_cache::max_age passed or
+ * the provider was invalidated; the oldest rendered files are dropped
+ * beyond provider_cache::max_files.
+ *
+ * A provider is called on the thread of the session with no lock held but
+ * the shared one of the provider list, it may render the same path on two
+ * threads at once.  Without a provider open() costs an atomic load.
+ */
+#include "async_tftpd_server.hpp"
+#include "file_cache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tftpd {
+
+class virtual_files
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    void add(const std::string &pattern, file_provider provider, const provider_cache &cache);
+
+    /// forget the files rendered by the providers of the pattern
+    void invalidate(const std::string &pattern);
+
+    /// remove all providers
+    void clear();
+
+    /// the content of the file at the path relative to the rootdir, nullptr
+    /// if no provider has it
+    content_ptr open(const std::string &path);
+
+    /// the rendered and rendered_hits of the file_cache_counters
+    void count(file_cache_counters &counters) const;
+
+private:
+    struct rendered_file
+    {
+        content_ptr content;
+        clock_type::time_point rendered;
+    };
+
+    struct registered
+    {
+        std::string pattern;
+        file_provider render;
+        provider_cache cache;
+
+        std::shared_mutex mutex; // of the files
+        std::unordered_map<std::string, rendered_file> files;
+        std::deque<std::pair<std::string, clock_type::time_point>> order; // NOTE: rendered, the oldest first
+    };
+
+    /// the file rendered before if it is not too old, else render it
+    content_ptr render(registered &p, const std::string &path);
+
+    mutable std::shared_mutex mutex_; // of the providers
+    std::vector<std::unique_ptr<registered>> providers_;
+    std::atomic<bool> empty_{true};
+    std::atomic<uint64_t> rendered_{0};
+    std::atomic<uint64_t> hits_{0};
+};
+
+} // namespace tftpd
@@ -0,0 +1,123 @@
+#ifdef NDEBUG
+#    undef NDEBUG
+#endif
+
+// NOTE: the per MAC config files of a PXE boot rendered in memory and kept until they are too old! CK
+
+#include "virtual_files.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string read_all(const tftpd::content_ptr &content)
+{
+    std::string data(content->size(), 0);
+    assert(content->read(0, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+    return data;
+}
+
+} // namespace
+
+int main()
+{
+    using namespace std::chrono_literals;
+
+    try {
+        tftpd::virtual_files files;
+        assert(!files.open("pxelinux.cfg/01-00-11-22-33-44-55"));
+
+        // the known MACs get their config, the others none
+        std::map<std::string, std::string> hosts{{"00-11-22-33-44-55", "node1"}, {"00-11-22-33-44-66", "node2"}};
+        std::map<std::string, int> calls;
+        files.add(
+            "pxelinux.cfg/01-*",
+            [&hosts, &calls](const std::string &path) -> std::optional<std::string> {
+                calls[path]++;
+                auto host = hosts.find(path.substr(path.rfind("01-") + 3));
+                if (host == hosts.end()) {
+                    return std::nullopt;
+                }
+                return "DEFAULT linux\nLABEL linux\n  KERNEL vmlinuz\n  APPEND hostname=" + host->second + "\n";
+            },
+            {1h, 2});
+
+        auto node1 = files.open("pxelinux.cfg/01-00-11-22-33-44-55");
+        assert(node1 && node1->cached());
+        assert(read_all(node1).find("hostname=node1\n") != std::string::npos);
+        assert(files.open("pxelinux.cfg/01-00-11-22-33-44-55") == node1);
+        assert(calls["pxelinux.cfg/01-00-11-22-33-44-55"] == 1);
+
+        assert(!files.open("pxelinux.cfg/01-00-11-22-33-44-77"));
+        assert(!files.open("pxelinux.cfg/default"));
+        assert(!files.open("other/pxelinux.cfg/01-00-11-22-33-44-55"));
+        assert(!files.open("pxelinux.cfg/01-00/11")); // NOTE: * does not match a slash
+        tftpd::file_cache_counters counters;
+        files.count(counters);
+        assert(counters.rendered == 1 && counters.rendered_hits == 1);
+
+        // beyond max_files the oldest is rendered again
+        assert(files.open("pxelinux.cfg/01-00-11-22-33-44-66"));
+        hosts["00-11-22-33-44-77"] = "node3";
+        assert(files.open("pxelinux.cfg/01-00-11-22-33-44-77"));
+        assert(files.open("pxelinux.cfg/01-00-11-22-33-44-55") != node1);
+        assert(calls["pxelinux.cfg/01-00-11-22-33-44-55"] == 2);
+
+        // invalidated after the data changed
+        hosts["00-11-22-33-44-55"] = "renamed";
+        files.invalidate("pxelinux.cfg/01-*");
+        assert(read_all(files.open("pxelinux.cfg/01-00-11-22-33-44-55")).find("hostname=renamed\n") !=
+               std::string::npos);
+
+        // the providers are asked in order, too old is rendered again
+        std::atomic<int> rendered{0};
+        files.add(
+            "pxelinux.cfg/*",
+            [&rendered](const std::string & /*path*/) {
+                rendered++;
+                return std::optional<std::string>("DEFAULT local\n");
+            },
+            {20ms, 100});
+        assert(read_all(files.open("pxelinux.cfg/default")) == "DEFAULT local\n");
+        assert(read_all(files.open("pxelinux.cfg/01-00-11-22-33-44-99")) == "DEFAULT local\n");
+        (void)files.open("pxelinux.cfg/default");
+        assert(rendered == 2);
+        std::this_thread::sleep_for(30ms);
+        (void)files.open("pxelinux.cfg/default");
+        assert(rendered == 3);
+
+        // many sessions at once
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&files, i] {
+                for (int n = 0; n < 1000; ++n) {
+                    auto content = files.open("pxelinux.cfg/" + std::to_string((i * n) % 300));
+                    assert(content && read_all(content) == "DEFAULT local\n");
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        files.count(counters);
+        std::cout << "rendered " << counters.rendered << " hits " << counters.rendered_hits << std::endl;
+
+        files.clear();
+        assert(!files.open("pxelinux.cfg/default"));
+
+    } catch (std::exception &e) {
+        std::cerr << "Exception: " << e.what() << "\n\n";
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}